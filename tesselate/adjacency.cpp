@@ -0,0 +1,83 @@
+//
+// MeshAdjacency
+//
+
+#include "adjacency.h"
+#include "mesh.h"
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+void MeshAdjacency::build(int numverts, const std::vector<Triangle> & tris)
+{
+    vector<int> cursor, ring;
+    int t, p, v, bad = 0;
+
+    clear();
+    numtris = (int) tris.size();
+
+    // count triangles incident on each vertex, shifted by one so that a prefix sum yields the offsets
+    vfoff.assign(numverts+1, 0);
+    for(t = 0; t < numtris; t++)
+        for(p = 0; p < 3; p++)
+        {
+            v = tris[t].v[p];
+            if(v >= 0 && v < numverts)
+                vfoff[v+1]++;
+            else
+                bad++;
+        }
+    if(bad > 0)
+        cerr << "Error MeshAdjacency::build: " << bad << " vertex indices out of bounds" << endl;
+    for(v = 0; v < numverts; v++)
+        vfoff[v+1] += vfoff[v];
+
+    // scatter triangle indices into their vertex slots, which keeps each list in increasing order
+    vfidx.resize(vfoff[numverts]);
+    cursor.assign(vfoff.begin(), vfoff.end()-1);
+    for(t = 0; t < numtris; t++)
+        for(p = 0; p < 3; p++)
+        {
+            v = tris[t].v[p];
+            if(v >= 0 && v < numverts)
+                vfidx[cursor[v]++] = t;
+        }
+
+    // every incident triangle contributes at most two neighbours, so a scratch ring of twice the
+    // incidence size holds all candidates in place, after which duplicates are removed per vertex
+    ring.resize(2 * vfidx.size());
+    vvoff.assign(numverts+1, 0);
+#pragma omp parallel for
+    for(int w = 0; w < numverts; w++)
+    {
+        int * r = ring.data() + 2 * vfoff[w];
+        int n = 0;
+        for(int f = vfoff[w]; f < vfoff[w+1]; f++)
+        {
+            const Triangle & tri = tris[vfidx[f]];
+            for(int q = 0; q < 3; q++)
+                if(tri.v[q] != w && tri.v[q] >= 0 && tri.v[q] < numverts)
+                    r[n++] = tri.v[q];
+        }
+        std::sort(r, r+n);
+        vvoff[w+1] = (int) (std::unique(r, r+n) - r);
+    }
+    for(v = 0; v < numverts; v++)
+        vvoff[v+1] += vvoff[v];
+
+    // compact the deduplicated lists into the final neighbour array
+    vvidx.resize(vvoff[numverts]);
+#pragma omp parallel for
+    for(int w = 0; w < numverts; w++)
+        std::copy(ring.begin() + 2 * vfoff[w], ring.begin() + 2 * vfoff[w] + (vvoff[w+1] - vvoff[w]), vvidx.begin() + vvoff[w]);
+}
+
+void MeshAdjacency::clear()
+{
+    vvoff.clear();
+    vvidx.clear();
+    vfoff.clear();
+    vfidx.clear();
+    numtris = 0;
+}
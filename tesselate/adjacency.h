@@ -0,0 +1,68 @@
+#ifndef _ADJACENCY
+#define _ADJACENCY
+/**
+ * @file
+ *
+ * Compact vertex incidence structure for triangle meshes, shared by all passes that need mesh topology.
+ */
+
+#include <vector>
+
+struct Triangle;
+
+/**
+ * Vertex-to-vertex and vertex-to-triangle incidence of a triangle mesh in compressed sparse row (CSR) form.
+ * The one-ring neighbours of vertex v are stored contiguously and in increasing order, starting at
+ * vvidx[vvoff[v]] and ending before vvidx[vvoff[v+1]]. Incident triangles are stored in the same way
+ * using vfoff and vfidx. Construction uses only a handful of flat allocations regardless of mesh size.
+ */
+class MeshAdjacency
+{
+private:
+    std::vector<int> vvoff; ///< start of each vertex's neighbour list in vvidx, with a trailing end marker
+    std::vector<int> vvidx; ///< concatenated one-ring vertex neighbours
+    std::vector<int> vfoff; ///< start of each vertex's incident triangle list in vfidx, with a trailing end marker
+    std::vector<int> vfidx; ///< concatenated incident triangle indices
+    int numtris;            ///< number of triangles the structure was built from
+
+public:
+
+    /// Default constructor
+    MeshAdjacency(){ numtris = 0; }
+
+    /**
+     * Build incidence lists from a triangle list. Out of bounds vertex indices are reported and skipped.
+     * @param numverts  number of vertices in the mesh
+     * @param tris      triangles indexing into the vertex list
+     */
+    void build(int numverts, const std::vector<Triangle> & tris);
+
+    /// Release all incidence lists
+    void clear();
+
+    /// Number of vertices covered by the structure
+    int numVerts() const { return vvoff.empty() ? 0 : (int) vvoff.size() - 1; }
+
+    /// Number of triangles covered by the structure
+    int numTris() const { return numtris; }
+
+    /// Number of distinct vertices sharing an edge with vertex @a v
+    int numNeighbours(int v) const { return vvoff[v+1] - vvoff[v]; }
+
+    /// Pointer to the sorted neighbour list of vertex @a v, of length numNeighbours(v)
+    const int * neighbours(int v) const { return vvidx.data() + vvoff[v]; }
+
+    /// Number of triangles incident on vertex @a v
+    int numIncident(int v) const { return vfoff[v+1] - vfoff[v]; }
+
+    /// Pointer to the incident triangle list of vertex @a v, in increasing order, of length numIncident(v)
+    const int * incident(int v) const { return vfidx.data() + vfoff[v]; }
+
+    /// Flattened neighbour offsets, for passes that stream over all vertices
+    const std::vector<int> & neighbourOffsets() const { return vvoff; }
+
+    /// Flattened neighbour indices, for passes that stream over all vertices
+    const std::vector<int> & neighbourIndices() const { return vvidx; }
+};
+
+#endif
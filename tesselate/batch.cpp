@@ -0,0 +1,234 @@
+/**
+ * @file
+ *
+ * Command line driver that runs the modelling pipeline without a display: load a scene, voxelise it, extract
+ * the isosurface, smooth, deform and write the result as STL, reporting the time taken by each stage.
+ */
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <boost/program_options.hpp>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "csg.h"
+#include "resultcache.h"
+#include "timer.h"
+
+using namespace std;
+namespace po = boost::program_options;
+
+/// Elapsed time of one pipeline stage
+struct StageTime
+{
+    string name;    ///< stage name
+    float secs;     ///< wall clock time in seconds, negative if the stage was skipped
+};
+
+static po::variables_map processOptions(int argc, const char **argv)
+{
+    po::options_description desc("Options");
+    desc.add_options()
+        ("help",                                                            "Show help")
+        ("scene", po::value<string>()->default_value("sample"),             "Scene to load, either built in (sample or expensive) or a scene file")
+        ("input,i", po::value<string>(),                                    "Load a single STL mesh instead of a built-in scene")
+        ("output,o", po::value<string>()->required(),                       "STL file for the final mesh")
+        ("voxel", po::value<float>()->default_value(0.05f),                 "Voxel side length")
+        ("threads", po::value<int>()->default_value(0),                     "Number of OpenMP threads, 0 for the runtime default")
+        ("smooth", po::value<string>()->default_value("taubin"),            "Smoothing scheme (none, laplacian, taubin or implicit)")
+        ("cache", po::value<string>(),                                      "Directory of voxel volumes and isosurfaces reused across runs of the same scene")
+        ("cache-size", po::value<int>()->default_value(1024),               "Size of the cache directory in megabytes above which the least recently used results are removed")
+        ("move", po::value<vector<string> >()->composing(),                 "Displace a control point of the 3x3x3 deformation lattice, as i,j,k,dx,dy,dz. May be repeated");
+
+    try
+    {
+        po::variables_map vm;
+        po::store(po::command_line_parser(argc, argv)
+                  .style(po::command_line_style::default_style & ~po::command_line_style::allow_guessing)
+                  .options(desc)
+                  .run(), vm);
+        if (vm.count("help"))
+        {
+            std::cout << desc << '\n';
+            exit(0);
+        }
+        po::notify(vm);
+        return vm;
+    }
+    catch (po::error &e)
+    {
+        std::cerr << e.what() << "\n\n" << desc << '\n';
+        std::exit(1);
+    }
+}
+
+/**
+ * Parse a control point displacement of the form i,j,k,dx,dy,dz
+ * @param spec          displacement specification
+ * @param[out] i, j, k  control point index
+ * @param[out] del      displacement
+ * @retval true if all six fields were read,
+ * @retval false otherwise
+ */
+static bool parseMove(const string & spec, int & i, int & j, int & k, cgp::Vector & del)
+{
+    string fields = spec;
+    char extra;
+
+    for(char & c: fields)
+        if(c == ',')
+            c = ' ';
+    istringstream in(fields);
+    if(!(in >> i >> j >> k >> del.i >> del.j >> del.k))
+        return false;
+    return !(in >> extra);
+}
+
+int main(int argc, const char **argv)
+{
+    po::variables_map vm = processOptions(argc, argv);
+    std::vector<StageTime> stages;
+    Scene scene;
+    ResultCache cache;
+    ffd def;
+    Timer timer;
+    float voxlen = vm["voxel"].as<float>();
+    string smoothing = vm["smooth"].as<string>();
+    bool ok;
+
+    if(voxlen <= 0.0f)
+    {
+        cerr << "Error tessbatch: voxel side length must be positive" << endl;
+        return 1;
+    }
+    if(vm["threads"].as<int>() > 0)
+    {
+#ifdef _OPENMP
+        omp_set_num_threads(vm["threads"].as<int>());
+#else
+        cerr << "Warning tessbatch: built without OpenMP, ignoring thread count" << endl;
+#endif
+    }
+    if(smoothing == "laplacian")
+        scene.setSmoothMode(SmoothMode::LAPLACIAN);
+    else if(smoothing == "taubin")
+        scene.setSmoothMode(SmoothMode::TAUBIN);
+    else if(smoothing == "implicit")
+        scene.setSmoothMode(SmoothMode::IMPLICIT);
+    else if(smoothing != "none")
+    {
+        cerr << "Error tessbatch: unknown smoothing scheme " << smoothing << endl;
+        return 1;
+    }
+
+    if(vm.count("cache"))
+    {
+        if(vm["cache-size"].as<int>() < 0 || !cache.open(vm["cache"].as<string>(), (std::uintmax_t) vm["cache-size"].as<int>() << 20))
+        {
+            cerr << "Error tessbatch: unable to use cache " << vm["cache"].as<string>() << endl;
+            return 1;
+        }
+        scene.setCache(&cache);
+    }
+
+    // same lattice as the interactive viewer, spanning the whole scene
+    def.setDim(3, 3, 3);
+    def.setFrame(cgp::Point(-10.0f, -10.0f, -10.0f), cgp::Vector(20.0f, 20.0f, 20.0f));
+    if(vm.count("move"))
+        for(const string & spec: vm["move"].as<vector<string> >())
+        {
+            int i, j, k;
+            cgp::Vector del;
+            if(!parseMove(spec, i, j, k, del) || i < 0 || i > 2 || j < 0 || j > 2 || k < 0 || k > 2)
+            {
+                cerr << "Error tessbatch: bad control point displacement " << spec << endl;
+                return 1;
+            }
+            cgp::Point cp = def.getCP(i, j, k);
+            def.setCP(i, j, k, cgp::Point(cp.x + del.i, cp.y + del.j, cp.z + del.k));
+        }
+
+    // load
+    timer.start();
+    if(vm.count("input"))
+        ok = scene.meshScene(vm["input"].as<string>());
+    else if(vm["scene"].as<string>() == "sample")
+    {
+        scene.sampleScene();
+        ok = true;
+    }
+    else if(vm["scene"].as<string>() == "expensive")
+    {
+        scene.expensiveScene();
+        ok = true;
+    }
+    else
+        ok = scene.loadScene(vm["scene"].as<string>());
+    timer.stop();
+    if(!ok)
+        return 1;
+    stages.push_back({"load", timer.peek()});
+
+    timer.start();
+    scene.voxelise(voxlen);
+    timer.stop();
+    stages.push_back({"voxelise", timer.peek()});
+
+    timer.start();
+    scene.isoextract();
+    timer.stop();
+    stages.push_back({"isoextract", timer.peek()});
+
+    if(smoothing != "none")
+    {
+        timer.start();
+        scene.smooth();
+        timer.stop();
+        stages.push_back({"smooth", timer.peek()});
+    }
+    else
+        stages.push_back({"smooth", -1.0f});
+
+    if(vm.count("move"))
+    {
+        timer.start();
+        scene.deform(&def);
+        timer.stop();
+        stages.push_back({"deform", timer.peek()});
+    }
+    else
+        stages.push_back({"deform", -1.0f});
+
+    timer.start();
+    ok = scene.writeSTL(vm["output"].as<string>());
+    timer.stop();
+    if(!ok)
+    {
+        cerr << "Error tessbatch: unable to write " << vm["output"].as<string>() << endl;
+        return 1;
+    }
+    stages.push_back({"write", timer.peek()});
+
+    // timing report
+    float total = 0.0f;
+    cout << endl << left << setw(12) << "stage" << right << setw(12) << "seconds" << endl;
+    for(const StageTime & st: stages)
+    {
+        cout << left << setw(12) << st.name << right << setw(12);
+        if(st.secs < 0.0f)
+            cout << "skipped" << endl;
+        else
+        {
+            cout << fixed << setprecision(3) << st.secs << endl;
+            total += st.secs;
+        }
+    }
+    cout << left << setw(12) << "total" << right << setw(12) << fixed << setprecision(3) << total << endl;
+    cout << "vertices " << scene.getIsosurface()->getVerts().size() << ", triangles " << scene.getIsosurface()->getTris().size() << endl;
+    if(cache.enabled())
+        cout << "cache hits " << cache.numHits() << ", misses " << cache.numMisses() << endl;
+    return 0;
+}
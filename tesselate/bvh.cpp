@@ -0,0 +1,272 @@
+//
+// TriangleBVH
+//
+
+#include "bvh.h"
+#include "mesh.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+void TriangleBVH::build(const PointArray & verts, const std::vector<Triangle> & tris, int leafsize)
+{
+    int numtris = (int) tris.size();
+    std::vector<cgp::Point> centroids(numtris);
+
+    clear();
+    if(numtris == 0)
+        return;
+
+    triboxes.resize(numtris);
+    order.resize(numtris);
+#pragma omp parallel for
+    for(int t = 0; t < numtris; t++)
+    {
+        cgp::BoundBox box;
+        for(int p = 0; p < 3; p++)
+            box.includePnt(verts[tris[t].v[p]]);
+        triboxes[t] = box;
+        centroids[t] = cgp::Point(0.5f * (box.min.x + box.max.x), 0.5f * (box.min.y + box.max.y), 0.5f * (box.min.z + box.max.z));
+        order[t] = t;
+    }
+
+    // a median split produces at most 2n / leafsize nodes
+    nodes.reserve(2 * (numtris / std::max(leafsize, 1) + 1));
+    nodes.resize(1);
+    subdivide(0, 0, numtris, centroids, std::max(leafsize, 1));
+}
+
+void TriangleBVH::subdivide(int nodeidx, int first, int count, const std::vector<cgp::Point> & centroids, int leafsize)
+{
+    cgp::BoundBox box, cbox;
+    int axis, mid, child;
+    float ext[3];
+
+    for(int i = first; i < first + count; i++)
+    {
+        box.includeBox(triboxes[order[i]]);
+        cbox.includePnt(centroids[order[i]]);
+    }
+    nodes[nodeidx].box = box;
+    nodes[nodeidx].child = -1;
+    nodes[nodeidx].first = first;
+    nodes[nodeidx].count = count;
+
+    // split along the axis of greatest centroid spread, stopping if the centroids coincide
+    ext[0] = cbox.max.x - cbox.min.x; ext[1] = cbox.max.y - cbox.min.y; ext[2] = cbox.max.z - cbox.min.z;
+    axis = 0;
+    if(ext[1] > ext[axis]) axis = 1;
+    if(ext[2] > ext[axis]) axis = 2;
+    if(count <= leafsize || ext[axis] <= 0.0f)
+        return;
+
+    mid = first + count / 2;
+    std::nth_element(order.begin() + first, order.begin() + mid, order.begin() + first + count,
+        [&centroids, axis](int a, int b){
+            const cgp::Point & ca = centroids[a], & cb = centroids[b];
+            return (axis == 0) ? ca.x < cb.x : ((axis == 1) ? ca.y < cb.y : ca.z < cb.z);
+        });
+
+    child = (int) nodes.size();
+    nodes.resize(child + 2);
+    nodes[nodeidx].child = child;
+    nodes[nodeidx].count = 0;
+    subdivide(child, first, mid - first, centroids, leafsize);
+    subdivide(child + 1, mid, first + count - mid, centroids, leafsize);
+}
+
+void TriangleBVH::clear()
+{
+    nodes.clear();
+    order.clear();
+    triboxes.clear();
+}
+
+void TriangleBVH::query(const cgp::BoundBox & box, std::vector<int> & hits) const
+{
+    int stack[64], top = 0;
+
+    if(nodes.empty())
+        return;
+
+    // median splits keep the depth logarithmic, so a fixed stack suffices
+    stack[top++] = 0;
+    while(top > 0)
+    {
+        const BVHNode & node = nodes[stack[--top]];
+        if(!node.box.overlaps(box))
+            continue;
+        if(node.child < 0)
+        {
+            for(int i = node.first; i < node.first + node.count; i++)
+                if(triboxes[order[i]].overlaps(box))
+                    hits.push_back(order[i]);
+        }
+        else
+        {
+            stack[top++] = node.child;
+            stack[top++] = node.child + 1;
+        }
+    }
+}
+
+//
+// Triangle-triangle intersection
+//
+
+/// Double precision 3D vector used by the intersection test
+struct DVec
+{
+    double x[3];
+};
+
+static inline DVec dsub(const DVec & a, const DVec & b){ DVec r; for(int i = 0; i < 3; i++) r.x[i] = a.x[i] - b.x[i]; return r; }
+static inline double ddot(const DVec & a, const DVec & b){ return a.x[0]*b.x[0] + a.x[1]*b.x[1] + a.x[2]*b.x[2]; }
+static inline DVec dcross(const DVec & a, const DVec & b)
+{
+    DVec r;
+    r.x[0] = a.x[1]*b.x[2] - a.x[2]*b.x[1];
+    r.x[1] = a.x[2]*b.x[0] - a.x[0]*b.x[2];
+    r.x[2] = a.x[0]*b.x[1] - a.x[1]*b.x[0];
+    return r;
+}
+static inline DVec dpnt(const cgp::Point & p){ DVec r; r.x[0] = p.x; r.x[1] = p.y; r.x[2] = p.z; return r; }
+
+/// Signed area of the 2D triangle abc, positive if counterclockwise
+static inline double orient2D(const double a[2], const double b[2], const double c[2])
+{
+    return (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+}
+
+/// Test whether 2D segments ab and cd share a point, including collinear overlap
+static bool segSegIntersect2D(const double a[2], const double b[2], const double c[2], const double d[2])
+{
+    double o1 = orient2D(a, b, c), o2 = orient2D(a, b, d), o3 = orient2D(c, d, a), o4 = orient2D(c, d, b);
+
+    if(((o1 > 0.0 && o2 < 0.0) || (o1 < 0.0 && o2 > 0.0)) && ((o3 > 0.0 && o4 < 0.0) || (o3 < 0.0 && o4 > 0.0)))
+        return true;
+
+    // collinear cases, where an endpoint lies on the other segment
+    auto onSeg = [](const double p[2], const double q[2], const double r[2]){
+        return std::min(p[0], q[0]) <= r[0] && r[0] <= std::max(p[0], q[0]) && std::min(p[1], q[1]) <= r[1] && r[1] <= std::max(p[1], q[1]);
+    };
+    return (o1 == 0.0 && onSeg(a, b, c)) || (o2 == 0.0 && onSeg(a, b, d)) || (o3 == 0.0 && onSeg(c, d, a)) || (o4 == 0.0 && onSeg(c, d, b));
+}
+
+/// Test whether 2D point p lies inside or on the boundary of triangle t
+static bool pointInTri2D(const double p[2], const double t[3][2])
+{
+    double d0 = orient2D(t[0], t[1], p), d1 = orient2D(t[1], t[2], p), d2 = orient2D(t[2], t[0], p);
+    bool neg = (d0 < 0.0) || (d1 < 0.0) || (d2 < 0.0);
+    bool pos = (d0 > 0.0) || (d1 > 0.0) || (d2 > 0.0);
+    return !(neg && pos);
+}
+
+/// Intersection test for two triangles lying in a common plane with normal n
+static bool coplanarTriTri(const DVec & n, const DVec p[3], const DVec q[3])
+{
+    double a[3][2], b[3][2];
+    int i0, i1;
+
+    // project onto the coordinate plane that maximises the projected area
+    double ax = fabs(n.x[0]), ay = fabs(n.x[1]), az = fabs(n.x[2]);
+    if(ax >= ay && ax >= az) { i0 = 1; i1 = 2; }
+    else if(ay >= az) { i0 = 0; i1 = 2; }
+    else { i0 = 0; i1 = 1; }
+    for(int i = 0; i < 3; i++)
+    {
+        a[i][0] = p[i].x[i0]; a[i][1] = p[i].x[i1];
+        b[i][0] = q[i].x[i0]; b[i][1] = q[i].x[i1];
+    }
+
+    for(int i = 0; i < 3; i++)
+        for(int j = 0; j < 3; j++)
+            if(segSegIntersect2D(a[i], a[(i+1)%3], b[j], b[(j+1)%3]))
+                return true;
+
+    // no edge crossings, so either one triangle contains the other or they are disjoint
+    return pointInTri2D(a[0], b) || pointInTri2D(b[0], a);
+}
+
+/**
+ * Interval of the line of intersection of two planes covered by a triangle, parametrised by projection onto the line direction
+ * @param pv    projections of the triangle vertices onto the line direction
+ * @param d     signed distances of the triangle vertices from the other triangle's plane, not all of the same sign
+ * @param[out] t0, t1   ends of the interval in increasing order
+ */
+static void lineInterval(const double pv[3], const double d[3], double & t0, double & t1)
+{
+    int iso;
+
+    // find the vertex alone on its side of the plane
+    if(d[0] * d[1] > 0.0)
+        iso = 2;
+    else if(d[0] * d[2] > 0.0)
+        iso = 1;
+    else if(d[1] * d[2] > 0.0 || d[0] != 0.0)
+        iso = 0;
+    else if(d[1] != 0.0)
+        iso = 1;
+    else
+        iso = 2;
+
+    int a = (iso+1)%3, b = (iso+2)%3;
+    t0 = (d[iso] == d[a]) ? pv[a] : pv[iso] + (pv[a] - pv[iso]) * d[iso] / (d[iso] - d[a]);
+    t1 = (d[iso] == d[b]) ? pv[b] : pv[iso] + (pv[b] - pv[iso]) * d[iso] / (d[iso] - d[b]);
+    if(t0 > t1)
+        std::swap(t0, t1);
+}
+
+bool triTriIntersect(const cgp::Point & p0, const cgp::Point & p1, const cgp::Point & p2,
+                     const cgp::Point & q0, const cgp::Point & q1, const cgp::Point & q2)
+{
+    DVec p[3] = {dpnt(p0), dpnt(p1), dpnt(p2)}, q[3] = {dpnt(q0), dpnt(q1), dpnt(q2)};
+    DVec n1, n2, dir;
+    double dp[3], dq[3], pv[3], qv[3], tol1, tol2, len, ta0, ta1, tb0, tb1;
+    int axis;
+
+    // plane of the second triangle, rejecting if the first lies strictly to one side
+    n2 = dcross(dsub(q[1], q[0]), dsub(q[2], q[0]));
+    len = 0.0;
+    for(int i = 0; i < 3; i++)
+        len = std::max(len, std::max(sqrt(ddot(dsub(p[(i+1)%3], p[i]), dsub(p[(i+1)%3], p[i]))), sqrt(ddot(dsub(q[(i+1)%3], q[i]), dsub(q[(i+1)%3], q[i])))));
+    tol2 = 1.0e-12 * sqrt(ddot(n2, n2)) * len; // distances below this are rounding noise
+    for(int i = 0; i < 3; i++)
+    {
+        dp[i] = ddot(n2, dsub(p[i], q[0]));
+        if(fabs(dp[i]) < tol2)
+            dp[i] = 0.0;
+    }
+    if((dp[0] > 0.0 && dp[1] > 0.0 && dp[2] > 0.0) || (dp[0] < 0.0 && dp[1] < 0.0 && dp[2] < 0.0))
+        return false;
+
+    // and the reverse
+    n1 = dcross(dsub(p[1], p[0]), dsub(p[2], p[0]));
+    tol1 = 1.0e-12 * sqrt(ddot(n1, n1)) * len;
+    for(int i = 0; i < 3; i++)
+    {
+        dq[i] = ddot(n1, dsub(q[i], p[0]));
+        if(fabs(dq[i]) < tol1)
+            dq[i] = 0.0;
+    }
+    if((dq[0] > 0.0 && dq[1] > 0.0 && dq[2] > 0.0) || (dq[0] < 0.0 && dq[1] < 0.0 && dq[2] < 0.0))
+        return false;
+
+    if((dp[0] == 0.0 && dp[1] == 0.0 && dp[2] == 0.0) || (dq[0] == 0.0 && dq[1] == 0.0 && dq[2] == 0.0))
+        return coplanarTriTri(n1, p, q);
+
+    // both triangles straddle the other's plane, so compare the intervals they cover on the line where the planes meet
+    dir = dcross(n1, n2);
+    axis = 0;
+    if(fabs(dir.x[1]) > fabs(dir.x[axis])) axis = 1;
+    if(fabs(dir.x[2]) > fabs(dir.x[axis])) axis = 2;
+    for(int i = 0; i < 3; i++)
+    {
+        pv[i] = p[i].x[axis];
+        qv[i] = q[i].x[axis];
+    }
+    lineInterval(pv, dp, ta0, ta1);
+    lineInterval(qv, dq, tb0, tb1);
+    return ta0 <= tb1 && tb0 <= ta1;
+}
@@ -0,0 +1,93 @@
+#ifndef _BVH
+#define _BVH
+/**
+ * @file
+ *
+ * Bounding volume hierarchy over mesh triangles, with an exact triangle-triangle intersection test for use on query results.
+ */
+
+#include <vector>
+#include "vecpnt.h"
+#include "soa.h"
+
+struct Triangle;
+
+/**
+ * Node of a bounding volume hierarchy. Interior nodes have two children stored at consecutive
+ * indices starting at child, while leaves reference a contiguous run of the triangle order.
+ */
+struct BVHNode
+{
+    cgp::BoundBox box;  ///< bounds of all triangles below this node
+    int child;          ///< index of the first of two children, or -1 for a leaf
+    int first;          ///< start of this leaf's triangles in the triangle order
+    int count;          ///< number of triangles in a leaf, zero for interior nodes
+};
+
+/**
+ * Binary bounding volume hierarchy over the triangles of a mesh, stored as a flat node array.
+ * Built top down by splitting triangle centroids at the median of the widest axis.
+ */
+class TriangleBVH
+{
+private:
+    std::vector<BVHNode> nodes; ///< node array with the root at index 0
+    std::vector<int> order;     ///< triangle indices, permuted so each leaf covers a contiguous run
+    std::vector<cgp::BoundBox> triboxes;   ///< bounds of each triangle, indexed by triangle
+
+    /**
+     * Recursively subdivide a run of the triangle order
+     * @param nodeidx   node to fill in, already allocated
+     * @param first     start of the run in the triangle order
+     * @param count     length of the run
+     * @param centroids triangle centroids, indexed by triangle
+     * @param leafsize  maximum number of triangles in a leaf
+     */
+    void subdivide(int nodeidx, int first, int count, const std::vector<cgp::Point> & centroids, int leafsize);
+
+public:
+
+    /// Default constructor
+    TriangleBVH(){}
+
+    /**
+     * Build the hierarchy over a triangle list
+     * @param verts     vertex positions
+     * @param tris      triangles indexing into verts
+     * @param leafsize  maximum number of triangles in a leaf
+     */
+    void build(const PointArray & verts, const std::vector<Triangle> & tris, int leafsize = 4);
+
+    /// Release the hierarchy
+    void clear();
+
+    /// Test whether the hierarchy is empty
+    bool empty() const { return nodes.empty(); }
+
+    /// Number of nodes in the hierarchy
+    int numNodes() const { return (int) nodes.size(); }
+
+    /// Bounds of triangle @a t as used during construction
+    const cgp::BoundBox & triangleBox(int t) const { return triboxes[t]; }
+
+    /**
+     * Find all triangles whose bounds overlap a query box. Safe to call concurrently from several threads
+     * @param box       query bounding box
+     * @param[out] hits indices of triangles with overlapping bounds, in no particular order. Appended to, not cleared
+     */
+    void query(const cgp::BoundBox & box, std::vector<int> & hits) const;
+};
+
+/**
+ * Test for intersection between two triangles in 3D, evaluated in double precision using Moller's interval overlap method,
+ * with a separate two-dimensional test for coplanar triangles. Vertex distances to the other triangle's plane below a
+ * relative tolerance of 1e-12 are treated as zero, so near-touching and touching both count as intersecting.
+ * @param p0, p1, p2    vertices of the first triangle
+ * @param q0, q1, q2    vertices of the second triangle
+ * @retval true if the triangles share at least one point,
+ * @retval false otherwise
+ */
+bool triTriIntersect(const cgp::Point & p0, const cgp::Point & p1, const cgp::Point & p2,
+                     const cgp::Point & q0, const cgp::Point & q1, const cgp::Point & q2);
+
+#endif
@@ -0,0 +1,131 @@
+//
+// CompactMesh
+//
+
+#include "compactmesh.h"
+#include "mesh.h"
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+const float maxquant = 65535.0f; ///< largest quantised coordinate
+const int maxnarrowverts = 65536; ///< most vertices addressable by 16 bit indices
+
+void CompactMesh::clear()
+{
+    origin = cgp::Point(0.0f, 0.0f, 0.0f);
+    step = cgp::Vector(0.0f, 0.0f, 0.0f);
+    qx.clear(); qy.clear(); qz.clear();
+    narrowidx.clear();
+    wideidx.clear();
+    wide = false;
+}
+
+size_t CompactMesh::memoryBytes() const
+{
+    return 3 * qx.size() * sizeof(uint16_t) + narrowidx.size() * sizeof(uint16_t) + wideidx.size() * sizeof(uint32_t);
+}
+
+bool CompactMesh::encode(const PointArray & verts, const std::vector<Triangle> & tris)
+{
+    int numverts = verts.size(), numtris = (int) tris.size();
+    cgp::BoundBox bbox;
+    cgp::Vector diag;
+
+    clear();
+    for(int t = 0; t < numtris; t++)
+        for(int p = 0; p < 3; p++)
+            if(tris[t].v[p] < 0 || tris[t].v[p] >= numverts)
+            {
+                cerr << "Error CompactMesh::encode: triangle " << t << " has out of bounds vertex index " << tris[t].v[p] << endl;
+                return false;
+            }
+
+    // quantise each axis over the bounding box, with a flat axis keeping a zero step
+    bbox = verts.bounds();
+    if(numverts > 0)
+    {
+        origin = bbox.min;
+        diag = bbox.getDiag();
+        step = cgp::Vector(diag.i / maxquant, diag.j / maxquant, diag.k / maxquant);
+    }
+    float rx = (step.i > 0.0f) ? 1.0f / step.i : 0.0f;
+    float ry = (step.j > 0.0f) ? 1.0f / step.j : 0.0f;
+    float rz = (step.k > 0.0f) ? 1.0f / step.k : 0.0f;
+    const float * px = verts.xs(), * py = verts.ys(), * pz = verts.zs();
+
+    qx.resize(numverts); qy.resize(numverts); qz.resize(numverts);
+#pragma omp parallel for schedule(static)
+    for(int v = 0; v < numverts; v++)
+    {
+        qx[v] = (uint16_t) std::min(maxquant, std::max(0.0f, roundf((px[v] - origin.x) * rx)));
+        qy[v] = (uint16_t) std::min(maxquant, std::max(0.0f, roundf((py[v] - origin.y) * ry)));
+        qz[v] = (uint16_t) std::min(maxquant, std::max(0.0f, roundf((pz[v] - origin.z) * rz)));
+    }
+
+    wide = (numverts > maxnarrowverts);
+    if(wide)
+        wideidx.resize(3 * numtris);
+    else
+        narrowidx.resize(3 * numtris);
+#pragma omp parallel for schedule(static)
+    for(int t = 0; t < numtris; t++)
+        for(int p = 0; p < 3; p++)
+        {
+            if(wide)
+                wideidx[3*t+p] = (uint32_t) tris[t].v[p];
+            else
+                narrowidx[3*t+p] = (uint16_t) tris[t].v[p];
+        }
+    return true;
+}
+
+void CompactMesh::decode(PointArray & verts, std::vector<Triangle> & tris) const
+{
+    int numverts = numVerts(), numtris = numTris();
+
+    verts.resize(numverts);
+    float * px = verts.xs(), * py = verts.ys(), * pz = verts.zs();
+#pragma omp parallel for simd schedule(static)
+    for(int v = 0; v < numverts; v++)
+    {
+        px[v] = origin.x + (float) qx[v] * step.i;
+        py[v] = origin.y + (float) qy[v] * step.j;
+        pz[v] = origin.z + (float) qz[v] * step.k;
+    }
+
+    tris.resize(numtris);
+#pragma omp parallel for schedule(static)
+    for(int t = 0; t < numtris; t++)
+    {
+        for(int p = 0; p < 3; p++)
+            tris[t].v[p] = index(3*t+p);
+        tris[t].n = faceNormal(t);
+    }
+}
+
+cgp::Point CompactMesh::getVert(int v) const
+{
+    return cgp::Point(origin.x + (float) qx[v] * step.i, origin.y + (float) qy[v] * step.j, origin.z + (float) qz[v] * step.k);
+}
+
+void CompactMesh::getTri(int t, int & v0, int & v1, int & v2) const
+{
+    v0 = index(3*t); v1 = index(3*t+1); v2 = index(3*t+2);
+}
+
+cgp::Vector CompactMesh::faceNormal(int t) const
+{
+    cgp::Vector evec[2], n;
+    cgp::Point p0 = getVert(index(3*t)), p1 = getVert(index(3*t+1)), p2 = getVert(index(3*t+2));
+
+    // same construction as Mesh::faceNormal, counter-clockwise winding from the front
+    evec[0].diff(p0, p1);
+    evec[1].diff(p0, p2);
+    evec[0].normalize();
+    evec[1].normalize();
+    n.cross(evec[0], evec[1]);
+    n.normalize();
+    return n;
+}
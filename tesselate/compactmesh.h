@@ -0,0 +1,97 @@
+#ifndef _COMPACTMESH
+#define _COMPACTMESH
+/**
+ * @file
+ *
+ * Compact storage for large triangle meshes, with quantised vertex positions and narrow indices.
+ */
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "vecpnt.h"
+#include "soa.h"
+
+struct Triangle;
+
+/**
+ * Triangle mesh stored in a reduced form for holding large isosurfaces. Vertex coordinates are quantised to 16 bits
+ * relative to the bounding box, triangle indices are 16 bits wide when there are few enough vertices and 32 bits otherwise,
+ * and face normals are not stored but derived on demand. Topology is preserved exactly, positions to within half a
+ * quantisation step, and converting back and forth again reproduces the same compact form.
+ */
+class CompactMesh
+{
+private:
+    cgp::Point origin;          ///< minimum corner of the bounding box, the position of quantised coordinate 0
+    cgp::Vector step;           ///< distance between successive quantised coordinates along each axis
+    std::vector<uint16_t> qx, qy, qz;   ///< quantised vertex coordinates, stored as separate arrays
+    std::vector<uint16_t> narrowidx;    ///< flattened triangle vertex indices when there are at most 65536 vertices
+    std::vector<uint32_t> wideidx;      ///< flattened triangle vertex indices otherwise
+    bool wide;                  ///< whether wideidx rather than narrowidx is in use
+
+    /// Triangle vertex index at position i of the flattened index list
+    inline int index(int i) const { return wide ? (int) wideidx[i] : (int) narrowidx[i]; }
+
+public:
+
+    /// Default constructor
+    CompactMesh(){ clear(); }
+
+    /// Remove all vertices and triangles
+    void clear();
+
+    /// Number of vertices
+    int numVerts() const { return (int) qx.size(); }
+
+    /// Number of triangles
+    int numTris() const { return (int) (wide ? wideidx.size() : narrowidx.size()) / 3; }
+
+    /// Test whether 32 bit indices are needed
+    bool wideIndices() const { return wide; }
+
+    /// Distance between successive quantised coordinates along each axis, twice the largest position error
+    cgp::Vector quantisationStep() const { return step; }
+
+    /// Bytes of storage used by the vertex and index arrays
+    size_t memoryBytes() const;
+
+    /**
+     * Replace contents with a compact copy of a full mesh
+     * @param verts     vertex positions
+     * @param tris      triangles indexing into verts, whose normals are discarded
+     * @retval true if the mesh was encoded,
+     * @retval false if a triangle index is out of bounds, in which case the compact mesh is left empty
+     */
+    bool encode(const PointArray & verts, const std::vector<Triangle> & tris);
+
+    /**
+     * Expand to a full mesh, with face normals derived from the dequantised positions
+     * @param[out] verts    vertex positions
+     * @param[out] tris     triangles indexing into verts
+     */
+    void decode(PointArray & verts, std::vector<Triangle> & tris) const;
+
+    /**
+     * Dequantised position of a vertex
+     * @param v     vertex index
+     * @returns     vertex position
+     */
+    cgp::Point getVert(int v) const;
+
+    /**
+     * Vertex indices of a triangle, in counterclockwise winding
+     * @param t     triangle index
+     * @param[out] v0, v1, v2   vertex indices
+     */
+    void getTri(int t, int & v0, int & v1, int & v2) const;
+
+    /**
+     * Outward facing unit normal of a triangle, derived from its dequantised vertices
+     * @param t     triangle index
+     * @returns     unit normal, or the zero vector for a degenerate triangle
+     */
+    cgp::Vector faceNormal(int t) const;
+};
+
+#endif
@@ -3,12 +3,17 @@
 //
 
 #include "csg.h"
+#include "meshcsg.h"
+#include "sceneparser.h"
+#include "csgplan.h"
+#include "resultcache.h"
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
 #include <iostream>
 #include <limits>
 #include <stack>
+#include <set>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/rotate_vector.hpp>
@@ -19,6 +24,22 @@ using namespace std;
 GLfloat defaultCol[] = {0.243f, 0.176f, 0.75f, 1.0f};
 
 bool Scene::genVizRender(View * view, ShapeDrawData &sdd)
+{
+    geom.clear();
+    geom.setColour(defaultCol);
+    genVizGeometry(&geom, view);
+
+    // bind geometry to buffers and return drawing parameters, if possible
+    if(geom.bindBuffers(view))
+    {
+        sdd = geom.getDrawParameters();
+        return true;
+    }
+    else
+        return false;
+}
+
+void Scene::genVizGeometry(ShapeGeometry * out, View * view)
 {
     std::vector<ShapeNode *> leaves;
     std::stack<SceneNode *> nodes;
@@ -27,9 +48,6 @@ bool Scene::genVizRender(View * view, ShapeDrawData &sdd)
     ShapeNode * currshape;
     int i;
 
-    geom.clear();
-    geom.setColour(defaultCol);
-
     // gather vector of leaf nodes
     if(csgroot != NULL)
     {
@@ -77,8 +95,15 @@ bool Scene::genVizRender(View * view, ShapeDrawData &sdd)
     // traverse leaf shapes generating geometry
     for(i = 0; i < (int) leaves.size(); i++)
     {
-        leaves[i]->shape->genGeometry(&geom, view);
+        leaves[i]->shape->genGeometry(out, view);
     }
+}
+
+bool Scene::genVoxRender(View * view, ShapeDrawData &sdd)
+{
+    geom.clear();
+    geom.setColour(defaultCol);
+    genVoxGeometry(&geom);
 
     // bind geometry to buffers and return drawing parameters, if possible
     if(geom.bindBuffers(view))
@@ -90,16 +115,13 @@ bool Scene::genVizRender(View * view, ShapeDrawData &sdd)
         return false;
 }
 
-bool Scene::genVoxRender(View * view, ShapeDrawData &sdd)
+void Scene::genVoxGeometry(ShapeGeometry * out)
 {
     int x, y, z, xdim, ydim, zdim;
     glm::mat4 tfm, idt;
     glm::vec3 trs;
     cgp::Point pnt;
 
-    geom.clear();
-    geom.setColour(defaultCol);
-
     if(rep == SceneRep::VOXELS)
     {
         idt = glm::mat4(1.0f); // identity matrix
@@ -116,78 +138,83 @@ bool Scene::genVoxRender(View * view, ShapeDrawData &sdd)
                         pnt = vox.getVoxelPos(x, y, z); // convert from voxel space to world coordinates
                         trs = glm::vec3(pnt.x, pnt.y, pnt.z);
                         tfm = glm::translate(idt, trs);
-                        geom.genSphere(voxsidelen * 5.0f, 3, 3, tfm);
+                        out->genSphere(voxsidelen * 5.0f, 3, 3, tfm);
                     }
                 }
 
     }
+}
 
-    // bind geometry to buffers and return drawing parameters, if possible
-    if(geom.bindBuffers(view))
+void deleteSceneGraph(SceneNode * root)
+{
+    std::stack<SceneNode *> nodes;
+    std::set<SceneNode *> visited;
+    std::vector<SceneNode *> order;
+
+    // gather each node once, since subtrees may be shared
+    if(root != NULL)
+        nodes.push(root);
+    while(!nodes.empty())
     {
-        sdd = geom.getDrawParameters();
-        return true;
+        SceneNode * currnode = nodes.top();
+        nodes.pop();
+        if(currnode == NULL || !visited.insert(currnode).second)
+            continue;
+        order.push_back(currnode);
+
+        if(OpNode * currop = dynamic_cast<OpNode*> (currnode))
+        {
+            nodes.push(currop->right);
+            nodes.push(currop->left);
+        }
+        else if(NaryOpNode * currnary = dynamic_cast<NaryOpNode*> (currnode))
+        {
+            for(SceneNode * child: currnary->children)
+                nodes.push(child);
+        }
+        else if(!dynamic_cast<ShapeNode*> (currnode))
+        {
+            cerr << "Error deleteSceneGraph: CSG tree is not properly formed" << endl;
+        }
     }
-    else
-        return false;
+
+    for(SceneNode * currnode: order)
+        delete currnode;
 }
 
 Scene::Scene()
 {
     csgroot = NULL;
+    parser = NULL;
     col = defaultCol;
     voldiag = cgp::Vector(20.0f, 20.0f, 20.0f);
     voxsidelen = 0.0f;
+    changed = {0, 0, 0, -1, -1, -1};
+    chunkscurrent = false;
+    cache = NULL;
+    voxkey = 0;
+    progress = NULL;
     rep = SceneRep::TREE;
+    smoothmode = SmoothMode::TAUBIN;
 }
 
 Scene::~Scene()
 {
     clear();
+    delete parser;
 }
 
 void Scene::clear()
 {
-    std::stack<SceneNode *> nodes;
-    SceneNode * currnode;
-    OpNode * currop;
-    ShapeNode * currleaf;
-
     geom.clear();
     vox.clear();
-
-    // walk csg tree and deallocate nodes
-    if(csgroot != NULL)
-    {
-        nodes.push(csgroot);
-
-        // explicit walk of csg tree using stack
-        while(!nodes.empty())
-        {
-            currnode = nodes.top();
-            nodes.pop(); // calls destructor
-
-            if(dynamic_cast<OpNode*> (currnode))
-            {
-                currop = dynamic_cast<OpNode*> (currnode);
-                nodes.push(currop->right);
-                nodes.push(currop->left);
-                delete currop;
-            }
-            else
-            {
-                if(dynamic_cast<ShapeNode*> (currnode))
-                {
-                    currleaf = dynamic_cast<ShapeNode*> (currnode);
-                    delete currleaf;
-                }
-                else
-                {
-                    cerr << "Error Scene::clear(): CSG tree is not properly formed" << endl;
-                }
-            }
-        }
-    }
+    deleteSceneGraph(csgroot);
+    csgroot = NULL;
+    voxbounds.clear();
+    dirty.reset();
+    isochunks.clear();
+    chunkscurrent = false;
+    voxkey = 0;
 }
 
 bool Scene::bindGeometry(View * view, ShapeDrawData &sdd)
@@ -213,7 +240,29 @@ bool Scene::bindGeometry(View * view, ShapeDrawData &sdd)
     return pass;
 }
 
-void Scene::voxSetOp(SetOp op, VoxelVolume *leftarg, VoxelVolume *rightarg)
+void Scene::genGeometry(ShapeGeometry * out)
+{
+    out->clear();
+    switch(rep)
+    {
+        case SceneRep::TREE:
+            out->setColour(defaultCol);
+            genVizGeometry(out, NULL);
+            break;
+        case SceneRep::VOXELS:
+            out->setColour(defaultCol);
+            genVoxGeometry(out);
+            break;
+        case SceneRep::ISOSURFACE:
+            out->setColour(voxmesh.getColour());
+            voxmesh.genGeometry(out, NULL);
+            break;
+        default:
+            break;
+    }
+}
+
+void Scene::voxSetOp(SetOp op, VoxelVolume *leftarg, VoxelVolume *rightarg, const VoxelRange & range)
 {
     /*
      switch based on op
@@ -222,139 +271,499 @@ void Scene::voxSetOp(SetOp op, VoxelVolume *leftarg, VoxelVolume *rightarg)
      DIFFERENCE: wherever voxel is set in rightarg turn it off in leftarg
      */
 
-    int x, y, z, dx1, dx2, dy1, dy2, dz1, dz2;
-
-    // check that volume sizes match
-    leftarg->getDim(dx1, dy1, dz1);
-    rightarg->getDim(dx2, dy2, dz2);
-    if(dx1 != dx2 || dy1 != dy2 || dz1 != dz2)
-    {
-    }
-    else
+    // voxels outside the range are empty in rightarg and so unchanged by any operation
+    // both arguments are blocks of the same grid, so rows are combined a word at a time
+    switch(op)
     {
-        switch(op)
-        {
-            case SetOp::UNION: // wherever voxel is set in rightarg copy to leftarg
-                for(x = 0; x < dx1; x++)
-                    for(y = 0; y < dy1; y++)
-                        for(z = 0; z < dz1; z++)
-                            if(rightarg->get(x,y,z))
-                                leftarg->set(x,y,z,true);
-                break;
-            case SetOp::INTERSECTION: // if voxel is set in leftarg, check to see if it is also set in rightarg, otherwise switch it off
-                for(x = 0; x < dx1; x++)
-                    for(y = 0; y < dy1; y++)
-                        for(z = 0; z < dz1; z++)
-                            if(leftarg->get(x,y,z))
-                                if(!rightarg->get(x,y,z))
-                                    leftarg->set(x,y,z,false);
-                break;
-            case SetOp::DIFFERENCE: // wherever voxel is set in rightarg turn it off in leftarg
-                for(x = 0; x < dx1; x++)
-                    for(y = 0; y < dy1; y++)
-                        for(z = 0; z < dz1; z++)
-                            if(rightarg->get(x,y,z))
-                                leftarg->set(x,y,z,false);
-                break;
-            default:
-                break;
-        }
+        case SetOp::UNION: // wherever voxel is set in rightarg copy to leftarg
+            leftarg->combineRange(* rightarg, range, VoxelOp::OR);
+            break;
+        case SetOp::INTERSECTION: // if voxel is set in leftarg, check to see if it is also set in rightarg, otherwise switch it off
+            leftarg->combineRange(* rightarg, range, VoxelOp::AND);
+            break;
+        case SetOp::DIFFERENCE: // wherever voxel is set in rightarg turn it off in leftarg
+            leftarg->combineRange(* rightarg, range, VoxelOp::ANDNOT);
+            break;
+        default:
+            break;
     }
 }
 
-void Scene::voxWalk(SceneNode *root, VoxelVolume *voxels)
+void Scene::voxWalk(SceneNode *root, const CSGPlan & plan, const VoxelRange & clip, VoxMemo & memo, VoxelVolume *voxels)
 {
     // traverse csg tree by depth first recursive walk
     /*
      if(root is leaf)
-     convert to voxel rep, store in voxels
+     allocate voxels over its bounds, convert to voxel rep within them
      else
-     voxWalk left tree (leftnode, voxels)
-     allocate rightvoxels, copy parameters from voxels
-     voxWalk right tree (rightnode, rightvoxels)
-     apply opp to voxels and rightvoxels store results in voxels
-     deallocate rightvoxels
+     allocate voxels over the bounds of root
+     voxWalk first operand (scratch), copy into voxels
+     for each remaining operand
+        voxWalk operand (scratch), which allocates it over the bounds of the operand
+        apply op to voxels and scratch store results in voxels
+     deallocate scratch
      */
 
     VoxelVolume * rightvoxels;
     ShapeNode * shapenode;
     OpNode * opnode;
-    int dx, dy, dz;
-    cgp::Point o;
-    cgp::Vector d;
+    NaryOpNode * narynode;
+    VoxelRange range, sub;
+
+    // every volume holds only the block of the scene grid in which its subtree can be occupied
+    vox.getBoxRange(plan.getBounds(root), range);
+    range = range.intersect(clip);
+    voxels->setSubVolume(vox, range);
+    if(range.empty())
+        return;
 
     if(dynamic_cast<ShapeNode*>( root )) // ShapeNode
     {
         shapenode = dynamic_cast<ShapeNode*>( root );
-        // efficiency could be improved by only considering bounding box area
-        voxels->getDim(dx, dy, dz);
-        for(int x = 0; x < dx; x++)
-        {
+        VoxelRange held = voxels->getGridRange();
+        // sample at the positions of the scene grid, so that results agree whichever block holds them
 #pragma omp parallel for
-            for(int y = 0; y < dy; y++)
-                for(int z = 0; z < dz; z++)
-                    voxels->set(x,y,z, shapenode->shape->pointContainment(voxels->getVoxelPos(x,y,z)));
+        for(int z = range.z0; z <= range.z1; z++)
+        {
+            if(progress != NULL && progress->cancelled())
+                continue;
+            for(int y = range.y0; y <= range.y1; y++)
+                for(int x = range.x0; x <= range.x1; x++)
+                    voxels->set(x - held.x0, y - held.y0, z - held.z0, shapenode->shape->pointContainment(vox.getVoxelPos(x,y,z)));
+            if(progress != NULL)
+                progress->step();
+        }
+    }
+    else if(dynamic_cast<NaryOpNode*>( root ))
+    {
+        narynode = dynamic_cast<NaryOpNode*>( root );
+        // a single scratch volume is reused by every operand, so memory does not grow with chain length
+        rightvoxels = new VoxelVolume();
+        for(int i = 0; i < (int) narynode->children.size(); i++)
+        {
+            voxShared(narynode->children[i], plan, range, memo, rightvoxels);
+            if(i == 0)
+                voxels->pasteRange(* rightvoxels, rightvoxels->getGridRange().intersect(range));
+            else if(narynode->op == SetOp::INTERSECTION)
+                voxSetOp(narynode->op, voxels, rightvoxels, range); // empty beyond the operand's block
+            else
+                voxSetOp(narynode->op, voxels, rightvoxels, rightvoxels->getGridRange().intersect(range));
         }
+        delete rightvoxels;
     }
-    else // OpNode
+    else if(dynamic_cast<OpNode*>( root )) // Sanity check in case something is wrong with the tree
     {
-        if(dynamic_cast<OpNode*>( root )) // Sanity check in case something is wrong with the tree
+        opnode = dynamic_cast<OpNode*>( root );
+        rightvoxels = new VoxelVolume();
+        voxShared(opnode->left, plan, range, memo, rightvoxels);
+        voxels->pasteRange(* rightvoxels, rightvoxels->getGridRange().intersect(range));
+        if(opnode->op == SetOp::DIFFERENCE)
         {
-            // as pointed out by Mark this could have memory issues with the wrong kind of unbalanced tree
-            // could be fixed if memory allocation for voxel volume where delayed to leaf nodes
-            opnode = dynamic_cast<OpNode*>( root );
-            voxWalk(opnode->left, voxels);
-            voxels->getDim(dx, dy, dz);
-            voxels->getFrame(o, d);
-            rightvoxels = new VoxelVolume(dx, dy, dz, o, d);
-            voxWalk(opnode->right, rightvoxels);
-            voxSetOp(opnode->op, voxels, rightvoxels);
-            delete rightvoxels;
+            // the subtrahend only matters where there is something to remove it from
+            sub = rightvoxels->getGridRange().intersect(range);
+            if(sub.empty())
+            {
+                delete rightvoxels;
+                return;
+            }
         }
         else
+            sub = range;
+        voxShared(opnode->right, plan, sub, memo, rightvoxels);
+        if(opnode->op == SetOp::INTERSECTION)
+            voxSetOp(opnode->op, voxels, rightvoxels, range);
+        else
+            voxSetOp(opnode->op, voxels, rightvoxels, rightvoxels->getGridRange().intersect(sub));
+        delete rightvoxels;
+    }
+    else
+    {
+        cerr << "Error Scene::voxWalk: csg tree is not properly formed" << endl;
+    }
+}
+
+void Scene::voxShared(SceneNode *root, const CSGPlan & plan, const VoxelRange & clip, VoxMemo & memo, VoxelVolume *voxels)
+{
+    VoxelRange range;
+
+    if(plan.getUses(root) < 2)
+    {
+        voxWalk(root, plan, clip, memo, voxels);
+        return;
+    }
+
+    auto it = memo.vols.find(root);
+    if(it == memo.vols.end())
+    {
+        // evaluate over all of its bounds so that the result serves every parent, whatever its clipping range
+        VoxelVolume * whole = new VoxelVolume();
+        voxWalk(root, plan, vox.getFullRange(), memo, whole);
+        it = memo.vols.insert(std::make_pair(root, whole)).first;
+        memo.remaining[root] = plan.getUses(root);
+    }
+    range = it->second->getGridRange().intersect(clip);
+    voxels->setSubVolume(vox, range);
+    voxels->pasteRange(* it->second, range);
+
+    // free intermediate results as soon as nothing else refers to them
+    if(--memo.remaining[root] == 0)
+    {
+        delete it->second;
+        memo.vols.erase(it);
+        memo.remaining.erase(root);
+    }
+}
+
+long Scene::planSlices(const CSGPlan & plan, const VoxelRange & range)
+{
+    std::stack<SceneNode *> nodes;
+    std::set<SceneNode *> visited;
+    VoxelRange block;
+    long slices = 0;
+
+    if(plan.getRoot() != NULL)
+        nodes.push(plan.getRoot());
+    while(!nodes.empty())
+    {
+        SceneNode * currnode = nodes.top();
+        nodes.pop();
+        if(currnode == NULL || !visited.insert(currnode).second)
+            continue;
+        if(dynamic_cast<ShapeNode*> (currnode))
+        {
+            vox.getBoxRange(plan.getBounds(currnode), block);
+            block = block.intersect(range);
+            if(!block.empty())
+                slices += block.z1 - block.z0 + 1;
+        }
+        else if(OpNode * currop = dynamic_cast<OpNode*> (currnode))
+        {
+            nodes.push(currop->right);
+            nodes.push(currop->left);
+        }
+        else if(NaryOpNode * currnary = dynamic_cast<NaryOpNode*> (currnode))
+        {
+            for(SceneNode * child: currnary->children)
+                nodes.push(child);
+        }
+    }
+    return slices;
+}
+
+void Scene::voxRange(const VoxelRange & range, VoxelVolume *voxels)
+{
+    CSGPlan plan;
+    VoxMemo memo;
+    cgp::BoundBox region;
+
+    // simplify the tree within the block before evaluating it
+    region.includePnt(vox.getVoxelPos(range.x0, range.y0, range.z0));
+    region.includePnt(vox.getVoxelPos(range.x1, range.y1, range.z1));
+    plan.build(csgroot, region);
+    const PlanStats & stats = plan.getStats();
+    cerr << "CSG plan: " << stats.plannodes << " nodes (" << stats.treenodes << " as written), " << stats.pruned << " pruned, "
+         << stats.shared << " shared, " << stats.planvolumes << " voxel volumes (" << stats.treevolumes << " as written)" << endl;
+
+    // work is counted in slices of leaf shapes, of which there are at most one per slice through each distinct leaf
+    if(progress != NULL)
+        progress->start(planSlices(plan, range));
+
+    // actual recursive depth-first walk of csg tree, into a volume covering just the bounds of the result
+    voxels->fill(false);
+    if(plan.getRoot() != NULL)
+    {
+        VoxelVolume result;
+        voxWalk(plan.getRoot(), plan, range, memo, &result);
+        voxels->pasteRange(result, result.getGridRange().intersect(range));
+    }
+    for(auto & held: memo.vols) // left over where a use was skipped because it could not affect the result
+        delete held.second;
+    if(progress != NULL && progress->cancelled())
+        return;
+    if(progress != NULL)
+        progress->finish();
+
+    // remember where each shape was, so that later edits know which voxels to revisit
+    recordBounds();
+}
+
+void Scene::recordBounds()
+{
+    std::stack<SceneNode *> nodes;
+
+    voxbounds.clear();
+    if(csgroot != NULL)
+        nodes.push(csgroot);
+    while(!nodes.empty())
+    {
+        SceneNode * currnode = nodes.top();
+        nodes.pop();
+        if(ShapeNode * currshape = dynamic_cast<ShapeNode*> (currnode))
         {
-            cerr << "Error Scene::voxWalk: csg tree is not properly formed" << endl;
+            if(!voxbounds.count(currnode))
+                voxbounds[currnode] = currshape->shape->bounds();
+        }
+        else if(OpNode * currop = dynamic_cast<OpNode*> (currnode))
+        {
+            nodes.push(currop->right);
+            nodes.push(currop->left);
         }
     }
 }
 
-void Scene::voxelise(float voxlen)
+bool Scene::voxelise(float voxlen)
 {
     int xdim, ydim, zdim;
+    cgp::BoundBox box;
+    std::uint64_t key = 0;
+    VoxelVolume fitted;
 
-    // calculate voxel volume dimensions based on voxlen
-    xdim = ceil(voldiag.i / voxlen)+2; // needs a 1 voxel border to ensure a closed mesh
-    ydim = ceil(voldiag.j / voxlen)+2;
-    zdim = ceil(voldiag.k / voxlen)+2;
-    voxsidelen = voxlen;
+    if(cache != NULL && cache->enabled())
+    {
+        key = cache->sceneKey(csgroot, voxlen);
+        if(cache->loadVoxels(key, fitted))
+        {
+            cerr << "Voxel volume read from cache" << endl;
+            vox.swap(fitted);
+            recordBounds();
+            adoptVoxels(voxlen, key);
+            if(progress != NULL)
+            {
+                progress->start(1);
+                progress->finish();
+            }
+            return true;
+        }
+    }
+
+    box = csgBounds(csgroot);
+    if(boxEmpty(box)) // nothing is contained, so fall back on the default scene extent
+    {
+        box.min = cgp::Point(-0.5f*voldiag.i, -0.5f*voldiag.j, -0.5f*voldiag.k);
+        box.max = cgp::Point(0.5f*voldiag.i, 0.5f*voldiag.j, 0.5f*voldiag.k);
+    }
 
-    cgp::Vector voxdiag = cgp::Vector((float) xdim * voxlen, (float) ydim * voxlen, (float) zdim * voxlen);
-    cgp::Point voxorigin = cgp::Point(-0.5f*voxdiag.i, -0.5f*voxdiag.j, -0.5f*voxdiag.k);
-    vox.setDim(xdim, ydim, zdim);
-    vox.setFrame(voxorigin, voxdiag);
+    // fit the volume to the bounds of the tree, with a 1 voxel border to ensure a closed mesh
+    xdim = ceil((box.max.x - box.min.x) / voxlen)+3;
+    ydim = ceil((box.max.y - box.min.y) / voxlen)+3;
+    zdim = ceil((box.max.z - box.min.z) / voxlen)+3;
+    fitted.setDim(xdim, ydim, zdim);
+    fitted.getDim(xdim, ydim, zdim); // rows are padded to whole words, which extends the volume along x
+
+    // voxel positions are spaced exactly voxlen apart
+    cgp::Vector voxdiag = cgp::Vector((float) (xdim-1) * voxlen, (float) (ydim-1) * voxlen, (float) (zdim-1) * voxlen);
+    cgp::Point voxorigin = cgp::Point(box.min.x - voxlen, box.min.y - voxlen, box.min.z - voxlen);
+    fitted.setFrame(voxorigin, voxdiag);
 
     cerr << "Voxel volume dimensions = " << xdim << " x " << ydim << " x " << zdim << endl;
 
-    // actual recursive depth-first walk of csg tree
-    if(csgroot != NULL)
-        voxWalk(csgroot, &vox);
+    // evaluation works on the grid of vox, so the new volume is swapped in and the previous one held until it completes
+    vox.swap(fitted);
+    voxRange(vox.getFullRange(), &vox);
+    if(progress != NULL && progress->cancelled())
+    {
+        cerr << "Voxelisation cancelled" << endl;
+        vox.swap(fitted);
+        return false;
+    }
+    if(key != 0)
+        cache->storeVoxels(key, vox);
+    adoptVoxels(voxlen, key);
+    return true;
+}
+
+void Scene::adoptVoxels(float voxlen, std::uint64_t key)
+{
+    dirty.reset();
+    isochunks.clear(); // chunks no longer match the volume's dimensions
+    changed = {0, 0, 0, -1, -1, -1};
     rep = SceneRep::VOXELS;
+    voxsidelen = voxlen;
+    voxkey = key;
+}
+
+void Scene::markDirty(SceneNode * leaf)
+{
+    ShapeNode * shapenode = dynamic_cast<ShapeNode*>( leaf );
+
+    if(shapenode == NULL)
+    {
+        cerr << "Error Scene::markDirty: only shape nodes can be marked as edited" << endl;
+        return;
+    }
+
+    // voxels covered before the edit may need clearing and those covered after it may need setting
+    auto it = voxbounds.find(leaf);
+    if(it != voxbounds.end())
+        dirty.includeBox(it->second);
+    dirty.includeBox(shapenode->shape->bounds());
 }
 
-void Scene::isoextract()
+void Scene::revoxelise()
 {
-    voxmesh.marchingCubes(vox);
+    VoxelRange range;
+    cgp::Point o;
+    cgp::Vector d;
+    cgp::BoundBox box;
+
+    if(voxsidelen <= 0.0f)
+    {
+        cerr << "Error Scene::revoxelise: scene has not been voxelised" << endl;
+        return;
+    }
+
+    // an edit that takes the tree into the outermost voxels would open the mesh, so the volume is fitted to it again
+    box = csgBounds(csgroot);
+    vox.getFrame(o, d);
+    if(!boxEmpty(box) && (box.min.x <= o.x || box.min.y <= o.y || box.min.z <= o.z
+        || box.max.x >= o.x + d.i || box.max.y >= o.y + d.j || box.max.z >= o.z + d.k))
+    {
+        cerr << "Scene has outgrown the voxel volume" << endl;
+        voxelise(voxsidelen);
+        return;
+    }
+
+    if(vox.getBoxRange(dirty, range))
+    {
+        // the patch only spans the dirty block, so an edit costs in proportion to the voxels it touches
+        VoxelVolume patch;
+        patch.setSubVolume(vox, range);
+        cerr << "Revoxelising " << (range.x1-range.x0+1) << " x " << (range.y1-range.y0+1) << " x " << (range.z1-range.z0+1) << " voxels" << endl;
+        voxRange(range, &patch);
+        if(progress != NULL && progress->cancelled())
+        {
+            cerr << "Revoxelisation cancelled" << endl;
+            return;
+        }
+        vox.pasteRange(patch, range);
+        changed = changed.enclose(range);
+        voxkey = 0; // the volume may differ from one fitted to the edited tree, so it is no longer cached
+    }
+    dirty.reset();
+    rep = SceneRep::VOXELS;
+}
+
+bool Scene::isoextract()
+{
+    if(cache != NULL && voxkey != 0 && cache->loadMesh(voxkey, voxmesh))
+    {
+        // no chunks are kept for a cached surface, so a later isoupdate extracts them afresh
+        cerr << "Isosurface read from cache" << endl;
+        isochunks.clear();
+        chunkscurrent = false;
+        changed = {0, 0, 0, -1, -1, -1};
+        rep = SceneRep::ISOSURFACE;
+        if(progress != NULL)
+        {
+            progress->start(1);
+            progress->finish();
+        }
+        return true;
+    }
+
+    cerr << "Marching" << endl;
+    if(!isochunks.extract(vox, progress))
+    {
+        cerr << "Isosurface extraction cancelled" << endl;
+        return false;
+    }
+    changed = {0, 0, 0, -1, -1, -1};
+    rep = SceneRep::ISOSURFACE;
+    cerr << "Extracted " << isochunks.numChunks() << " chunks" << endl;
+    isochunks.assemble(voxmesh);
+    voxmesh.reorder();
+    chunkscurrent = true;
+    if(cache != NULL && voxkey != 0)
+        cache->storeMesh(voxkey, voxmesh);
+    return true;
+}
+
+void Scene::isoupdate()
+{
+    int redone;
+
+    if(isochunks.numChunks() == 0)
+    {
+        isoextract();
+        return;
+    }
+    redone = isochunks.update(vox, changed);
+    cerr << "Re-extracted " << redone << " of " << isochunks.numChunks() << " chunks" << endl;
+    isochunks.assemble(voxmesh);
+    voxmesh.reorder();
+    changed = {0, 0, 0, -1, -1, -1};
+    chunkscurrent = true;
+    rep = SceneRep::ISOSURFACE;
+}
+
+bool Scene::bindChunks(View * view, std::vector<ShapeDrawData> &sdd)
+{
+    if(rep != SceneRep::ISOSURFACE || !chunkscurrent)
+        return false;
+    isochunks.setColour(col);
+    isochunks.bindGeometry(view, sdd);
+    return true;
+}
+
+bool Scene::meshEvaluate(int slices)
+{
+    MeshCSG mcsg(slices);
+    PointArray verts;
+    std::vector<Triangle> tris;
+
+    if(!mcsg.evaluate(csgroot, verts, tris))
+        return false;
+    voxmesh.setGeometry(verts, tris);
+    voxmesh.reorder();
+    chunkscurrent = false;
     rep = SceneRep::ISOSURFACE;
+    return true;
 }
 
 void Scene::smooth()
 {
-    voxmesh.laplacianSmooth(6, 1.0f);
+    if(progress != NULL)
+        progress->start(1);
+    chunkscurrent = false;
+    switch(smoothmode)
+    {
+        case SmoothMode::LAPLACIAN:
+            voxmesh.laplacianSmooth(6, 1.0f);
+            break;
+        case SmoothMode::TAUBIN:
+            // Taubin's lambda|mu pair with a pass-band of about 0.1, which removes the marching cubes
+            // staircase without the shrinkage that repeated Laplacian smoothing causes
+            voxmesh.taubinSmooth(3, 0.6307f, -0.6732f);
+            break;
+        case SmoothMode::IMPLICIT:
+            // comparable to the six explicit iterations of the Laplacian mode, but in a single solve
+            voxmesh.implicitSmooth(6.0f);
+            break;
+    }
+    if(progress != NULL)
+        progress->finish();
 }
 
 void Scene::deform(ffd * def)
 {
-    voxmesh.applyFFD(def);
+    if(progress != NULL)
+        progress->start(1);
+    chunkscurrent = false;
+    // control point moves already applied, incrementally or before smoothing, are not applied again
+    voxmesh.followFFD(def);
+    if(progress != NULL)
+        progress->finish();
+}
+
+void Scene::moveControlPoint(ffd * def, int i, int j, int k, cgp::Point pnt)
+{
+    if(voxmesh.empty())
+        def->setCP(i, j, k, pnt);
+    else
+    {
+        voxmesh.moveFFDControlPoint(def, i, j, k, pnt);
+        chunkscurrent = false;
+    }
 }
 
 void Scene::sampleScene()
@@ -395,6 +804,7 @@ void Scene::expensiveScene()
     bunny->boxFit(10.0f);
     mesh->shape = bunny;
 
+    // the bunny node is shared by both operations, so it is voxelised only once
     OpNode * combine = new OpNode();
     combine->op = SetOp::UNION;
     combine->left = mesh;
@@ -407,3 +817,35 @@ void Scene::expensiveScene()
 
     csgroot = diff;
 }
+
+bool Scene::meshScene(string filename)
+{
+    Mesh * mesh = new Mesh();
+
+    clear();
+    if(!mesh->readSTL(filename))
+    {
+        cerr << "Error Scene::meshScene: unable to read " << filename << endl;
+        delete mesh;
+        return false;
+    }
+    mesh->boxFit(0.5f * std::min(voldiag.i, std::min(voldiag.j, voldiag.k)));
+
+    ShapeNode * leaf = new ShapeNode();
+    leaf->shape = mesh;
+    csgroot = leaf;
+    return true;
+}
+
+bool Scene::loadScene(string filename)
+{
+    SceneNode * root;
+
+    clear();
+    if(parser == NULL)
+        parser = new SceneParser();
+    if(!parser->parseFile(filename, root))
+        return false;
+    csgroot = root;
+    return true;
+}
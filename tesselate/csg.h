@@ -7,9 +7,13 @@
  */
 
 #include <vector>
+#include <map>
+#include <cstdint>
 #include <stdio.h>
 #include <iostream>
 #include "mesh.h"
+#include "isochunks.h"
+#include "progress.h"
 
 /**
  * Different types of binary set operations on shapes
@@ -31,6 +35,16 @@ enum class SceneRep
     ISOSURFACE, ///< final isosurface mesh representation
 };
 
+/**
+ * Smoothing schemes applied to the extracted isosurface
+ */
+enum class SmoothMode
+{
+    LAPLACIAN,  ///< explicit Laplacian iterations, which shrink the surface
+    TAUBIN,     ///< explicit lambda|mu iterations that largely preserve volume
+    IMPLICIT,   ///< single backward Euler step solved with conjugate gradients, stable for large steps
+};
+
 /// Base class for csg tree nodes
 class SceneNode
 {
@@ -39,14 +53,27 @@ public:
     virtual ~SceneNode(){};
 };
 
-/// Inherited class for internal csg tree boolean set operation nodes
+/**
+ * Inherited class for internal csg tree boolean set operation nodes. Children may be shared with other parents, making
+ * the tree a directed acyclic graph, so the node does not free its children; trees are freed with deleteSceneGraph
+ */
 class OpNode: public SceneNode
 {
 public:
     SceneNode * left, * right;
     SetOp op;
+};
 
-    ~OpNode(){ delete left; delete right; }
+/**
+ * Internal csg tree node that applies one associative set operation (union or intersection) across any number of
+ * operands, in order. Produced by CSGPlan when flattening chains of the same operation. Like OpNode it does not free
+ * its children, which may be shared; use deleteSceneGraph on trees that contain it
+ */
+class NaryOpNode: public SceneNode
+{
+public:
+    std::vector<SceneNode *> children;
+    SetOp op;
 };
 
 /// Inherited class for leaf csg tree shape nodes
@@ -58,6 +85,23 @@ public:
     ~ShapeNode(){ delete shape; }
 };
 
+/**
+ * Free every node of a CSG tree exactly once, even where subtrees are shared between several parents
+ * @param root  root node of the tree, may be NULL
+ */
+void deleteSceneGraph(SceneNode * root);
+
+class SceneParser;
+class CSGPlan;
+class ResultCache;
+
+/// Voxelised results of shared subtrees, held during one voxelisation until their last use
+struct VoxMemo
+{
+    std::map<SceneNode *, VoxelVolume *> vols;  ///< exact voxelisation of each shared subtree evaluated so far
+    std::map<SceneNode *, int> remaining;       ///< uses still to come before each volume can be freed
+};
+
 /**
  * CSG Tree that can be evaluated to produce a volumetric representation.
  */
@@ -66,11 +110,21 @@ class Scene
 private:
     SceneNode * csgroot;            ///< root node of the csg tree
     GLfloat * col;                  ///< (r,g,b,a) colour
-    cgp::Vector voldiag;                 ///< diagonal of scene bounding box in cm
+    cgp::Vector voldiag;            ///< diagonal of default scene bounding box in cm, used when the tree has no extent
     VoxelVolume vox;                ///< voxel representation of scene
     float voxsidelen;               ///< side length of a single voxel
     SceneRep rep;                   ///< which representation is current (tree, voxel, isosurface)
     Mesh voxmesh;                   ///< isosurface of voxel volume
+    SmoothMode smoothmode;          ///< scheme used to smooth the isosurface
+    SceneParser * parser;           ///< reader for scene files, kept so that mesh files are read once across loads
+    std::map<SceneNode *, cgp::BoundBox> voxbounds; ///< bounds of each shape when the voxels were last evaluated
+    cgp::BoundBox dirty;            ///< region of the voxel volume that no longer matches the tree
+    IsoChunks isochunks;            ///< isosurface split into independently extracted chunks
+    VoxelRange changed;             ///< voxels patched by revoxelise since the isosurface was extracted
+    bool chunkscurrent;             ///< whether the chunks match voxmesh, which stops being true once it is smoothed or deformed
+    ResultCache * cache;            ///< store of results shared between runs, NULL if results are always computed
+    std::uint64_t voxkey;           ///< cache key of the tree the voxels were evaluated from, 0 once they have been patched
+    StageProgress * progress;       ///< where stages report their progress and look for cancellation, NULL if unmonitored
 
     /**
      * Generate triangle mesh geometry for OpenGL rendering of all leaf nodes.
@@ -82,6 +136,13 @@ private:
      */
     bool genVizRender(View * view, ShapeDrawData &sdd);
 
+    /**
+     * Generate triangle mesh geometry for all leaf nodes, as drawn by genVizRender, without binding it
+     * @param[out] out  geometry to append to
+     * @param view      current view parameters, which may be NULL
+     */
+    void genVizGeometry(ShapeGeometry * out, View * view);
+
     /**
      * Generate triangle mesh geometry for OpenGL rendering of voxel structure.
      * Approximates voxel grid as a set of spheres. Extremely expensive to render but more accurate in
@@ -93,20 +154,70 @@ private:
      */
     bool genVoxRender(View * view, ShapeDrawData &sdd);
 
+    /**
+     * Generate the spheres drawn by genVoxRender for the voxel structure, without binding them
+     * @param[out] out  geometry to append to
+     */
+    void genVoxGeometry(ShapeGeometry * out);
+
     /**
      * Apply a boolean set operator given two volumetric operands.
      * @param op            boolean set operation being applied (union, intersection or difference). Applied as leftarg = leftarg op rightarg
-     * @param[out] leftarg  first voxel grid argument. Overwritten as the result for space reasons.
-     * @param rightarg      second voxel grid argument.
+     * @param[out] leftarg  first voxel grid argument, a block of the scene grid. Overwritten as the result for space reasons.
+     * @param rightarg      second voxel grid argument, which may hold a different block of the scene grid.
+     * @param range         grid indices of the voxels to combine, held by leftarg, outside which rightarg is empty
+     */
+    void voxSetOp(SetOp op, VoxelVolume *leftarg, VoxelVolume *rightarg, const VoxelRange & range);
+
+    /**
+     * Convert a CSG tree into a VoxelVolume by evaluating it with a recursive depth-first walk. Each intermediate
+     * volume holds only the block of the scene grid within the bounds of its subtree, so that memory follows the size
+     * of the features rather than the scene. Voxels outside the clipping range are left empty
+     * @param root          root node of a CSG tree optimised by plan
+     * @param plan          optimiser that produced the tree, which supplies node bounds
+     * @param clip          grid indices of the voxels in which the result must be exact
+     * @param memo          results of shared subtrees awaiting reuse
+     * @param[out] voxels   volumetric representation of the CSG tree, reallocated as a block of the scene grid
+     */
+    void voxWalk(SceneNode *root, const CSGPlan & plan, const VoxelRange & clip, VoxMemo & memo, VoxelVolume *voxels);
+
+    /**
+     * Evaluate a subtree that may have several parents, voxelising it on first use and copying the stored result on
+     * later uses. The stored volume is freed after the last use
+     * @param root          root node of the subtree
+     * @param plan          optimiser that produced the tree, which supplies node bounds and parent counts
+     * @param clip          grid indices of the voxels in which the result must be exact
+     * @param memo          results of shared subtrees awaiting reuse
+     * @param[out] voxels   volumetric representation of the subtree, reallocated as a block of the scene grid
+     */
+    void voxShared(SceneNode *root, const CSGPlan & plan, const VoxelRange & clip, VoxMemo & memo, VoxelVolume *voxels);
+
+    /**
+     * Estimate the work of evaluating an optimised tree, as the number of voxel slices through its distinct leaves
+     * @param plan      optimiser holding the tree
+     * @param range     voxels to evaluate
+     * @returns         slices of leaf shapes within range, an upper bound on those voxWalk samples
      */
-    void voxSetOp(SetOp op, VoxelVolume *leftarg, VoxelVolume *rightarg);
+    long planSlices(const CSGPlan & plan, const VoxelRange & range);
 
     /**
-     * Convert a CSG tree into a VoxelVolume by evaluating it with a recursive depth-first walk
-     * @param root          root node of the CSG tree
-     * @param[out] voxels   volumetric representation of the CSG tree
+     * Optimise and evaluate the csg tree within a block of the voxel volume, recording the bounds of its shapes unless
+     * cancelled through the progress monitor
+     * @param range         voxels to evaluate
+     * @param[out] voxels   volume on the grid of vox that holds range, such as vox itself or a sub-volume of it, exact
+     *                      within range and empty outside it
+     */
+    void voxRange(const VoxelRange & range, VoxelVolume *voxels);
+
+    /// Remember the bounds of every shape of the tree, so that later edits know which voxels to revisit
+    void recordBounds();
+
+    /**
+     * Make a newly completed voxel volume the current representation
+     * @param voxlen    side length of an individual voxel
+     * @param key       cache key of the tree it was evaluated from, or 0 if it is not cached
      */
-    void voxWalk(SceneNode *root, VoxelVolume *voxels);
+    void adoptVoxels(float voxlen, std::uint64_t key);
 
 public:
     //TODO: deleeeete
@@ -134,21 +245,90 @@ public:
      */
     bool bindGeometry(View * view, ShapeDrawData &sdd);
 
+    /**
+     * Generate triangle mesh geometry for the current representation, as drawn by bindGeometry, without binding it.
+     * Needs no rendering context, so it may run on a thread other than the one drawing
+     * @param[out] out  geometry to replace, ready for ShapeGeometry::bindBuffers
+     */
+    void genGeometry(ShapeGeometry * out);
+
+    /**
+     * Report the progress of voxelise, revoxelise, isoextract, smooth and deform, and let them be cancelled from
+     * another thread. Only voxelisation and isosurface extraction stop early when cancelled
+     * @param monitor   progress shared with the caller, which must outlive its use, or NULL to stop reporting
+     */
+    void setProgress(StageProgress * monitor){ progress = monitor; }
+
     /**
      * Access voxel volume associated with scene
      */
     VoxelVolume * getVox(){ return &vox; }
 
     /**
-     * convert csg tree into a voxel representation
+     * Access isosurface mesh associated with scene
+     */
+    Mesh * getIsosurface(){ return &voxmesh; }
+
+    /**
+     * Share results with other runs through an on-disk cache, which voxelise and isoextract consult before doing any work
+     * @param store     cache to use, which must outlive the scene, or NULL to always compute results
+     */
+    void setCache(ResultCache * store){ cache = store; }
+
+    /**
+     * convert csg tree into a voxel representation, in a volume fitted to the bounds of the tree given by csgBounds
      * @param voxlen    side length of an individual voxel
+     * @retval @c true  if the voxels were evaluated,
+     * @retval @c false if cancelled through the progress monitor, in which case the scene is left as it was
+     */
+    bool voxelise(float voxlen);
+
+    /**
+     * Record that a shape of the tree has been edited, for instance moved or resized, so that revoxelise updates the
+     * voxels it covered before the edit and those it covers after. Call after changing the shape's parameters
+     * @param leaf  shape node of the csg tree whose shape was changed
      */
-    void voxelise(float voxlen);
+    void markDirty(SceneNode * leaf);
+
+    /**
+     * bring the voxel representation up to date with edits recorded by markDirty, re-evaluating the tree only within
+     * the region those edits affect and patching the result into the existing voxels. Only changes to the parameters of
+     * existing shapes are tracked, so changes to the structure of the tree need a full voxelise. If the edits take the
+     * tree beyond the volume, it is voxelised again in full. If cancelled through the progress monitor the voxels are
+     * left as they were and the edits stay pending
+     */
+    void revoxelise();
 
     /**
      * convert voxel representation back into a mesh using marching cubes
+     * @retval @c true  if the isosurface was extracted,
+     * @retval @c false if cancelled through the progress monitor, in which case the scene is left as it was
+     */
+    bool isoextract();
+
+    /**
+     * bring the isosurface up to date with the voxels patched by revoxelise, extracting only the chunks that read those
+     * voxels again. Any smoothing or deformation of the isosurface is lost, as with isoextract
+     */
+    void isoupdate();
+
+    /**
+     * Bind the chunks of an isosurface that has not been smoothed or deformed, uploading only those extracted since
+     * they were last bound, so that local edits stay cheap to display
+     * @param view      current view parameters
+     * @param[out] sdd  drawing parameters of every non-empty chunk, appended to the list
+     * @retval @c true  if the chunks are the current representation and could be bound,
+     * @retval @c false otherwise, in which case bindGeometry should be used
      */
-    void isoextract();
+    bool bindChunks(View * view, std::vector<ShapeDrawData> &sdd);
+
+    /**
+     * convert csg tree directly into a mesh with boolean operations on tessellated shapes, bypassing voxelisation
+     * @param slices    subdivisions around the axis used when tessellating spheres and cylinders
+     * @retval @c true  if the tree was evaluated, in which case it replaces the extracted isosurface
+     * @retval @c false if the tree is malformed or contains unsupported shapes
+     */
+    bool meshEvaluate(int slices = 48);
 
     /**
      * smooth extracted isosurface to improve on aliasing artefacts that result from marching cubes
@@ -156,11 +336,27 @@ public:
     void smooth();
 
     /**
-     * apply free-form deformation to extracted isosurface
+     * Select the scheme used by smooth
+     * @param mode  smoothing scheme
+     */
+    void setSmoothMode(SmoothMode mode){ smoothmode = mode; }
+
+    /**
+     * apply free-form deformation to extracted isosurface, leaving out any control point moves it already reflects
      * @param def   free-form deformation lattice
      */
     void deform(ffd * def);
 
+    /**
+     * Move one control point of a free-form deformation lattice, updating the extracted isosurface incrementally
+     * so that only vertices near the control point are revisited. Once the isosurface follows a lattice in this way,
+     * deform with the same lattice has nothing left to apply
+     * @param def       free-form deformation lattice
+     * @param i, j, k   control point index in lattice
+     * @param pnt       new control point position
+     */
+    void moveControlPoint(ffd * def, int i, int j, int k, cgp::Point pnt);
+
     /**
      * create a sample csg tree to test different shapes and operators
      */
@@ -170,6 +366,22 @@ public:
      * create a sample csg tree to test different shapes and operators. Expensive because it uses mesh point containment with the Bunny.
      */
     void expensiveScene();
+
+    /**
+     * create a csg tree with a single triangle mesh read from file, scaled to half the width of the voxel volume
+     * @param filename  STL file to read
+     * @retval @c true  if the mesh was read,
+     * @retval @c false otherwise, in which case the tree is left empty
+     */
+    bool meshScene(string filename);
+
+    /**
+     * replace the csg tree with one read from a scene file, in the format described by SceneParser
+     * @param filename  scene file to read
+     * @retval @c true  if the file was read and parsed,
+     * @retval @c false otherwise, in which case the tree is left empty
+     */
+    bool loadScene(string filename);
 };
 
 #endif
@@ -0,0 +1,380 @@
+//
+// CSGPlan
+//
+
+#include "csgplan.h"
+#include "csg.h"
+#include <set>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+cgp::BoundBox boxIntersect(const cgp::BoundBox & a, const cgp::BoundBox & b)
+{
+    cgp::BoundBox box;
+
+    box.min = cgp::Point(std::max(a.min.x, b.min.x), std::max(a.min.y, b.min.y), std::max(a.min.z, b.min.z));
+    box.max = cgp::Point(std::min(a.max.x, b.max.x), std::min(a.max.y, b.max.y), std::min(a.max.z, b.max.z));
+    return box;
+}
+
+bool boxEmpty(const cgp::BoundBox & box)
+{
+    return box.min.x > box.max.x || box.min.y > box.max.y || box.min.z > box.max.z;
+}
+
+/**
+ * Bounds of a subtree by the rules of csgBounds
+ * @param node          subtree root
+ * @param[in,out] memo  bounds of each subtree visited so far, so that shared subtrees are visited once
+ * @returns             world space bounds of the subtree
+ */
+static cgp::BoundBox subtreeBounds(SceneNode * node, std::map<SceneNode *, cgp::BoundBox> & memo)
+{
+    cgp::BoundBox box;
+
+    if(node == NULL)
+        return box;
+    auto it = memo.find(node);
+    if(it != memo.end())
+        return it->second;
+
+    if(ShapeNode * leaf = dynamic_cast<ShapeNode *>(node))
+        box = leaf->shape->bounds();
+    else if(OpNode * op = dynamic_cast<OpNode *>(node))
+    {
+        box = subtreeBounds(op->left, memo);
+        if(op->op == SetOp::UNION)
+            box.includeBox(subtreeBounds(op->right, memo));
+        else if(op->op == SetOp::INTERSECTION)
+            box = boxIntersect(box, subtreeBounds(op->right, memo));
+    }
+    else if(NaryOpNode * nop = dynamic_cast<NaryOpNode *>(node))
+    {
+        for(int i = 0; i < (int) nop->children.size(); i++)
+        {
+            cgp::BoundBox child = subtreeBounds(nop->children[i], memo);
+            if(i == 0)
+                box = child;
+            else if(nop->op == SetOp::INTERSECTION)
+                box = boxIntersect(box, child);
+            else
+                box.includeBox(child);
+        }
+    }
+
+    // an empty box is kept in canonical form so that merging it with others has no effect
+    if(boxEmpty(box))
+        box.reset();
+    memo[node] = box;
+    return box;
+}
+
+cgp::BoundBox csgBounds(SceneNode * root)
+{
+    std::map<SceneNode *, cgp::BoundBox> memo;
+
+    return subtreeBounds(root, memo);
+}
+
+/// Volume enclosed by a box, zero if it is empty
+static float boxVolume(const cgp::BoundBox & box)
+{
+    if(boxEmpty(box))
+        return 0.0f;
+    return (box.max.x - box.min.x) * (box.max.y - box.min.y) * (box.max.z - box.min.z);
+}
+
+/**
+ * Gather the distinct nodes of a tree and the voxel volumes needed to evaluate it as written
+ * @param node          subtree root
+ * @param[in,out] seen  nodes visited so far
+ * @param[in,out] need  volumes needed by each visited node
+ * @returns             volumes needed by the subtree
+ */
+static int treeVolumes(SceneNode * node, std::set<SceneNode *> & seen, std::map<SceneNode *, int> & need)
+{
+    int n = 1;
+
+    if(node == NULL)
+        return 0;
+    if(need.count(node))
+        return need[node];
+    seen.insert(node);
+    if(OpNode * op = dynamic_cast<OpNode *>(node))
+        n = std::max(treeVolumes(op->left, seen, need), treeVolumes(op->right, seen, need) + 1);
+    else if(NaryOpNode * nop = dynamic_cast<NaryOpNode *>(node))
+        for(int i = 0; i < (int) nop->children.size(); i++)
+            n = std::max(n, treeVolumes(nop->children[i], seen, need) + (i > 0 ? 1 : 0));
+    need[node] = n;
+    return n;
+}
+
+/**
+ * Collect the operands of a chain of the same associative operation, looking through nested operation nodes
+ * @param node          subtree of the original tree
+ * @param op            union or intersection
+ * @param[out] operands subtrees combined by the chain, in order
+ */
+static void flattenChain(SceneNode * node, SetOp op, std::vector<SceneNode *> & operands)
+{
+    OpNode * bop = dynamic_cast<OpNode *>(node);
+    NaryOpNode * nop = dynamic_cast<NaryOpNode *>(node);
+
+    if(bop != NULL && bop->op == op)
+    {
+        flattenChain(bop->left, op, operands);
+        flattenChain(bop->right, op, operands);
+    }
+    else if(nop != NULL && nop->op == op)
+    {
+        for(SceneNode * child: nop->children)
+            flattenChain(child, op, operands);
+    }
+    else
+        operands.push_back(node);
+}
+
+void CSGPlan::clear()
+{
+    // children belong to the original tree or are freed separately
+    for(SceneNode * node: owned)
+        delete node;
+    owned.clear();
+    boxes.clear();
+    costs.clear();
+    volumes.clear();
+    uses.clear();
+    rewritten.clear();
+    root = NULL;
+    stats = PlanStats();
+}
+
+void CSGPlan::describeLeaf(SceneNode * leaf)
+{
+    ShapeNode * shapenode = dynamic_cast<ShapeNode *>(leaf);
+    cgp::BoundBox box;
+
+    if(boxes.count(leaf))
+        return;
+    box = shapenode->shape->bounds();
+    boxes[leaf] = box;
+    costs[leaf] = shapenode->shape->containmentCost() * boxVolume(box);
+    volumes[leaf] = 1;
+}
+
+cgp::BoundBox CSGPlan::getBounds(SceneNode * node) const
+{
+    auto it = boxes.find(node);
+
+    if(it == boxes.end())
+        return cgp::BoundBox();
+    return it->second;
+}
+
+int CSGPlan::getUses(SceneNode * node) const
+{
+    auto it = uses.find(node);
+
+    if(it == uses.end())
+        return 0;
+    return it->second;
+}
+
+SceneNode * CSGPlan::makeNary(SetOp op, std::vector<SceneNode *> & operands, const cgp::BoundBox & region)
+{
+    std::vector<SceneNode *> flat;
+    cgp::BoundBox box;
+    float cost = 0.0f;
+    int need = 0;
+
+    // operands rebuilt by this plan may themselves be chains of the same operation
+    for(SceneNode * node: operands)
+    {
+        NaryOpNode * nop = dynamic_cast<NaryOpNode *>(node);
+        if(nop != NULL && nop->op == op)
+            flat.insert(flat.end(), nop->children.begin(), nop->children.end());
+        else
+            flat.push_back(node);
+    }
+    if(flat.size() == 1)
+        return flat[0];
+
+    if(op == SetOp::INTERSECTION)
+        std::stable_sort(flat.begin(), flat.end(), [this](SceneNode * a, SceneNode * b){
+            return costs[a] < costs[b]; });
+    else
+        std::stable_sort(flat.begin(), flat.end(), [this](SceneNode * a, SceneNode * b){
+            return (volumes[a] != volumes[b]) ? volumes[a] > volumes[b] : costs[a] < costs[b]; });
+
+    NaryOpNode * nary = new NaryOpNode();
+    nary->op = op;
+    nary->children = flat;
+    owned.push_back(nary);
+
+    box = boxes[flat[0]];
+    for(int i = 0; i < (int) flat.size(); i++)
+    {
+        if(op == SetOp::INTERSECTION)
+            box = boxIntersect(box, boxes[flat[i]]);
+        else
+            box.includeBox(boxes[flat[i]]);
+        cost += costs[flat[i]];
+        need = std::max(need, volumes[flat[i]] + (i > 0 ? 1 : 0));
+    }
+    boxes[nary] = boxIntersect(box, region);
+    costs[nary] = cost;
+    volumes[nary] = need;
+    return nary;
+}
+
+SceneNode * CSGPlan::rewrite(SceneNode * node, const cgp::BoundBox & region)
+{
+    OpNode * bop = dynamic_cast<OpNode *>(node);
+    NaryOpNode * nop = dynamic_cast<NaryOpNode *>(node);
+    std::vector<SceneNode *> operands, kept;
+
+    if(dynamic_cast<ShapeNode *>(node))
+    {
+        describeLeaf(node);
+        if(boxEmpty(boxIntersect(boxes[node], region)))
+        {
+            stats.pruned++;
+            return NULL;
+        }
+        return node;
+    }
+    if(bop == NULL && nop == NULL)
+    {
+        cerr << "Error CSGPlan::rewrite: csg tree is not properly formed" << endl;
+        return NULL;
+    }
+
+    if(bop != NULL && bop->op == SetOp::DIFFERENCE)
+    {
+        // (a - b) - c is a - (b + c), so a chain of differences becomes a single subtraction of a union
+        SceneNode * base = node, * minuend, * subtrahend;
+        OpNode * diff;
+        while((diff = dynamic_cast<OpNode *>(base)) != NULL && diff->op == SetOp::DIFFERENCE)
+        {
+            operands.push_back(diff->right);
+            base = diff->left;
+        }
+        std::reverse(operands.begin(), operands.end());
+
+        minuend = rewriteShared(base, region);
+        if(minuend == NULL)
+            return NULL;
+
+        // only the part of each subtrahend overlapping the minuend matters
+        cgp::BoundBox subregion = boxIntersect(region, boxes[minuend]);
+        for(SceneNode * sub: operands)
+        {
+            SceneNode * rsub = rewriteShared(sub, subregion);
+            if(rsub != NULL)
+                kept.push_back(rsub);
+        }
+        if(kept.empty())
+            return minuend;
+        subtrahend = makeNary(SetOp::UNION, kept, subregion);
+
+        diff = new OpNode();
+        diff->op = SetOp::DIFFERENCE;
+        diff->left = minuend;
+        diff->right = subtrahend;
+        owned.push_back(diff);
+        boxes[diff] = boxIntersect(boxes[minuend], region);
+        costs[diff] = costs[minuend] + costs[subtrahend];
+        volumes[diff] = std::max(volumes[minuend], volumes[subtrahend] + 1);
+        return diff;
+    }
+
+    SetOp op = (bop != NULL) ? bop->op : nop->op;
+    flattenChain(node, op, operands);
+    if(op == SetOp::INTERSECTION)
+    {
+        cgp::BoundBox common = region;
+        for(SceneNode * operand: operands)
+        {
+            SceneNode * roperand = rewriteShared(operand, common);
+            if(roperand != NULL)
+                common = boxIntersect(common, boxes[roperand]);
+            if(roperand == NULL || boxEmpty(common))
+            {
+                // operands that do not overlap leave nothing
+                stats.pruned++;
+                return NULL;
+            }
+            kept.push_back(roperand);
+        }
+        return makeNary(op, kept, common);
+    }
+
+    for(SceneNode * operand: operands)
+    {
+        SceneNode * roperand = rewriteShared(operand, region);
+        if(roperand != NULL)
+            kept.push_back(roperand);
+    }
+    if(kept.empty())
+        return NULL;
+    return makeNary(op, kept, region);
+}
+
+/// Test whether two boxes have identical extents
+static bool sameBox(const cgp::BoundBox & a, const cgp::BoundBox & b)
+{
+    return a.min.x == b.min.x && a.min.y == b.min.y && a.min.z == b.min.z
+        && a.max.x == b.max.x && a.max.y == b.max.y && a.max.z == b.max.z;
+}
+
+SceneNode * CSGPlan::rewriteShared(SceneNode * node, const cgp::BoundBox & region)
+{
+    SceneNode * result;
+    auto it = rewritten.find(node);
+
+    if(it != rewritten.end() && sameBox(it->second.first, region))
+        return it->second.second;
+    result = rewrite(node, region);
+    rewritten[node] = std::make_pair(region, result);
+    return result;
+}
+
+void CSGPlan::build(SceneNode * tree, const cgp::BoundBox & region)
+{
+    std::set<SceneNode *> seen;
+    std::map<SceneNode *, int> need;
+
+    clear();
+    stats.treevolumes = treeVolumes(tree, seen, need);
+    stats.treenodes = (int) seen.size();
+    if(tree == NULL)
+        return;
+
+    root = rewriteShared(tree, region);
+    if(root != NULL)
+    {
+        seen.clear();
+        need.clear();
+        treeVolumes(root, seen, need);
+        stats.plannodes = (int) seen.size();
+        stats.planvolumes = volumes[root];
+
+        // count operand references, visiting the children of each node once
+        for(SceneNode * node: seen)
+        {
+            if(OpNode * op = dynamic_cast<OpNode *>(node))
+            {
+                uses[op->left]++;
+                uses[op->right]++;
+            }
+            else if(NaryOpNode * nop = dynamic_cast<NaryOpNode *>(node))
+                for(SceneNode * child: nop->children)
+                    uses[child]++;
+        }
+        for(auto & use: uses)
+            if(use.second > 1)
+                stats.shared++;
+    }
+}
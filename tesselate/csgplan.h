@@ -0,0 +1,137 @@
+#ifndef _CSGPLAN
+#define _CSGPLAN
+/**
+ * @file
+ *
+ * Optimisation of CSG trees ahead of voxelisation.
+ */
+
+#include <vector>
+#include <map>
+#include "vecpnt.h"
+
+class SceneNode;
+enum class SetOp;
+
+/// Summary of the changes made by CSGPlan
+struct PlanStats
+{
+    int treenodes;      ///< distinct nodes in the tree as written
+    int plannodes;      ///< distinct nodes in the optimised tree
+    int pruned;         ///< subtrees dropped because their bounds show they cannot contribute
+    int treevolumes;    ///< voxel volumes alive at once when evaluating the tree as written
+    int planvolumes;    ///< voxel volumes alive at once when evaluating the optimised tree
+    int shared;         ///< distinct nodes of the optimised tree with more than one parent
+};
+
+/**
+ * Rewrites a CSG tree into an equivalent tree that is cheaper to voxelise, using the bounding boxes of its shapes.
+ * The original tree is left untouched and its leaves are shared, so the plan is only valid while the tree exists.
+ * Subtrees shared by several parents of the original tree remain shared in the plan wherever they are rewritten within
+ * the same region, and the plan counts the parents of each node so that evaluation can reuse their results.
+ *  - Shapes outside the region of interest, intersections whose operands' bounds do not meet and subtrahends that
+ *    miss the bounds of what they are subtracted from are pruned.
+ *  - Chains of unions and of intersections are flattened into NaryOpNode operations, and chains of differences
+ *    (a - b) - c are rewritten as a - (b + c), so that deep unbalanced trees become shallow.
+ *  - Intersection operands are ordered by estimated cost, the product of containment cost and bounding volume, so
+ *    that cheap small shapes narrow the region in which expensive ones are evaluated. Union operands are ordered
+ *    to need the fewest voxel volumes alive at once, as in Sethi-Ullman register allocation, with ties broken by cost.
+ */
+class CSGPlan
+{
+private:
+    SceneNode * root;                               ///< root of the optimised tree, NULL if it is empty
+    std::vector<SceneNode *> owned;                 ///< operation nodes created by the plan
+    std::map<SceneNode *, cgp::BoundBox> boxes;     ///< conservative world space bounds of each node
+    std::map<SceneNode *, float> costs;             ///< estimated voxelisation cost of each node
+    std::map<SceneNode *, int> volumes;             ///< voxel volumes alive at once while evaluating each node
+    std::map<SceneNode *, int> uses;                ///< number of parents of each node of the optimised tree
+    std::map<SceneNode *, std::pair<cgp::BoundBox, SceneNode *> > rewritten; ///< region and result of each rewrite, by original node
+    PlanStats stats;                                ///< summary of the last build
+
+    /**
+     * Rewrite a subtree
+     * @param node      subtree of the original tree
+     * @param region    region of interest, outside which the subtree's contents do not matter
+     * @returns         equivalent optimised subtree, or NULL if it is empty within the region
+     */
+    SceneNode * rewrite(SceneNode * node, const cgp::BoundBox & region);
+
+    /**
+     * Build an operation over rewritten operands, or return the operand itself if there is only one
+     * @param op        union or intersection
+     * @param operands  rewritten operands, none of them NULL
+     * @param region    region of interest, used to clip the bounds of the result
+     * @returns         optimised operation node
+     */
+    SceneNode * makeNary(SetOp op, std::vector<SceneNode *> & operands, const cgp::BoundBox & region);
+
+    /**
+     * Rewrite a subtree, reusing an earlier rewrite of the same subtree within the same region
+     * @param node      subtree of the original tree
+     * @param region    region of interest
+     * @returns         equivalent optimised subtree, or NULL if it is empty within the region
+     */
+    SceneNode * rewriteShared(SceneNode * node, const cgp::BoundBox & region);
+
+    /// Record the bounds, cost and volume count of a leaf on first use
+    void describeLeaf(SceneNode * leaf);
+
+public:
+
+    /// Default constructor
+    CSGPlan(){ root = NULL; stats = PlanStats(); }
+
+    /// Destructor
+    ~CSGPlan(){ clear(); }
+
+    /// Free the nodes created by the plan, leaving the original tree alone
+    void clear();
+
+    /**
+     * Optimise a CSG tree for evaluation within a region
+     * @param tree      root of the tree as written, may be NULL
+     * @param region    region of interest, typically the extent of the voxel volume
+     */
+    void build(SceneNode * tree, const cgp::BoundBox & region);
+
+    /// Root of the optimised tree, NULL if the tree has nothing inside the region
+    SceneNode * getRoot() const { return root; }
+
+    /**
+     * Conservative bounds of a node of the optimised tree
+     * @param node  node of the optimised tree
+     * @returns     world space box outside which the node contains nothing
+     */
+    cgp::BoundBox getBounds(SceneNode * node) const;
+
+    /**
+     * Number of parents of a node of the optimised tree
+     * @param node  node of the optimised tree
+     * @returns     how many times the node is an operand, 0 for the root
+     */
+    int getUses(SceneNode * node) const;
+
+    /// Summary of the last build
+    const PlanStats & getStats() const { return stats; }
+};
+
+/**
+ * Intersection of two axis aligned boxes
+ * @param a, b  boxes to intersect
+ * @returns     common region, which has min greater than max along some axis if the boxes do not meet
+ */
+cgp::BoundBox boxIntersect(const cgp::BoundBox & a, const cgp::BoundBox & b);
+
+/// Test whether a box encloses no volume
+bool boxEmpty(const cgp::BoundBox & box);
+
+/**
+ * Tightest axis aligned box around a CSG tree that follows from the bounds of its shapes: the operands of a union are
+ * merged, those of an intersection overlapped, and a difference takes the bounds of what is subtracted from
+ * @param root  root of the tree, may be NULL or share subtrees
+ * @returns     world space bounds, empty if the tree can contain nothing
+ */
+cgp::BoundBox csgBounds(SceneNode * root);
+
+#endif
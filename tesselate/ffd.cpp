@@ -5,52 +5,37 @@
 #include "ffd.h"
 #include <stdio.h>
 #include <math.h>
+#include <algorithm>
+#include <glm/gtc/matrix_transform.hpp>
 
 using namespace std;
 
 GLfloat defaultLatCol[] = {0.2f, 0.2f, 0.2f, 1.0f};
 GLfloat highlightLatCol[] = {1.0f, 0.176f, 0.176f, 1.0f};
-int maxbezorder = 4;
+const int maxbezorder = 4;
+const int ffdwindow = 4; ///< most control points per dimension that influence a point, for either basis
+const int ffdblock = 256; ///< number of points deformed together, sized so that basis weights stay in cache
 
 void ffd::alloc()
 {
-    // allocate memory for a 3D array of control points and highlighting switches
-    if(dimx > 1 && dimy > 1 && dimz > 1 && dimx <= maxbezorder && dimy <= maxbezorder && dimz <= maxbezorder)
+    // allocate a flat array of control points and highlighting switches
+    dealloc();
+    if(dimx > 1 && dimy > 1 && dimz > 1 && (basis == FFDBasis::BSPLINE || (dimx <= maxbezorder && dimy <= maxbezorder && dimz <= maxbezorder)))
     {
-        cp = new cgp::Point **[dimx];
-        highlight = new bool **[dimx];
-        for (int i = 0; i < dimx; i++)
-        {
-            cp[i] = new cgp::Point *[dimy];
-            highlight[i] = new bool *[dimy];
-
-            for (int j = 0; j < dimy; j++)
-            {
-                cp[i][j] = new cgp::Point[dimz];
-                highlight[i][j] = new bool[dimz];
-            }
-        }
+        cp.resize(dimx * dimy * dimz);
+        highlight.resize(dimx * dimy * dimz);
         deactivateAllCP();
     }
+    else if(basis == FFDBasis::BEZIER)
+        cerr << "Error ffd::alloc: Bezier lattice dimensions must lie between 2 and " << maxbezorder << endl;
+    else
+        cerr << "Error ffd::alloc: B-spline lattice dimensions must be at least 2" << endl;
 }
 
 void ffd::dealloc()
 {
-    // deallocate 3D array of control points and boolean highlighting switches
-    for (int i = 0; i < dimx; i++)
-    {
-        for (int j = 0; j < dimy; j++)
-        {
-            delete [] cp[i][j];
-            delete [] highlight[i][j];
-        }
-
-        delete [] cp[i];
-        delete [] highlight[i];
-    }
-    delete [] cp;
-    delete [] highlight;
-    cp = NULL;
+    cp.clear();
+    highlight.clear();
 }
 
 bool ffd::inCPBounds(int i, int j, int k)
@@ -61,37 +46,30 @@ bool ffd::inCPBounds(int i, int j, int k)
 ffd::ffd()
 {
     dimx = dimy = dimz = 0;
+    basis = FFDBasis::BEZIER;
     setFrame(cgp::Point(0.0f, 0.0f, 0.0f), cgp::Vector(0.0f, 0.0f, 0.0f));
-    cp = NULL;
-    highlight = NULL;
 }
 
-ffd::ffd(int xnum, int ynum, int znum, cgp::Point corner, cgp::Vector diag)
+ffd::ffd(int xnum, int ynum, int znum, cgp::Point corner, cgp::Vector diag, FFDBasis fbasis)
 {
     dimx = xnum;
     dimy = ynum;
     dimz = znum;
-    setFrame(corner, diag);
+    basis = fbasis;
     alloc();
+    setFrame(corner, diag);
 }
 
 void ffd::reset()
 {
-    // calculate the S, T, and U vectors
-    cgp::Vector uniS(diagonal.i, 0.0f, 0.0f);
-    cgp::Vector uniT(0.0f, diagonal.j, 0.0f);
-    cgp::Vector uniU(0.0f, 0.0f, diagonal.k);
+    if(cp.empty())
+        return;
 
-    // position each of the control points in the lattice(relative to origin)
-    float l = dimx-1; float m = dimy-1; float n = dimz-1;
+    // position each of the control points evenly across the lattice
     for(int k = 0; k < dimz; k++)
     for(int j = 0; j < dimy; j++)
-    for(int i = 0; i < dimx; i++){
-        cp[i][j][k] = origin;
-        cp[i][j][k].x += ((i/l) * uniS.i) + ((j/m) * uniT.i) + ((k/n) * uniU.i);
-        cp[i][j][k].y += ((i/l) * uniS.j) + ((j/m) * uniT.j) + ((k/n) * uniU.j);
-        cp[i][j][k].z += ((i/l) * uniS.k) + ((j/m) * uniT.k) + ((k/n) * uniU.k);
-    }
+    for(int i = 0; i < dimx; i++)
+        cp[cpIndex(i, j, k)] = getRestCP(i, j, k);
 }
 
 void ffd::getDim(int &numx, int &numy, int &numz)
@@ -106,6 +84,13 @@ void ffd::setDim(int numx, int numy, int numz)
     reset();
 }
 
+void ffd::setBasis(FFDBasis fbasis)
+{
+    basis = fbasis;
+    alloc();
+    reset();
+}
+
 void ffd::getFrame(cgp::Point &corner, cgp::Vector &diag)
 {
     corner = origin;
@@ -122,21 +107,18 @@ void ffd::setFrame(cgp::Point corner, cgp::Vector diag)
 void ffd::activateCP(int i, int j, int k)
 {
     if(inCPBounds(i,j,k))
-        highlight[i][j][k] = true;
+        highlight[cpIndex(i, j, k)] = true;
 }
 
 void ffd::deactivateCP(int i, int j, int k)
 {
     if(inCPBounds(i,j,k))
-        highlight[i][j][k] = false;
+        highlight[cpIndex(i, j, k)] = false;
 }
 
 void ffd::deactivateAllCP()
 {
-    for(int i = 0; i < dimx; i++)
-        for(int j = 0; j < dimy; j++)
-            for(int k = 0; k < dimz; k++)
-                highlight[i][j][k] = false;
+    std::fill(highlight.begin(), highlight.end(), false);
 }
 
 bool ffd::bindGeometry(View * view, ShapeDrawData &sdd, bool active)
@@ -166,13 +148,13 @@ bool ffd::bindGeometry(View * view, ShapeDrawData &sdd, bool active)
             for(k = 0; k < dimz; k++)
             {
                 if(active) // only draw those control points that match active flag
-                    draw = highlight[i][j][k];
+                    draw = highlight[cpIndex(i, j, k)];
                 else
-                    draw = !highlight[i][j][k];
+                    draw = !highlight[cpIndex(i, j, k)];
 
                 if(draw)
                 {
-                    pnt = cp[i][j][k];
+                    pnt = cp[cpIndex(i, j, k)];
                     trs = glm::vec3(pnt.x, pnt.y, pnt.z);
                     tfm = glm::translate(idt, trs);
                     if(active)
@@ -209,7 +191,7 @@ cgp::Point ffd::getCP(int i, int j, int k)
 {
     if(inCPBounds(i,j,k))
     {
-        return cp[i][j][k];
+        return cp[cpIndex(i, j, k)];
     }
     else
     {
@@ -218,70 +200,589 @@ cgp::Point ffd::getCP(int i, int j, int k)
     }
 }
 
+cgp::Point ffd::getRestCP(int i, int j, int k) const
+{
+    cgp::Point c = origin;
+    float l = dimx-1; float m = dimy-1; float n = dimz-1;
+
+    c.x += (i/l) * diagonal.i;
+    c.y += (j/m) * diagonal.j;
+    c.z += (k/n) * diagonal.k;
+    return c;
+}
+
 void ffd::setCP(int i, int j, int k, cgp::Point pnt)
 {
     if(inCPBounds(i,j,k))
-        cp[i][j][k] = pnt;
+        cp[cpIndex(i, j, k)] = pnt;
 }
 
-int choose(int n, int k){
-    if(k == 0)
-        return 1;
+/**
+ * Evaluate the Bernstein basis of one degree at a block of parameter values with the de Casteljau recurrence
+ * B(d,k) = (1-t) B(d-1,k) + t B(d-1,k-1), which avoids binomial coefficients and powers. Derivatives come from the
+ * basis one degree lower as B'(d,k) = d (B(d-1,k-1) - B(d-1,k))
+ * @param deg       polynomial degree, at most maxbezorder-1
+ * @param t         parameter values
+ * @param n         number of parameter values, at most ffdblock
+ * @param[out] first    index of the first control point influencing each value, always 0 for the global Bezier basis
+ * @param[out] w    w[k][v] is the weight of basis function k at parameter t[v]
+ * @param[out] dw   if not NULL, dw[k][v] is the derivative of basis function k with respect to t at t[v]
+ */
+static void bernsteinBlock(int deg, const float * t, int n, int * first, float w[][ffdblock], float dw[][ffdblock] = NULL)
+{
+#pragma omp simd
+    for(int v = 0; v < n; v++)
+        first[v] = 0;
+#pragma omp simd
+    for(int v = 0; v < n; v++)
+        w[0][v] = 1.0f;
+    if(dw != NULL && deg == 0)
+    {
+#pragma omp simd
+        for(int v = 0; v < n; v++)
+            dw[0][v] = 0.0f;
+    }
+    for(int d = 1; d <= deg; d++)
+    {
+        if(dw != NULL && d == deg)
+        {
+            float fd = (float) deg;
+            for(int k = 0; k <= deg; k++)
+            {
+#pragma omp simd
+                for(int v = 0; v < n; v++)
+                    dw[k][v] = fd * ((k > 0 ? w[k-1][v] : 0.0f) - (k < deg ? w[k][v] : 0.0f));
+            }
+        }
+#pragma omp simd
+        for(int v = 0; v < n; v++)
+            w[d][v] = t[v] * w[d-1][v];
+        for(int k = d-1; k > 0; k--)
+        {
+#pragma omp simd
+            for(int v = 0; v < n; v++)
+                w[k][v] = (1.0f - t[v]) * w[k][v] + t[v] * w[k-1][v];
+        }
+#pragma omp simd
+        for(int v = 0; v < n; v++)
+            w[0][v] *= (1.0f - t[v]);
+    }
+}
 
-    return (n * choose(n - 1, k - 1)) / k;
+/**
+ * Evaluate the Bernstein basis of one degree at a single parameter value, using the same recurrence as bernsteinBlock
+ * @param deg       polynomial degree, at most maxbezorder-1
+ * @param t         parameter value
+ * @param[out] w    w[k] is the weight of basis function k at t
+ */
+static void bernsteinWeights(int deg, float t, float w[ffdwindow])
+{
+    w[0] = 1.0f;
+    for(int d = 1; d <= deg; d++)
+    {
+        w[d] = t * w[d-1];
+        for(int k = d-1; k > 0; k--)
+            w[k] = (1.0f - t) * w[k] + t * w[k-1];
+        w[0] *= (1.0f - t);
+    }
+}
+
+/**
+ * Evaluate the uniform cubic B-spline basis at a single parameter value. The lattice is extended by a phantom
+ * control point at each end, placed by linear extrapolation so that an evenly spaced lattice is still the identity,
+ * and the phantom weights are folded back onto the two control points that define them.
+ * @param dim       number of control points in this dimension, at least 2
+ * @param t         parameter value, with [0,1] spanning the lattice
+ * @param[out] first    index of the first of min(dim,4) consecutive control points influencing t
+ * @param[out] w    w[k] is the weight of control point first+k at t
+ * @param[out] dw   if not NULL, dw[k] is the derivative of that weight with respect to t
+ */
+static void bsplineWeights(int dim, float t, int & first, float w[ffdwindow], float * dw = NULL)
+{
+    int window = std::min(dim, ffdwindow);
+    float x = t * (float) (dim - 1), f, f2, f3, b[4], db[4];
+    int c = (int) floorf(x);
+
+    // segment c lies between control points c and c+1, with points beyond the lattice using the end segments
+    c = std::max(0, std::min(c, dim - 2));
+    f = x - (float) c; f2 = f * f; f3 = f2 * f;
+    b[0] = (1.0f - 3.0f * f + 3.0f * f2 - f3) / 6.0f;
+    b[1] = (4.0f - 6.0f * f2 + 3.0f * f3) / 6.0f;
+    b[2] = (1.0f + 3.0f * f + 3.0f * f2 - 3.0f * f3) / 6.0f;
+    b[3] = f3 / 6.0f;
+
+    // derivatives with respect to t, which is scaled by dim-1 relative to the segment parameter f
+    float sc = (float) (dim - 1);
+    db[0] = -0.5f * (1.0f - f) * (1.0f - f) * sc;
+    db[1] = (1.5f * f2 - 2.0f * f) * sc;
+    db[2] = (0.5f + f - 1.5f * f2) * sc;
+    db[3] = 0.5f * f2 * sc;
+
+    first = std::max(0, std::min(c - 1, dim - window));
+    for(int k = 0; k < ffdwindow; k++)
+        w[k] = 0.0f;
+    if(dw != NULL)
+        for(int k = 0; k < ffdwindow; k++)
+            dw[k] = 0.0f;
+    for(int k = 0; k < 4; k++)
+    {
+        int r = c - 1 + k, a, e = -1;
+        float fa = 1.0f;
+
+        if(r < 0) // phantom before the start, 2 P0 - P1
+        {
+            a = 0; fa = 2.0f; e = 1;
+        }
+        else if(r > dim - 1) // phantom after the end, 2 Pn - Pn-1
+        {
+            a = dim - 1; fa = 2.0f; e = dim - 2;
+        }
+        else
+            a = r;
+        w[a - first] += fa * b[k];
+        if(e >= 0)
+            w[e - first] -= b[k];
+        if(dw != NULL)
+        {
+            dw[a - first] += fa * db[k];
+            if(e >= 0)
+                dw[e - first] -= db[k];
+        }
+    }
+}
+
+/**
+ * Evaluate the uniform cubic B-spline basis at a block of parameter values, as in bsplineWeights
+ * @param dim       number of control points in this dimension, at least 2
+ * @param t         parameter values, with [0,1] spanning the lattice
+ * @param n         number of parameter values, at most ffdblock
+ * @param[out] first    index of the first of min(dim,4) consecutive control points influencing each value
+ * @param[out] w    w[k][v] is the weight of control point first[v]+k at parameter t[v]
+ * @param[out] dw   if not NULL, dw[k][v] is the derivative of that weight with respect to t at t[v]
+ */
+static void bsplineBlock(int dim, const float * t, int n, int * first, float w[][ffdblock], float dw[][ffdblock] = NULL)
+{
+    float wv[ffdwindow], dwv[ffdwindow];
+
+    for(int v = 0; v < n; v++)
+    {
+        bsplineWeights(dim, t[v], first[v], wv, (dw != NULL) ? dwv : NULL);
+        for(int k = 0; k < ffdwindow; k++)
+            w[k][v] = wv[k];
+        if(dw != NULL)
+            for(int k = 0; k < ffdwindow; k++)
+                dw[k][v] = dwv[k];
+    }
 }
 
 void ffd::deform(cgp::Point & pnt)
 {
-    // S, T, and U vectors
-    cgp::Vector uniS(diagonal.i, 0.0f, 0.0f);
-    cgp::Vector uniT(0.0f, diagonal.j, 0.0f);
-    cgp::Vector uniU(0.0f, 0.0f, diagonal.k);
-
-    // calculate the relevant terms needed for the deform equation
-    cgp::Vector XminX0;
-    XminX0.diff(origin, pnt);
-
-    cgp::Vector TcrossU;
-    TcrossU.cross(uniT, uniU);
-    float s = (TcrossU.dot(XminX0)) / (TcrossU.dot(uniS));
-
-    cgp::Vector ScrossU;
-    ScrossU.cross(uniS, uniU);
-    float t = (ScrossU.dot(XminX0)) / (ScrossU.dot(uniT));
-
-    cgp::Vector ScrossT;
-    ScrossT.cross(uniS, uniT);
-    float u = (ScrossT.dot(XminX0)) / (ScrossT.dot(uniU));
-
-    // Evaluate the vector valued trivariate Bernstein polynomial to account for
-    // the influence of each of the control points in the cp lattice
-    cgp::Point xSum(0.0f, 0.0f, 0.0f);
-    for(int x = 0; x < dimx; x++){
-        cgp::Point ySum(0.0f, 0.0f, 0.0f);
-        for(int y = 0; y < dimy; y++){
-            cgp::Point zSum(0.0f, 0.0f, 0.0f);
-            for(int z = 0; z < dimz; z++){
-                float zfact = choose(dimz-1, z) * pow((1 - u), ((dimz-1) - z)) * pow(u, z);
-
-                zSum.x += zfact * cp[x][y][z].x;
-                zSum.y += zfact * cp[x][y][z].y;
-                zSum.z += zfact * cp[x][y][z].z;
+    deform(&pnt, 1);
+}
+
+void ffd::deform(cgp::Point * pnts, size_t n)
+{
+    std::vector<float> x(n), y(n), z(n);
+
+    for(size_t i = 0; i < n; i++)
+    {
+        x[i] = pnts[i].x; y[i] = pnts[i].y; z[i] = pnts[i].z;
+    }
+    deform(x.data(), y.data(), z.data(), x.data(), y.data(), z.data(), n);
+    for(size_t i = 0; i < n; i++)
+        pnts[i] = cgp::Point(x[i], y[i], z[i]);
+}
+
+void ffd::deform(const float * x, const float * y, const float * z, float * dx, float * dy, float * dz, size_t n)
+{
+    deform(x, y, z, dx, dy, dz, NULL, NULL, NULL, NULL, NULL, NULL, n);
+}
+
+void ffd::deform(const float * x, const float * y, const float * z, float * dx, float * dy, float * dz,
+                 const float * nx, const float * ny, const float * nz, float * dnx, float * dny, float * dnz, size_t n)
+{
+    int ncp = (int) cp.size();
+    std::vector<float> cx(ncp), cy(ncp), cz(ncp);
+    bool jacobian = (nx != NULL);
+
+    if(cp.empty())
+    {
+        cerr << "Error ffd::deform: lattice has not been allocated" << endl;
+        std::copy(x, x+n, dx); std::copy(y, y+n, dy); std::copy(z, z+n, dz);
+        if(jacobian)
+        {
+            std::copy(nx, nx+n, dnx); std::copy(ny, ny+n, dny); std::copy(nz, nz+n, dnz);
+        }
+        return;
+    }
+
+    // the lattice axes are aligned with the coordinate axes, so embedding a point in the undeformed lattice
+    // reduces to a shift and a scale by the reciprocal extent
+    float rs = (diagonal.i != 0.0f) ? 1.0f / diagonal.i : 0.0f;
+    float rt = (diagonal.j != 0.0f) ? 1.0f / diagonal.j : 0.0f;
+    float ru = (diagonal.k != 0.0f) ? 1.0f / diagonal.k : 0.0f;
+    float ox = origin.x, oy = origin.y, oz = origin.z;
+    int wx = std::min(dimx, ffdwindow), wy = std::min(dimy, ffdwindow), wz = std::min(dimz, ffdwindow);
+
+    // control points as separate coordinate arrays for the accumulation loops
+    for(int c = 0; c < ncp; c++)
+    {
+        cx[c] = cp[c].x; cy[c] = cp[c].y; cz[c] = cp[c].z;
+    }
+
+#pragma omp parallel for schedule(static)
+    for(size_t start = 0; start < n; start += ffdblock)
+    {
+        float s[ffdblock], t[ffdblock], u[ffdblock];
+        float ws[ffdwindow][ffdblock], wt[ffdwindow][ffdblock], wu[ffdwindow][ffdblock];
+        float dws[ffdwindow][ffdblock], dwt[ffdwindow][ffdblock], dwu[ffdwindow][ffdblock];
+        int fs[ffdblock], ft[ffdblock], fu[ffdblock];
+        float wst[ffdblock], ax[ffdblock], ay[ffdblock], az[ffdblock];
+        // Jacobian columns with respect to s, t and u, and the matching partial products of the weights
+        float gs[ffdblock], gt[ffdblock];
+        float jxs[ffdblock], jys[ffdblock], jzs[ffdblock], jxt[ffdblock], jyt[ffdblock], jzt[ffdblock], jxu[ffdblock], jyu[ffdblock], jzu[ffdblock];
+        int len = (int) std::min((size_t) ffdblock, n - start);
+
+        // local (s,t,u) coordinates of the block within the undeformed lattice
+#pragma omp simd
+        for(int v = 0; v < len; v++)
+        {
+            s[v] = (x[start+v] - ox) * rs;
+            t[v] = (y[start+v] - oy) * rt;
+            u[v] = (z[start+v] - oz) * ru;
+            ax[v] = 0.0f; ay[v] = 0.0f; az[v] = 0.0f;
+            jxs[v] = jys[v] = jzs[v] = jxt[v] = jyt[v] = jzt[v] = jxu[v] = jyu[v] = jzu[v] = 0.0f;
+        }
+        if(basis == FFDBasis::BEZIER)
+        {
+            bernsteinBlock(dimx-1, s, len, fs, ws, jacobian ? dws : NULL);
+            bernsteinBlock(dimy-1, t, len, ft, wt, jacobian ? dwt : NULL);
+            bernsteinBlock(dimz-1, u, len, fu, wu, jacobian ? dwu : NULL);
+        }
+        else
+        {
+            bsplineBlock(dimx, s, len, fs, ws, jacobian ? dws : NULL);
+            bsplineBlock(dimy, t, len, ft, wt, jacobian ? dwt : NULL);
+            bsplineBlock(dimz, u, len, fu, wu, jacobian ? dwu : NULL);
+        }
+
+        // Evaluate the vector valued trivariate polynomial to account for the influence of each of
+        // the control points in the window of the cp lattice around each point
+        for(int i = 0; i < wx; i++)
+            for(int j = 0; j < wy; j++)
+            {
+#pragma omp simd
+                for(int v = 0; v < len; v++)
+                    wst[v] = ws[i][v] * wt[j][v];
+                if(!jacobian)
+                {
+                    for(int k = 0; k < wz; k++)
+                    {
+#pragma omp simd
+                        for(int v = 0; v < len; v++)
+                        {
+                            int c = cpIndex(fs[v] + i, ft[v] + j, fu[v] + k);
+                            float w = wst[v] * wu[k][v];
+                            ax[v] += w * cx[c];
+                            ay[v] += w * cy[c];
+                            az[v] += w * cz[c];
+                        }
+                    }
+                    continue;
+                }
+
+                // the same control point gathers also feed the partial derivatives of the deformation
+#pragma omp simd
+                for(int v = 0; v < len; v++)
+                {
+                    gs[v] = dws[i][v] * wt[j][v];
+                    gt[v] = ws[i][v] * dwt[j][v];
+                }
+                for(int k = 0; k < wz; k++)
+                {
+#pragma omp simd
+                    for(int v = 0; v < len; v++)
+                    {
+                        int c = cpIndex(fs[v] + i, ft[v] + j, fu[v] + k);
+                        float w = wst[v] * wu[k][v], es = gs[v] * wu[k][v], et = gt[v] * wu[k][v], eu = wst[v] * dwu[k][v];
+                        ax[v] += w * cx[c]; ay[v] += w * cy[c]; az[v] += w * cz[c];
+                        jxs[v] += es * cx[c]; jys[v] += es * cy[c]; jzs[v] += es * cz[c];
+                        jxt[v] += et * cx[c]; jyt[v] += et * cy[c]; jzt[v] += et * cz[c];
+                        jxu[v] += eu * cx[c]; jyu[v] += eu * cy[c]; jzu[v] += eu * cz[c];
+                    }
+                }
+            }
+
+#pragma omp simd
+        for(int v = 0; v < len; v++)
+        {
+            dx[start+v] = ax[v]; dy[start+v] = ay[v]; dz[start+v] = az[v];
+        }
+
+        if(jacobian)
+        {
+            // map normals by the cofactor matrix of J = [a b c], whose columns are the derivatives with respect to x, y, z.
+            // cof(J) n = n.x (b x c) + n.y (c x a) + n.z (a x b), which also matches the winding of deformed triangles
+#pragma omp simd
+            for(int v = 0; v < len; v++)
+            {
+                float a0 = jxs[v] * rs, a1 = jys[v] * rs, a2 = jzs[v] * rs;
+                float b0 = jxt[v] * rt, b1 = jyt[v] * rt, b2 = jzt[v] * rt;
+                float c0 = jxu[v] * ru, c1 = jyu[v] * ru, c2 = jzu[v] * ru;
+                float n0 = nx[start+v], n1 = ny[start+v], n2 = nz[start+v];
+                float m0 = n0 * (b1 * c2 - b2 * c1) + n1 * (c1 * a2 - c2 * a1) + n2 * (a1 * b2 - a2 * b1);
+                float m1 = n0 * (b2 * c0 - b0 * c2) + n1 * (c2 * a0 - c0 * a2) + n2 * (a2 * b0 - a0 * b2);
+                float m2 = n0 * (b0 * c1 - b1 * c0) + n1 * (c0 * a1 - c1 * a0) + n2 * (a0 * b1 - a1 * b0);
+                float lensq = m0 * m0 + m1 * m1 + m2 * m2;
+
+                // a degenerate Jacobian, as from a flat lattice, leaves the normal unchanged
+                if(lensq > 0.0f)
+                {
+                    float inv = 1.0f / sqrtf(lensq);
+                    m0 *= inv; m1 *= inv; m2 *= inv;
+                }
+                else
+                {
+                    m0 = n0; m1 = n1; m2 = n2;
+                }
+                dnx[start+v] = m0; dny[start+v] = m1; dnz[start+v] = m2;
+            }
+        }
+    }
+}
+
+void ffd::embed(const cgp::Point & pnt, float & s, float & t, float & u) const
+{
+    // matches the embedding used by the batched deform
+    s = (diagonal.i != 0.0f) ? (pnt.x - origin.x) * (1.0f / diagonal.i) : 0.0f;
+    t = (diagonal.j != 0.0f) ? (pnt.y - origin.y) * (1.0f / diagonal.j) : 0.0f;
+    u = (diagonal.k != 0.0f) ? (pnt.z - origin.z) * (1.0f / diagonal.k) : 0.0f;
+}
+
+void ffd::getWindowSize(int & wx, int & wy, int & wz) const
+{
+    if(basis == FFDBasis::BEZIER)
+    {
+        wx = dimx; wy = dimy; wz = dimz;
+    }
+    else
+    {
+        wx = std::min(dimx, ffdwindow); wy = std::min(dimy, ffdwindow); wz = std::min(dimz, ffdwindow);
+    }
+}
+
+void ffd::getWindow(float s, float t, float u, int & i, int & j, int & k) const
+{
+    float w[ffdwindow];
+
+    if(basis == FFDBasis::BEZIER)
+    {
+        i = j = k = 0;
+    }
+    else
+    {
+        bsplineWeights(dimx, s, i, w);
+        bsplineWeights(dimy, t, j, w);
+        bsplineWeights(dimz, u, k, w);
+    }
+}
+
+float ffd::weight(int i, int j, int k, float s, float t, float u) const
+{
+    float ws[ffdwindow], wt[ffdwindow], wu[ffdwindow];
+    int fs, ft, fu, wx, wy, wz;
+
+    if(i < 0 || j < 0 || k < 0 || i >= dimx || j >= dimy || k >= dimz)
+        return 0.0f;
+    if(basis == FFDBasis::BEZIER)
+    {
+        bernsteinWeights(dimx-1, s, ws);
+        bernsteinWeights(dimy-1, t, wt);
+        bernsteinWeights(dimz-1, u, wu);
+        fs = ft = fu = 0;
+    }
+    else
+    {
+        bsplineWeights(dimx, s, fs, ws);
+        bsplineWeights(dimy, t, ft, wt);
+        bsplineWeights(dimz, u, fu, wu);
+    }
+    getWindowSize(wx, wy, wz);
+    if(i < fs || i >= fs + wx || j < ft || j >= ft + wy || k < fu || k >= fu + wz)
+        return 0.0f;
+    return ws[i-fs] * wt[j-ft] * wu[k-fu];
+}
+
+//
+// FFDBinding
+//
+
+bool FFDBinding::sameLayout(ffd * def)
+{
+    int nx, ny, nz;
+    cgp::Point corner;
+    cgp::Vector diag;
+
+    if(lat == NULL || lat != def)
+        return false;
+    def->getDim(nx, ny, nz);
+    def->getFrame(corner, diag);
+    return nx == dimx && ny == dimy && nz == dimz && def->getBasis() == basis
+        && corner.x == origin.x && corner.y == origin.y && corner.z == origin.z
+        && diag.i == diagonal.i && diag.j == diagonal.j && diag.k == diagonal.k;
+}
+
+bool FFDBinding::bind(ffd * def, float * x, float * y, float * z, int n, std::vector<int> & moved)
+{
+    int wx, wy, wz, ncells;
+    std::vector<int> cell(n);
+    std::vector<cgp::Vector> delta;
+    std::vector<char> shifted(n, 0);
+    bool follows, pending = false;
+
+    moved.clear();
+    unbind();
+    if(!def->allocated())
+    {
+        cerr << "Error FFDBinding::bind: lattice has not been allocated" << endl;
+        return false;
+    }
+
+    // control point moves the points do not yet reflect, measured from the undeformed lattice unless they follow this one
+    follows = sameLayout(def) && !applied.empty();
+    lat = def;
+    def->getDim(dimx, dimy, dimz);
+    basis = def->getBasis();
+    def->getFrame(origin, diagonal);
+    applied.resize(dimx * dimy * dimz);
+    delta.resize(dimx * dimy * dimz);
+    for(int i = 0; i < dimx; i++)
+        for(int j = 0; j < dimy; j++)
+            for(int k = 0; k < dimz; k++)
+            {
+                int c = (i * dimy + j) * dimz + k;
+                cgp::Point pnt = def->getCP(i, j, k);
+                delta[c].diff(follows ? applied[c] : def->getRestCP(i, j, k), pnt);
+                if(delta[c].i != 0.0f || delta[c].j != 0.0f || delta[c].k != 0.0f)
+                    pending = true;
+                applied[c] = pnt;
             }
 
-            float yfact = choose(dimy-1, y) * pow((1 - t), ((dimy-1) - y)) * pow(t, y);
+    def->getWindowSize(wx, wy, wz);
+    cellsx = dimx - wx + 1; cellsy = dimy - wy + 1; cellsz = dimz - wz + 1;
+    ncells = cellsx * cellsy * cellsz;
+
+    ls.resize(n); lt.resize(n); lu.resize(n);
+#pragma omp parallel for
+    for(int p = 0; p < n; p++)
+    {
+        int fi, fj, fk;
+        def->embed(cgp::Point(x[p], y[p], z[p]), ls[p], lt[p], lu[p]);
+        def->getWindow(ls[p], lt[p], lu[p], fi, fj, fk);
+        cell[p] = (fi * cellsy + fj) * cellsz + fk;
 
-            ySum.x += yfact * zSum.x;
-            ySum.y += yfact * zSum.y;
-            ySum.z += yfact * zSum.z;
+        // by linearity in the control points, each outstanding move adds its weight times the move
+        if(pending)
+        {
+            float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+            for(int i = fi; i < fi + wx; i++)
+                for(int j = fj; j < fj + wy; j++)
+                    for(int k = fk; k < fk + wz; k++)
+                    {
+                        const cgp::Vector & d = delta[(i * dimy + j) * dimz + k];
+                        if(d.i == 0.0f && d.j == 0.0f && d.k == 0.0f)
+                            continue;
+                        float w = def->weight(i, j, k, ls[p], lt[p], lu[p]);
+                        sx += w * d.i; sy += w * d.j; sz += w * d.k;
+                    }
+            if(sx != 0.0f || sy != 0.0f || sz != 0.0f)
+            {
+                x[p] += sx; y[p] += sy; z[p] += sz;
+                shifted[p] = 1;
+            }
         }
+    }
+    for(int p = 0; p < n; p++)
+        if(shifted[p])
+            moved.push_back(p);
+
+    // counting sort of points by window position, which keeps each run in increasing point order
+    celloff.assign(ncells + 1, 0);
+    for(int p = 0; p < n; p++)
+        celloff[cell[p] + 1]++;
+    for(int c = 0; c < ncells; c++)
+        celloff[c + 1] += celloff[c];
+    cellpnts.resize(n);
+    std::vector<int> fill(celloff.begin(), celloff.end() - 1);
+    for(int p = 0; p < n; p++)
+        cellpnts[fill[cell[p]]++] = p;
+    bound = true;
+    return true;
+}
 
-        float xfact = choose(dimx-1, x) * pow((1 - s), ((dimx-1) - x)) * pow(s, x);
+void FFDBinding::unbind()
+{
+    bound = false;
+    ls.clear(); lt.clear(); lu.clear();
+    celloff.clear();
+    cellpnts.clear();
+}
+
+void FFDBinding::clear()
+{
+    unbind();
+    lat = NULL;
+    applied.clear();
+}
 
-        xSum.x += xfact * ySum.x;
-        xSum.y += xfact * ySum.y;
-        xSum.z += xfact * ySum.z;
+bool FFDBinding::isBound(ffd * def)
+{
+    return bound && sameLayout(def);
+}
+
+bool FFDBinding::moveCP(int i, int j, int k, cgp::Point pnt, float * x, float * y, float * z, std::vector<int> & moved)
+{
+    cgp::Vector delta;
+    int wx, wy, wz;
+
+    moved.clear();
+    if(!bound)
+    {
+        cerr << "Error FFDBinding::moveCP: no lattice is bound" << endl;
+        return false;
     }
+    if(i < 0 || j < 0 || k < 0 || i >= dimx || j >= dimy || k >= dimz)
+    {
+        cerr << "Error FFDBinding::moveCP: out of bounds access to lattice" << endl;
+        return false;
+    }
+    delta.diff(lat->getCP(i, j, k), pnt);
+    lat->setCP(i, j, k, pnt);
+    applied[(i * dimy + j) * dimz + k] = pnt;
+    if(delta.i == 0.0f && delta.j == 0.0f && delta.k == 0.0f)
+        return true;
+
+    // only windows that start no more than one window width below the control point can contain it
+    lat->getWindowSize(wx, wy, wz);
+    for(int ci = std::max(0, i - wx + 1); ci <= std::min(i, cellsx - 1); ci++)
+        for(int cj = std::max(0, j - wy + 1); cj <= std::min(j, cellsy - 1); cj++)
+            for(int ck = std::max(0, k - wz + 1); ck <= std::min(k, cellsz - 1); ck++)
+            {
+                int c = (ci * cellsy + cj) * cellsz + ck;
+                moved.insert(moved.end(), cellpnts.begin() + celloff[c], cellpnts.begin() + celloff[c+1]);
+            }
+    std::sort(moved.begin(), moved.end());
 
-    pnt = xSum; // set pnt to the computed deformed position
+    // the deformation is linear in the control points, so a move adds the same multiple of delta that the control point contributes
+    int nmoved = (int) moved.size();
+#pragma omp parallel for
+    for(int m = 0; m < nmoved; m++)
+    {
+        int p = moved[m];
+        float w = lat->weight(i, j, k, ls[p], lt[p], lu[p]);
+        x[p] += w * delta.i;
+        y[p] += w * delta.j;
+        z[p] += w * delta.k;
+    }
+    return true;
 }
@@ -3,35 +3,53 @@
 /**
  * @file
  *
- * Free-form Deformation to warp vertices of a mesh. Uses a Bezier basis.
+ * Free-form Deformation to warp vertices of a mesh. Uses a Bezier or uniform cubic B-spline basis.
  */
 
 #include <vector>
 #include <stdio.h>
 #include <iostream>
-#include "renderer.h"
+#include "shape.h"
+
+/**
+ * Polynomial basis used to blend lattice control points
+ */
+enum class FFDBasis
+{
+    BEZIER,     ///< global Bernstein basis, at most 4 control points per dimension
+    BSPLINE,    ///< uniform cubic B-spline basis with local support, any number of control points per dimension
+};
 
 /**
  * Free-Form Deformation of geometric models. Supports Bezier bases with n=1,2,3
- * that can be set seperately for each dimension.
+ * that can be set seperately for each dimension, and uniform cubic B-spline bases of arbitrary resolution
+ * in which each point is influenced only by a 4x4x4 neighbourhood of control points.
  */
 class ffd
 {
 private:
     cgp::Point origin;      ///< bottom left front corner of lattice
     cgp::Vector diagonal;   ///< diagonal extent of lattice
-    cgp::Point *** cp;      ///< dimx * dimy * dimz lattice of control points
-    bool *** highlight;     ///< highlighting of control points to show selection
+    std::vector<cgp::Point> cp;     ///< dimx * dimy * dimz lattice of control points, flattened with z varying fastest
+    std::vector<bool> highlight;    ///< highlighting of control points to show selection, flattened like cp
     int dimx;               ///< number of control points in x dimension
     int dimy;               ///< number of control points in y dimension
     int dimz;               ///< number of control points in z dimension
+    FFDBasis basis;         ///< blending basis
 
-    /// Memory allocation of 3D array
+    /// Memory allocation of the lattice
     void alloc();
 
-    /// Memory deallocation of 3D array
+    /// Memory deallocation of the lattice
     void dealloc();
 
+    /**
+     * Position of a control point in the flattened lattice
+     * @param i, j, k   control point index [0..dimx-1,0..dimy-1,0..dimz-1] in lattice
+     * @returns         index into cp and highlight
+     */
+    inline int cpIndex(int i, int j, int k) const { return (i * dimy + j) * dimz + k; }
+
     /**
      * Check control point access to see if it is out of bounds
      * @param i, j, k   control point index [0..dimx-1,0..dimy-1,0..dimz-1] in lattice
@@ -53,8 +71,9 @@ public:
      * @param xnum, ynum, znum  number of control point in x, y, z dimensions (2-4)
      * @param corner    origin position of the volume
      * @param diag      diagonal extent of the volume
+     * @param fbasis    blending basis, where Bezier lattices are limited to 4 control points per dimension
      */
-    ffd(int xnum, int ynum, int znum, cgp::Point corner, cgp::Vector diag);
+    ffd(int xnum, int ynum, int znum, cgp::Point corner, cgp::Vector diag, FFDBasis fbasis = FFDBasis::BEZIER);
 
     /// Destructor
     ~ffd(){ dealloc(); }
@@ -78,6 +97,18 @@ public:
      */
     void setDim(int numx, int numy, int numz);
 
+    /// Test whether the lattice has been allocated with valid dimensions
+    bool allocated() const { return !cp.empty(); }
+
+    /// Getter for the blending basis
+    FFDBasis getBasis(){ return basis; }
+
+    /**
+     * Set the blending basis, reallocating and resetting the lattice
+     * @param fbasis    blending basis
+     */
+    void setBasis(FFDBasis fbasis);
+
     /**
      * Getter for the placement and dimensions of the lattice in 3d space
      * @param[out] corner    bottom, front, left corner of the lattice
@@ -126,6 +157,13 @@ public:
      */
     cgp::Point getCP(int i, int j, int k);
 
+    /**
+     * Position of a control point in the undeformed lattice, as placed by reset
+     * @param i, j, k   control point index [0..dimx-1,0..dimy-1,0..dimz-1] in lattice
+     * @returns         control point position in 3d space
+     */
+    cgp::Point getRestCP(int i, int j, int k) const;
+
     /**
      * Setter for control point positions
      * @param i, j, k   control point index [0..dimx-1,0..dimy-1,0..dimz-1] in lattice
@@ -136,9 +174,147 @@ public:
     /**
      * Apply free-form deformation to a point by embedding it in an undistorted lattice and then applying the deformation indicated by new control point positions
      * @param[out] pnt  Point undergoing deformation
-     * @todo ffd::deform to be completed for CGP Assignment3
      */
     void deform(cgp::Point & pnt);
+
+    /**
+     * Apply free-form deformation to an array of points
+     * @param[in,out] pnts  points undergoing deformation
+     * @param n             number of points
+     */
+    void deform(cgp::Point * pnts, size_t n);
+
+    /**
+     * Apply free-form deformation to points held as separate coordinate arrays. Points are processed in blocks, with
+     * the basis weights of a block evaluated by recurrence and accumulated over at most 4x4x4 control points in
+     * vectorised loops, and blocks are distributed across threads. Output arrays may be the same as the input arrays
+     * @param x, y, z       coordinates of the points before deformation
+     * @param[out] dx, dy, dz   coordinates of the points after deformation
+     * @param n             number of points
+     */
+    void deform(const float * x, const float * y, const float * z, float * dx, float * dy, float * dz, size_t n);
+
+    /**
+     * Apply free-form deformation to points held as separate coordinate arrays and carry their normals through it.
+     * The Jacobian J of the deformation is accumulated from the basis derivatives in the same pass as the positions,
+     * and each normal is mapped by the cofactor matrix det(J) J^-T, the inverse transpose up to scale, and renormalised.
+     * This matches the normals of deformed triangles, including where the deformation turns the surface inside out.
+     * Output arrays may be the same as the input arrays
+     * @param x, y, z       coordinates of the points before deformation
+     * @param[out] dx, dy, dz   coordinates of the points after deformation
+     * @param nx, ny, nz    unit normals at the points before deformation
+     * @param[out] dnx, dny, dnz    unit normals after deformation
+     * @param n             number of points
+     */
+    void deform(const float * x, const float * y, const float * z, float * dx, float * dy, float * dz,
+                const float * nx, const float * ny, const float * nz, float * dnx, float * dny, float * dnz, size_t n);
+
+    /**
+     * Local coordinates of a point within the undeformed lattice
+     * @param pnt       point in 3d space
+     * @param[out] s, t, u  lattice coordinates, with [0,1] spanning the lattice in each dimension
+     */
+    void embed(const cgp::Point & pnt, float & s, float & t, float & u) const;
+
+    /**
+     * Number of control points in each dimension that influence any one point. This is the whole
+     * lattice for a Bezier basis and at most 4 for a B-spline basis
+     * @param[out] wx, wy, wz   window size in x, y, z dimensions
+     */
+    void getWindowSize(int & wx, int & wy, int & wz) const;
+
+    /**
+     * First control point of the window that influences a point
+     * @param s, t, u       lattice coordinates of the point
+     * @param[out] i, j, k  lowest control point index of the window in each dimension
+     */
+    void getWindow(float s, float t, float u, int & i, int & j, int & k) const;
+
+    /**
+     * Blending weight of one control point at a point, which is the proportion of a move of that
+     * control point passed on to the deformed point
+     * @param i, j, k   control point index [0..dimx-1,0..dimy-1,0..dimz-1] in lattice
+     * @param s, t, u   lattice coordinates of the point
+     * @returns         basis weight, zero if the control point lies outside the window of the point
+     */
+    float weight(int i, int j, int k, float s, float t, float u) const;
+};
+
+/**
+ * Record of where a set of points sits in an undeformed lattice, so that moving a single control point
+ * only revisits the points within its support rather than deforming every point again. Points are grouped
+ * by the first control point of their window, so the points affected by a move are found by visiting at most
+ * 4x4x4 groups. The binding lapses if the points move in any other way or the lattice dimensions, frame or basis
+ * change. Separately, it remembers which control point positions the points already reflect, so that binding again
+ * after the points have been smoothed only applies the moves made since, rather than deforming them a second time.
+ */
+class FFDBinding
+{
+private:
+    ffd * lat;                  ///< lattice the points follow, or NULL if they reflect no deformation
+    bool bound;                 ///< whether the lattice coordinates below match the points
+    int dimx, dimy, dimz;       ///< lattice dimensions at binding
+    FFDBasis basis;             ///< lattice basis at binding
+    cgp::Point origin;          ///< lattice corner at binding
+    cgp::Vector diagonal;       ///< lattice extent at binding
+    std::vector<cgp::Point> applied;    ///< control point positions the points reflect, flattened like the lattice
+    int cellsx, cellsy, cellsz; ///< number of distinct window positions in each dimension
+    std::vector<float> ls, lt, lu;  ///< lattice coordinates of each point
+    std::vector<int> celloff;   ///< start of each window position's run in cellpnts, with a final sentinel
+    std::vector<int> cellpnts;  ///< point indices grouped by window position
+
+    /**
+     * Test whether the lattice has the layout recorded at binding
+     * @param def   lattice to check against
+     * @retval true if def is the recorded lattice with unchanged dimensions, frame and basis,
+     * @retval false otherwise
+     */
+    bool sameLayout(ffd * def);
+
+public:
+
+    /// Default constructor
+    FFDBinding(){ lat = NULL; bound = false; }
+
+    /**
+     * Record the lattice coordinates of a set of points, replacing any existing binding, and shift the points by
+     * every control point move they do not yet reflect. Points that follow no deformation, or an earlier layout
+     * of the lattice, are taken to sit in the undeformed lattice, so they receive its full current deformation.
+     * Points that were moved after following this lattice, for instance by smoothing, only receive the moves made
+     * since, weighted at their current positions
+     * @param def       lattice to bind to, which must be allocated
+     * @param[in,out] x, y, z   coordinates of the points, updated in place
+     * @param n         number of points
+     * @param[out] moved    indices of the points that were shifted, in increasing order
+     * @retval true if binding succeeded,
+     * @retval false if the lattice is not allocated
+     */
+    bool bind(ffd * def, float * x, float * y, float * z, int n, std::vector<int> & moved);
+
+    /// Discard the lattice coordinates after the points move in some other way, remembering the deformation they reflect
+    void unbind();
+
+    /// Discard the binding and the deformation the points reflect, for points that have been replaced
+    void clear();
+
+    /**
+     * Test whether points are bound to a lattice whose layout is unchanged since binding
+     * @param def   lattice to check against
+     * @retval true if the binding is current for def,
+     * @retval false otherwise
+     */
+    bool isBound(ffd * def);
+
+    /**
+     * Move a control point of the bound lattice and shift each point in its support by its basis weight times the move
+     * @param i, j, k   control point index [0..dimx-1,0..dimy-1,0..dimz-1] in lattice
+     * @param pnt       new control point position
+     * @param[in,out] x, y, z   coordinates of the bound points, updated in place
+     * @param[out] moved    indices of points in the support of the control point, in increasing order
+     * @retval true if the move was applied,
+     * @retval false if there is no binding or the control point index is out of bounds
+     */
+    bool moveCP(int i, int j, int k, cgp::Point pnt, float * x, float * y, float * z, std::vector<int> & moved);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,23 @@
+#ifndef GLTYPES_H_
+#define GLTYPES_H_
+/**
+ * @file
+ *
+ * OpenGL scalar types for geometry that is packed for rendering. When TESS_HEADLESS is defined these are plain
+ * typedefs with the sizes fixed by the OpenGL specification, so that the core geometry code builds without OpenGL,
+ * GLEW or Qt. Otherwise the full OpenGL headers are included.
+ */
+
+#ifdef TESS_HEADLESS
+typedef unsigned int GLenum;
+typedef unsigned char GLboolean;
+typedef int GLint;
+typedef int GLsizei;
+typedef unsigned int GLuint;
+typedef float GLfloat;
+typedef double GLdouble;
+#else
+#include "glheaders.h"
+#endif
+
+#endif  // GLTYPES_H_
@@ -39,6 +39,7 @@ GLWidget::GLWidget(const QGLFormat& format, QWidget *parent)
     viewing = false;
     glewSetupDone = false;
     updateGeometry = true;
+    stageResult = false;
     meshVisible = false;
 
     scene.sampleScene();
@@ -48,15 +49,31 @@ GLWidget::GLWidget(const QGLFormat& format, QWidget *parent)
     def.setFrame(cgp::Point(-10.0f, -10.0f, -10.0f), cgp::Vector(20.0f, 20.0f, 20.0f));
     def.activateCP(0,0,0);
 
+    // pipeline stages run on their own thread, so the scene keeps being drawn while they work
+    worker = new PipelineWorker(&scene, &def);
+    worker->moveToThread(&pipelineThread);
+    pipelineThread.start();
+
     setMouseTracking(true);
     setFocusPolicy(Qt::StrongFocus);
 }
 
 GLWidget::~GLWidget()
 {
+    worker->cancel();
+    pipelineThread.quit();
+    pipelineThread.wait();
+    delete worker;
     if (renderer) delete renderer;
 }
 
+void GLWidget::acceptStageResult()
+{
+    worker->acceptResult();
+    stageResult = true;
+    updateGeometry = true;
+}
+
 QSize GLWidget::minimumSizeHint() const
 {
     return QSize(50, 50);
@@ -131,13 +148,26 @@ void GLWidget::paintGL()
 
     if(updateGeometry)
     {
-        drawParams.clear();
-
-        if(meshVisible)
+        if(!meshVisible)
+            sceneParams.clear();
+        else if(stageResult)
         {
-            if(scene.bindGeometry(getView(), sdd))
-                drawParams.push_back(sdd);
+            // geometry was packed by the pipeline thread, so only the upload is left
+            sceneParams.clear();
+            if(worker->frontGeometry()->bindBuffers(getView()))
+                sceneParams.push_back(worker->frontGeometry()->getDrawParameters());
         }
+        else if(!worker->busy()) // otherwise the scene is being changed, so the previous geometry is drawn until it is done
+        {
+            sceneParams.clear();
+            // an unsmoothed isosurface is drawn chunk by chunk, so local edits only upload the chunks they touch
+            if(!scene.bindChunks(getView(), sceneParams))
+                if(scene.bindGeometry(getView(), sdd))
+                    sceneParams.push_back(sdd);
+        }
+        stageResult = false;
+
+        drawParams = sceneParams;
         if(latVisible)
         {
             if(def.bindGeometry(getView(), sdd, true)) // highlighted cp
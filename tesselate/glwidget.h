@@ -11,6 +11,7 @@
 #include <QMouseEvent>
 #include <QKeyEvent>
 #include <QPushButton>
+#include <QThread>
 #include <list>
 #include <common/debug_vector.h>
 #include <common/debug_list.h>
@@ -18,6 +19,7 @@
 #include "view.h"
 #include "csg.h"
 #include "renderer.h"
+#include "pipelineworker.h"
 
 //! [0]
 using namespace std;
@@ -51,6 +53,12 @@ public:
     /// getter for scene
     ffd * getDef(){ return &def; }
 
+    /// getter for the worker that runs pipeline stages in the background
+    PipelineWorker * getWorker(){ return worker; }
+
+    /// take the geometry of a finished pipeline stage, to be bound on the next draw
+    void acceptStageResult();
+
     /// setter for geometry updating
     void setGeometryUpdate(bool update){ updateGeometry = update; }
 
@@ -99,7 +107,11 @@ private:
     ffd def;                            ///< free-form deformation lattice
     View view;                          ///< current viewpoint
     vector<ShapeDrawData> drawParams;   ///< OpenGL drawing parameters
+    vector<ShapeDrawData> sceneParams;  ///< drawing parameters of the scene, kept while a stage changes it
     bool updateGeometry;                ///< recreate render buffers on change
+    bool stageResult;                   ///< bind the geometry packed by the last pipeline stage instead of the scene's own
+    PipelineWorker * worker;            ///< runs pipeline stages on pipelineThread
+    QThread pipelineThread;             ///< thread on which pipeline stages run
     bool meshVisible;                   ///< render csg geometry
     bool latVisible;                    ///< render ffd control points
 
@@ -0,0 +1,320 @@
+//
+// IsoChunks
+//
+
+#include "isochunks.h"
+#include "vcache.h"
+#include <unordered_map>
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+static GLfloat chunkCol[] = {0.243f, 0.176f, 0.75f, 1.0f};
+
+IsoChunks::IsoChunks(int bricksize)
+{
+    brick = std::max(1, bricksize);
+    nx = ny = nz = 0;
+    cx = cy = cz = 0;
+    col = chunkCol;
+}
+
+IsoChunks::~IsoChunks()
+{
+    clear();
+    for(IsoChunk * chunk: spare)
+        delete chunk;
+}
+
+void IsoChunks::clear()
+{
+    spare.insert(spare.end(), chunks.begin(), chunks.end());
+    chunks.clear();
+    nx = ny = nz = 0;
+    cx = cy = cz = 0;
+}
+
+void IsoChunks::extractChunk(VoxelVolume & vox, IsoChunk * chunk, double & before, double & after)
+{
+    std::unordered_map<long, int> welded;
+    std::vector<int> remap;
+    PointArray pnts;
+    std::vector<Triangle> faces;
+    std::vector<long> keys;
+    std::vector<cgp::Vector> sums;
+    std::vector<int> counts;
+    int ncore, xdim, ydim, zdim;
+
+    // triangles of the chunk itself come first, followed by those of the surrounding cells
+    vox.getDim(xdim, ydim, zdim);
+    const VoxelRange & core = chunk->cells;
+    VoxelRange apron = {std::max(0, core.x0-1), std::max(0, core.y0-1), std::max(0, core.z0-1),
+                        std::min(xdim-2, core.x1+1), std::min(ydim-2, core.y1+1), std::min(zdim-2, core.z1+1)};
+    Mesh::marchCells(vox, core, NULL, pnts, faces, keys, welded);
+    ncore = (int) faces.size();
+    Mesh::marchCells(vox, apron, &core, pnts, faces, keys, welded);
+
+    // average the face normals around each vertex in the same way as Mesh::deriveVertNorms, including apron faces so
+    // that vertices on the chunk boundary get the same normal as in the neighbouring chunk
+    sums.assign(pnts.size(), cgp::Vector(0.0f, 0.0f, 0.0f));
+    counts.assign(pnts.size(), 0);
+    for(Triangle & t: faces)
+    {
+        cgp::Vector evec[2];
+        evec[0].diff(pnts[t.v[0]], pnts[t.v[1]]);
+        evec[1].diff(pnts[t.v[0]], pnts[t.v[2]]);
+        evec[0].normalize();
+        evec[1].normalize();
+        t.n.cross(evec[0], evec[1]);
+        t.n.normalize();
+        for(int p = 0; p < 3; p++)
+        {
+            sums[t.v[p]].add(t.n);
+            counts[t.v[p]]++;
+        }
+    }
+
+    // keep the chunk's own triangles and the vertices they use
+    remap.assign(pnts.size(), -1);
+    chunk->verts.clear();
+    chunk->norms.clear();
+    chunk->keys.clear();
+    chunk->tris.assign(faces.begin(), faces.begin() + ncore);
+    for(Triangle & t: chunk->tris)
+        for(int p = 0; p < 3; p++)
+        {
+            int v = t.v[p];
+            if(remap[v] < 0)
+            {
+                cgp::Vector n = sums[v];
+                n.mult(1.0f / (float) counts[v]);
+                n.normalize();
+                remap[v] = (int) chunk->verts.size();
+                chunk->verts.push_back(pnts[v]);
+                chunk->norms.push_back(n);
+                chunk->keys.push_back(keys[v]);
+            }
+            t.v[p] = remap[v];
+        }
+
+    // order for the vertex cache once per extraction, since the chunk is packed for drawing as it stands
+    std::vector<int> flat, order, fetch;
+    for(const Triangle & t: chunk->tris)
+        for(int p = 0; p < 3; p++)
+            flat.push_back(t.v[p]);
+    before = computeACMR(flat, (int) chunk->verts.size()) * chunk->tris.size();
+    optimizeVertexCache(flat, (int) chunk->verts.size(), 32, &order);
+    after = computeACMR(flat, (int) chunk->verts.size()) * chunk->tris.size();
+    if(order.size() == chunk->tris.size())
+    {
+        std::vector<Triangle> tris(chunk->tris.size());
+        PointArray verts;
+        VectorArray norms;
+        std::vector<long> vkeys(chunk->keys.size());
+
+        optimizeVertexFetch(flat, (int) chunk->verts.size(), fetch);
+        for(int t = 0; t < (int) tris.size(); t++)
+        {
+            tris[t] = chunk->tris[order[t]];
+            for(int p = 0; p < 3; p++)
+                tris[t].v[p] = flat[3*t+p];
+        }
+        verts.resize(chunk->verts.size());
+        norms.resize(chunk->norms.size());
+        for(int v = 0; v < (int) fetch.size(); v++)
+        {
+            verts[fetch[v]] = chunk->verts[v];
+            norms[fetch[v]] = chunk->norms[v];
+            vkeys[fetch[v]] = chunk->keys[v];
+        }
+        chunk->tris.swap(tris);
+        chunk->verts.swap(verts);
+        chunk->norms.swap(norms);
+        chunk->keys.swap(vkeys);
+    }
+    chunk->bound = false;
+}
+
+bool IsoChunks::extract(VoxelVolume & vox, StageProgress * progress)
+{
+    int xdim, ydim, zdim, fx, fy, fz, gx, gy, gz; // cells and chunks along each axis of the new surface
+    std::vector<IsoChunk *> fresh;
+    double before = 0.0, after = 0.0;
+    long numtris = 0;
+
+    vox.getDim(xdim, ydim, zdim);
+    fx = xdim-1; fy = ydim-1; fz = zdim-1;
+    if(fx < 1 || fy < 1 || fz < 1)
+    {
+        clear();
+        cx = fx; cy = fy; cz = fz;
+        return true;
+    }
+    gx = (fx + brick - 1) / brick;
+    gy = (fy + brick - 1) / brick;
+    gz = (fz + brick - 1) / brick;
+
+    // the new chunks are built alongside the current ones, which stay in place if the extraction is cancelled
+    for(int z = 0; z < gz; z++)
+        for(int y = 0; y < gy; y++)
+            for(int x = 0; x < gx; x++)
+            {
+                IsoChunk * chunk;
+                if(spare.empty())
+                    chunk = new IsoChunk();
+                else
+                {
+                    chunk = spare.back();
+                    spare.pop_back();
+                    chunk->verts.clear();
+                    chunk->norms.clear();
+                    chunk->tris.clear();
+                    chunk->keys.clear();
+                }
+                chunk->cells = {x * brick, y * brick, z * brick,
+                                std::min(fx, (x+1) * brick) - 1, std::min(fy, (y+1) * brick) - 1, std::min(fz, (z+1) * brick) - 1};
+                chunk->bound = false;
+                fresh.push_back(chunk);
+            }
+
+    if(progress != NULL)
+        progress->start((long) fresh.size());
+#pragma omp parallel for schedule(dynamic) reduction(+:before, after, numtris)
+    for(int c = 0; c < (int) fresh.size(); c++)
+    {
+        double chunkbefore, chunkafter;
+        if(progress != NULL && progress->cancelled())
+            continue;
+        extractChunk(vox, fresh[c], chunkbefore, chunkafter);
+        before += chunkbefore; after += chunkafter;
+        numtris += (long) fresh[c]->tris.size();
+        if(progress != NULL)
+            progress->step();
+    }
+
+    if(progress != NULL && progress->cancelled())
+    {
+        spare.insert(spare.end(), fresh.begin(), fresh.end());
+        return false;
+    }
+    reportACMR(before, after, numtris);
+    spare.insert(spare.end(), chunks.begin(), chunks.end());
+    chunks.swap(fresh);
+    nx = gx; ny = gy; nz = gz;
+    cx = fx; cy = fy; cz = fz;
+    return true;
+}
+
+int IsoChunks::update(VoxelVolume & vox, const VoxelRange & changed)
+{
+    int xdim, ydim, zdim;
+    std::vector<IsoChunk *> stale;
+    double before = 0.0, after = 0.0;
+    long numtris = 0;
+
+    vox.getDim(xdim, ydim, zdim);
+    if(xdim-1 != cx || ydim-1 != cy || zdim-1 != cz)
+    {
+        cerr << "Error IsoChunks::update: voxel volume dimensions have changed since extraction" << endl;
+        return 0;
+    }
+    if(changed.empty() || chunks.empty())
+        return 0;
+
+    // a voxel is read by the cells on either side of it, and their triangles contribute to normals one cell further out
+    VoxelRange cells = {changed.x0-2, changed.y0-2, changed.z0-2, changed.x1+1, changed.y1+1, changed.z1+1};
+    cells = cells.intersect({0, 0, 0, cx-1, cy-1, cz-1});
+    if(cells.empty())
+        return 0;
+    for(int z = cells.z0 / brick; z <= cells.z1 / brick; z++)
+        for(int y = cells.y0 / brick; y <= cells.y1 / brick; y++)
+            for(int x = cells.x0 / brick; x <= cells.x1 / brick; x++)
+                stale.push_back(chunks[(z * ny + y) * nx + x]);
+
+#pragma omp parallel for schedule(dynamic) reduction(+:before, after, numtris)
+    for(int c = 0; c < (int) stale.size(); c++)
+    {
+        double chunkbefore, chunkafter;
+        extractChunk(vox, stale[c], chunkbefore, chunkafter);
+        before += chunkbefore; after += chunkafter;
+        numtris += (long) stale[c]->tris.size();
+    }
+    reportACMR(before, after, numtris);
+    return (int) stale.size();
+}
+
+void IsoChunks::reportACMR(double before, double after, long numtris)
+{
+    if(numtris > 0)
+        cerr << "Vertex cache ACMR " << before / numtris << " before and " << after / numtris << " after optimisation" << endl;
+}
+
+void IsoChunks::assemble(Mesh & mesh)
+{
+    std::unordered_map<long, int> welded;
+    std::vector<int> remap;
+    PointArray pnts;
+    std::vector<Triangle> faces;
+
+    for(IsoChunk * chunk: chunks)
+    {
+        // copies of a boundary vertex in neighbouring chunks share a key and become one vertex
+        remap.resize(chunk->verts.size());
+        for(int v = 0; v < (int) chunk->verts.size(); v++)
+        {
+            auto found = welded.find(chunk->keys[v]);
+            if(found == welded.end())
+            {
+                found = welded.insert(std::make_pair(chunk->keys[v], (int) pnts.size())).first;
+                pnts.push_back(chunk->verts[v]);
+            }
+            remap[v] = found->second;
+        }
+        for(Triangle t: chunk->tris)
+        {
+            for(int p = 0; p < 3; p++)
+                t.v[p] = remap[t.v[p]];
+            faces.push_back(t);
+        }
+    }
+    mesh.setGeometry(pnts, faces);
+}
+
+int IsoChunks::bindGeometry(View * view, std::vector<ShapeDrawData> & sdd)
+{
+    int uploaded = 0;
+
+    for(IsoChunk * chunk: chunks)
+    {
+        if(chunk->tris.empty())
+            continue;
+        if(!chunk->bound)
+        {
+            std::vector<int> faces;
+
+            for(const Triangle & t: chunk->tris)
+                for(int p = 0; p < 3; p++)
+                    faces.push_back(t.v[p]);
+            chunk->geometry.clear();
+            chunk->geometry.setColour(col);
+            chunk->geometry.genMesh(&chunk->verts, &chunk->norms, &faces, glm::mat4(1.0f));
+            if(!chunk->geometry.bindBuffers(view))
+                continue;
+            chunk->sdd = chunk->geometry.getDrawParameters();
+            chunk->bound = true;
+            uploaded++;
+        }
+        sdd.push_back(chunk->sdd);
+    }
+    return uploaded;
+}
+
+int IsoChunks::numTris() const
+{
+    int total = 0;
+
+    for(IsoChunk * chunk: chunks)
+        total += (int) chunk->tris.size();
+    return total;
+}
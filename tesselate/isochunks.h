@@ -0,0 +1,118 @@
+#ifndef _ISOCHUNKS
+#define _ISOCHUNKS
+/**
+ * @file
+ *
+ * Isosurface of a voxel volume stored as independently updatable chunks.
+ */
+
+#include <vector>
+#include "mesh.h"
+#include "progress.h"
+
+/// Part of the isosurface extracted from one brick of cells
+struct IsoChunk
+{
+    VoxelRange cells;           ///< cells covered by the chunk
+    PointArray verts;           ///< vertex positions
+    VectorArray norms;          ///< vertex normals, matching those of the whole surface
+    std::vector<Triangle> tris; ///< triangles indexing into verts
+    std::vector<long> keys;     ///< global key of each vertex, shared by copies of a vertex in neighbouring chunks
+    ShapeGeometry geometry;     ///< OpenGL buffers for the chunk
+    ShapeDrawData sdd;          ///< drawing parameters of the bound buffers
+    bool bound;                 ///< whether sdd matches the current triangles
+};
+
+/**
+ * Marching cubes isosurface split into chunks, one per brick of cells, so that after a local change to the voxels only
+ * the chunks whose cells read changed voxels are extracted and uploaded again. Each chunk derives its vertex normals with
+ * a one cell apron of neighbouring triangles, so shading is continuous across chunk boundaries, and vertices on chunk
+ * boundaries carry the same key in every chunk that holds them, so the chunks stitch into a single closed mesh.
+ */
+class IsoChunks
+{
+private:
+    int brick;                      ///< cells along each side of a chunk
+    int nx, ny, nz;                 ///< chunks along each axis
+    int cx, cy, cz;                 ///< cells along each axis
+    std::vector<IsoChunk *> chunks; ///< chunks indexed by (z * ny + y) * nx + x
+    std::vector<IsoChunk *> spare;  ///< discarded chunks, kept so that their OpenGL buffers are reused when they are bound again
+    GLfloat * col;                  ///< (r,g,b,a) colour of every chunk
+
+    /**
+     * Extract the isosurface within one chunk
+     * @param vox   voxel volume
+     * @param chunk chunk to fill, with its cells already set
+     * @param[out] before, after    simulated vertex cache misses of the chunk's triangles before and after ordering them
+     */
+    void extractChunk(VoxelVolume & vox, IsoChunk * chunk, double & before, double & after);
+
+    /**
+     * Report the vertex cache miss ratio of newly extracted chunks
+     * @param before, after total simulated cache misses before and after ordering
+     * @param numtris       total number of triangles in the chunks
+     */
+    void reportACMR(double before, double after, long numtris);
+
+public:
+
+    /**
+     * Constructor
+     * @param bricksize cells along each side of a chunk
+     */
+    IsoChunks(int bricksize = 32);
+
+    /// Destructor
+    ~IsoChunks();
+
+    /**
+     * Discard all chunks. Their OpenGL buffers can only be released on the thread that draws, so the chunks are kept
+     * aside and reused by later extractions, whose first bind replaces the old buffers
+     */
+    void clear();
+
+    /**
+     * Setter for the colour of the surface
+     * @param colour    (r,g,b,a) colour, which must outlive this object
+     */
+    void setColour(GLfloat * colour){ col = colour; }
+
+    /**
+     * Extract the whole isosurface, replacing any earlier chunks once it is complete
+     * @param vox       voxel volume
+     * @param progress  where to count extracted chunks and look for cancellation, or NULL
+     * @retval @c true  if the surface was extracted,
+     * @retval @c false if cancelled, in which case the earlier chunks are kept
+     */
+    bool extract(VoxelVolume & vox, StageProgress * progress = NULL);
+
+    /**
+     * Re-extract the chunks affected by a change to a block of voxels
+     * @param vox       voxel volume, with the same dimensions as when last extracted
+     * @param changed   block of voxels that may have changed
+     * @returns         number of chunks extracted again
+     */
+    int update(VoxelVolume & vox, const VoxelRange & changed);
+
+    /**
+     * Stitch the chunks into a single mesh, welding the copies of vertices on chunk boundaries
+     * @param[out] mesh mesh to replace with the surface
+     */
+    void assemble(Mesh & mesh);
+
+    /**
+     * Bind the chunks to OpenGL buffers, uploading only those extracted since they were last bound
+     * @param view      current view parameters
+     * @param[out] sdd  drawing parameters of every non-empty chunk, appended to the list
+     * @returns         number of chunks uploaded
+     */
+    int bindGeometry(View * view, std::vector<ShapeDrawData> & sdd);
+
+    /// Number of chunks
+    int numChunks() const { return (int) chunks.size(); }
+
+    /// Total number of triangles across all chunks
+    int numTris() const;
+};
+
+#endif
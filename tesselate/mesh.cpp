@@ -3,6 +3,10 @@
 //
 
 #include "mesh.h"
+#include "sparse.h"
+#include "bvh.h"
+#include "compactmesh.h"
+#include "vcache.h"
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
@@ -10,6 +14,7 @@
 #include <fstream>
 #include <math.h>
 #include <list>
+#include <algorithm>
 #include <sys/stat.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -17,7 +22,7 @@
 #include <glm/gtx/rotate_vector.hpp>
 #include <glm/gtx/intersect.hpp>
 #include <unordered_map>
-#include <set>
+#include <cstdint>
 
 using namespace std;
 using namespace cgp;
@@ -322,6 +327,15 @@ bool Sphere::pointContainment(cgp::Point pnt)
         return false;
 }
 
+cgp::BoundBox Sphere::bounds()
+{
+    cgp::BoundBox box;
+
+    box.includePnt(cgp::Point(c.x - r, c.y - r, c.z - r));
+    box.includePnt(cgp::Point(c.x + r, c.y + r, c.z + r));
+    return box;
+}
+
 void Cylinder::genGeometry(ShapeGeometry * geom, View * view)
 {
     glm::mat4 tfm, idt;
@@ -380,6 +394,25 @@ bool Cylinder::pointContainment(cgp::Point pnt)
         return false;
 }
 
+cgp::BoundBox Cylinder::bounds()
+{
+    cgp::BoundBox box;
+    cgp::Vector axis;
+    float ex, ey, ez;
+
+    // each end cap is a disc, whose extent along a coordinate axis shrinks as the cylinder axis turns towards it
+    axis.diff(s, e);
+    axis.normalize();
+    ex = r * sqrtf(std::max(0.0f, 1.0f - axis.i * axis.i));
+    ey = r * sqrtf(std::max(0.0f, 1.0f - axis.j * axis.j));
+    ez = r * sqrtf(std::max(0.0f, 1.0f - axis.k * axis.k));
+    box.includePnt(cgp::Point(s.x - ex, s.y - ey, s.z - ez));
+    box.includePnt(cgp::Point(s.x + ex, s.y + ey, s.z + ez));
+    box.includePnt(cgp::Point(e.x - ex, e.y - ey, e.z - ez));
+    box.includePnt(cgp::Point(e.x + ex, e.y + ey, e.z + ez));
+    return box;
+}
+
 bool Mesh::findVert(cgp::Point pnt, int &idx)
 {
     bool found = false;
@@ -389,7 +422,7 @@ bool Mesh::findVert(cgp::Point pnt, int &idx)
     // linear search of vertex list
     while(!found && i < (int) verts.size())
     {
-        if(verts[i] == pnt)
+        if(cgp::Point(verts[i]) == pnt)
         {
             found = true;
             idx = i;
@@ -473,56 +506,79 @@ void Mesh::mergeVerts()
 
     verts.clear();
     verts = cleanverts;
+    topologyChanged();
 }
 
-void Mesh::deriveVertNorms()
+cgp::Vector Mesh::vertNormal(const MeshAdjacency & adj, int v)
 {
-    vector<int> vinc; // number of faces incident on vertex
-    int p, t;
-    cgp::Vector n;
+    cgp::Vector sum(0.0f, 0.0f, 0.0f), n;
+    const int * inc = adj.incident(v);
+    int ninc = adj.numIncident(v);
 
-    // init structures
-    for(p = 0; p < (int) verts.size(); p++)
+    for(int f = 0; f < ninc; f++)
     {
-        vinc.push_back(0);
-        norms.push_back(cgp::Vector(0.0f, 0.0f, 0.0f));
+        n = tris[inc[f]].n; n.normalize();
+        sum.add(n);
     }
+    if(ninc > 0)
+        sum.mult(1.0f/((float) ninc));
+    sum.normalize();
+    return sum;
+}
 
-    // accumulate face normals into vertex normals
-    for(t = 0; t < (int) tris.size(); t++)
-    {
-        n = tris[t].n; n.normalize();
-        for(p = 0; p < 3; p++)
-        {
-            norms[tris[t].v[p]].add(n);
-            vinc[tris[t].v[p]]++;
-        }
-    }
+void Mesh::deriveVertNorms()
+{
+    const MeshAdjacency & adj = getAdjacency();
 
-    // complete average
-    for(p = 0; p < (int) verts.size(); p++)
-    {
-        norms[p].mult(1.0f/((float) vinc[p]));
-        norms[p].normalize();
-    }
+    norms.resize(verts.size());
+
+    // average normals of the faces incident on each vertex
+#pragma omp parallel for
+    for(int p = 0; p < (int) verts.size(); p++)
+        norms[p] = vertNormal(adj, p);
 }
 
-void Mesh::deriveFaceNorms()
+cgp::Vector Mesh::faceNormal(int t)
 {
-    int t;
-    cgp::Vector evec[2];
+    cgp::Vector evec[2], n;
+
+    // right-hand rule for calculating normals, i.e. counter-clockwise winding from front on vertices
+    evec[0].diff(verts[tris[t].v[0]], verts[tris[t].v[1]]);
+    evec[1].diff(verts[tris[t].v[0]], verts[tris[t].v[2]]);
+    evec[0].normalize();
+    evec[1].normalize();
+    n.cross(evec[0], evec[1]);
+    n.normalize();
+    return n;
+}
 
-    for(t = 0; t < (int) tris.size(); t++)
+void Mesh::deriveFaceNorms()
+{
+    int numtris = (int) tris.size();
+    VectorArray evec[2];
+
+    // gather edge vectors so that the cross products and normalisation run as straight-line kernels
+    evec[0].resize(numtris); evec[1].resize(numtris);
+    const float * px = verts.xs(), * py = verts.ys(), * pz = verts.zs();
+    float * e0x = evec[0].xs(), * e0y = evec[0].ys(), * e0z = evec[0].zs();
+    float * e1x = evec[1].xs(), * e1y = evec[1].ys(), * e1z = evec[1].zs();
+#pragma omp parallel for schedule(static)
+    for(int t = 0; t < numtris; t++)
     {
-        // right-hand rule for calculating normals, i.e. counter-clockwise winding from front on vertices
-        evec[0].diff(verts[tris[t].v[0]], verts[tris[t].v[1]]);
-        evec[1].diff(verts[tris[t].v[0]], verts[tris[t].v[2]]);
-        evec[0].normalize();
-        evec[1].normalize();
-        tris[t].n.cross(evec[0], evec[1]);
-        tris[t].n.normalize();
+        int v0 = tris[t].v[0], v1 = tris[t].v[1], v2 = tris[t].v[2];
+        e0x[t] = px[v1] - px[v0]; e0y[t] = py[v1] - py[v0]; e0z[t] = pz[v1] - pz[v0];
+        e1x[t] = px[v2] - px[v0]; e1y[t] = py[v2] - py[v0]; e1z[t] = pz[v2] - pz[v0];
     }
 
+    // right-hand rule for calculating normals, i.e. counter-clockwise winding from front on vertices
+    evec[0].normalize();
+    evec[1].normalize();
+    VectorArray::cross(evec[0], evec[1], evec[0]);
+    evec[0].normalize();
+
+#pragma omp parallel for schedule(static)
+    for(int t = 0; t < numtris; t++)
+        tris[t].n = cgp::Vector(e0x[t], e0y[t], e0z[t]);
 }
 
 void Mesh::buildTransform(glm::mat4x4 &tfm)
@@ -724,6 +780,7 @@ void Mesh::buildSphereAccel(int maxspheres)
 
 Mesh::Mesh()
 {
+    adjvalid = false;
     col = stdCol;
     scale = 1.0f;
     xrot = yrot = zrot = 0.0f;
@@ -738,7 +795,11 @@ Mesh::~Mesh()
 void Mesh::clear()
 {
     verts.clear();
+    norms.clear();
     tris.clear();
+    boundspheres.clear();
+    adjacency.clear();
+    topologyChanged();
     geometry.clear();
     col = stdCol;
     scale = 1.0f;
@@ -746,6 +807,17 @@ void Mesh::clear()
     trx = cgp::Vector(0.0f, 0.0f, 0.0f);
 }
 
+const MeshAdjacency & Mesh::getAdjacency()
+{
+    // also catch direct edits to the vertex or triangle lists that bypassed topologyChanged
+    if(!adjvalid || adjacency.numVerts() != (int) verts.size() || adjacency.numTris() != (int) tris.size())
+    {
+        adjacency.build((int) verts.size(), tris);
+        adjvalid = true;
+    }
+    return adjacency;
+}
+
 void Mesh::genGeometry(ShapeGeometry * geom, View * view)
 {
     vector<int> faces;
@@ -854,15 +926,12 @@ bool Mesh::pointContainment(cgp::Point pnt)
 
 void Mesh::boxFit(float sidelen)
 {
-    cgp::Point pnt;
     cgp::Vector shift, diag, halfdiag;
     float scale;
-    int v;
     cgp::BoundBox bbox;
 
     // calculate current bounding box
-    for(v = 0; v < (int) verts.size(); v++)
-        bbox.includePnt(verts[v]);
+    bbox = verts.bounds();
 
     if((int) verts.size() > 0)
     {
@@ -880,34 +949,50 @@ void Mesh::boxFit(float sidelen)
             scale = sidelen / scale;
 
             // shift center to origin and scale uniformly
-            for(v = 0; v < (int) verts.size(); v++)
-            {
-                pnt = verts[v];
-                shift.pntplusvec(pnt, &pnt);
-                pnt.x *= scale; pnt.y *= scale; pnt.z *= scale;
-                verts[v] = pnt;
-            }
+            glm::mat4x4 tfm = glm::scale(glm::mat4(1.0f), glm::vec3(scale, scale, scale));
+            tfm = glm::translate(tfm, glm::vec3(shift.i, shift.j, shift.k));
+            verts.transform(tfm, verts);
+            positionsChanged();
         }
         buildSphereAccel((int) sphperdim);
     }
 }
 
-void Mesh::marchingCubes(VoxelVolume vox)
+void Mesh::marchingCubes(VoxelVolume & vox)
 {
+    std::vector<long> keys;
+    std::unordered_map<long, int> welded;
+    int xlim, ylim, zlim;
+
     cerr << "Marching" << endl;
 
-    // get the dimensions of the voxelvolume
-    int xlim, ylim, zlim;
+    // loop through the entire voxelvolume
     vox.getDim(xlim, ylim, zlim);
+    VoxelRange cells = {0, 0, 0, xlim-2, ylim-2, zlim-2};
+    verts.clear();
+    tris.clear();
+    marchCells(vox, cells, NULL, verts, tris, keys, welded);
+    topologyChanged();
+
+    // lay the mesh out for locality and calculate the normals
+    reorder();
+    deriveFaceNorms();
+    deriveVertNorms();
+    cerr << "Done marching!" << endl;
+}
 
-    cgp::Point corner;
-    cgp::Vector diagonal;
-    vox.getFrame(corner, diagonal);
+void Mesh::marchCells(VoxelVolume & vox, const VoxelRange & cells, const VoxelRange * skip, PointArray & points,
+                      std::vector<Triangle> & faces, std::vector<long> & keys, std::unordered_map<long, int> & welded)
+{
+    int xlim, ylim, zlim;
 
-    // loop through the entire voxelvolume
-    for(int x = 0; x < xlim-1; x++)
-    for(int y = 0; y < ylim-1; y++)
-    for(int z = 0; z < zlim-1; z++){
+    vox.getDim(xlim, ylim, zlim);
+    for(int x = cells.x0; x <= cells.x1; x++)
+    for(int y = cells.y0; y <= cells.y1; y++)
+    for(int z = cells.z0; z <= cells.z1; z++){
+
+        if(skip != NULL && x >= skip->x0 && x <= skip->x1 && y >= skip->y0 && y <= skip->y1 && z >= skip->z0 && z <= skip->z1)
+            continue;
 
         // Find which of the 8 corners are inside/outside this cell and save this in flagIndex
         int flagIndex = vox.getMCVertIdx(x, y, z);
@@ -920,94 +1005,415 @@ void Mesh::marchingCubes(VoxelVolume vox)
             continue;
         }
 
-        cgp::Point asEdgeVertex[12];
+        int asEdgeVertex[12];
         // Find the intersection of the isosurface with each edge of the cube
         for(int edge = 0; edge < 12; edge++)
         {
             cgp::Point off = vox.getMCEdgeXsect(edge);
-            // if there is an intersection on this edge, add it to the asEdgeVertex array
+            // if there is an intersection on this edge, find or add its vertex
             if(edgeFlags & (1<<edge)){
-                cgp::Point worldPos = vox.getVoxelPos(x + off.x, y + off.y, z + off.z);
-                asEdgeVertex[edge].x = worldPos.x;
-                asEdgeVertex[edge].y = worldPos.y;
-                asEdgeVertex[edge].z = worldPos.z;
+                int vx = x + off.x, vy = y + off.y, vz = z + off.z;
+                long key = ((long) vx * (long) ylim + (long) vy) * (long) zlim + (long) vz;
+                auto found = welded.find(key);
+                if(found == welded.end())
+                {
+                    found = welded.insert(std::make_pair(key, (int) points.size())).first;
+                    points.push_back(vox.getVoxelPos(vx, vy, vz));
+                    keys.push_back(key);
+                }
+                asEdgeVertex[edge] = found->second;
             }
         }
 
-        // draw the triangles that were found by pushing them into verts and tris
+        // record the triangles that were found
         for(int triangle = 0; triangle < 5; triangle++){
             if(triangleTable[flagIndex][3*triangle] < 0)
                 break;
 
-            for(int corner = 0; corner < 3; corner++){
-                int vert = triangleTable[flagIndex][3*triangle+corner];
-                verts.push_back(asEdgeVertex[vert]);
+            Triangle t;
+            for(int corner = 0; corner < 3; corner++)
+                t.v[2-corner] = asEdgeVertex[triangleTable[flagIndex][3*triangle+corner]];
+            t.n = cgp::Vector(0.0f, 0.0f, 0.0f);
+            faces.push_back(t);
+        }
+    }
+}
+
+/// Spread the low 21 bits of v so that two zero bits separate each, ready for interleaving
+static inline uint64_t spreadBits(uint64_t v)
+{
+    v &= 0x1fffff;
+    v = (v | (v << 32)) & 0x1f00000000ffffULL;
+    v = (v | (v << 16)) & 0x1f0000ff0000ffULL;
+    v = (v | (v << 8)) & 0x100f00f00f00f00fULL;
+    v = (v | (v << 4)) & 0x10c30c30c30c30c3ULL;
+    v = (v | (v << 2)) & 0x1249249249249249ULL;
+    return v;
+}
+
+/**
+ * Position of a point along a Morton curve through a bounding box
+ * @param pnt   point inside the box
+ * @param bbox  bounding box
+ * @param scale quantisation steps per unit length, the same along every axis so that the curve is isotropic
+ * @returns     interleaved 21 bit quantised coordinates
+ */
+static inline uint64_t mortonCode(const cgp::Point & pnt, const cgp::BoundBox & bbox, float scale)
+{
+    uint64_t qx = (uint64_t) std::max(0.0f, std::min(2097151.0f, (pnt.x - bbox.min.x) * scale));
+    uint64_t qy = (uint64_t) std::max(0.0f, std::min(2097151.0f, (pnt.y - bbox.min.y) * scale));
+    uint64_t qz = (uint64_t) std::max(0.0f, std::min(2097151.0f, (pnt.z - bbox.min.z) * scale));
+    return spreadBits(qx) | (spreadBits(qy) << 1) | (spreadBits(qz) << 2);
+}
+
+void Mesh::reorder()
+{
+    int numverts = (int) verts.size(), numtris = (int) tris.size();
+    std::vector<std::pair<uint64_t, int>> keys(numverts), trikeys(numtris);
+    std::vector<int> remap(numverts);
+    std::vector<Triangle> sortedtris(numtris);
+    PointArray sortedverts;
+    VectorArray sortednorms;
+    bool hasnorms = (norms.size() == numverts);
+    cgp::BoundBox bbox;
+    cgp::Vector diag;
+    float scale, extent;
+
+    if(numverts == 0)
+        return;
+    bbox = verts.bounds();
+    diag = bbox.getDiag();
+    extent = std::max(diag.i, std::max(diag.j, diag.k));
+    scale = (extent > 0.0f) ? 2097151.0f / extent : 0.0f;
+
+    // vertices in curve order, with ties kept in their existing order
+#pragma omp parallel for
+    for(int v = 0; v < numverts; v++)
+        keys[v] = std::make_pair(mortonCode(verts[v], bbox, scale), v);
+    std::sort(keys.begin(), keys.end());
+
+    sortedverts.resize(numverts);
+    if(hasnorms)
+        sortednorms.resize(numverts);
+#pragma omp parallel for
+    for(int v = 0; v < numverts; v++)
+    {
+        int old = keys[v].second;
+        remap[old] = v;
+        sortedverts[v] = verts[old];
+        if(hasnorms)
+            sortednorms[v] = norms[old];
+    }
+    verts.swap(sortedverts);
+    if(hasnorms)
+        norms.swap(sortednorms);
+
+    // triangles in curve order of their centroids, so that consecutive triangles share vertices
+#pragma omp parallel for
+    for(int t = 0; t < numtris; t++)
+    {
+        cgp::Point c(0.0f, 0.0f, 0.0f);
+        for(int p = 0; p < 3; p++)
+        {
+            int v = tris[t].v[p];
+            if(v >= 0 && v < numverts)
+            {
+                tris[t].v[p] = remap[v];
+                cgp::Point q = verts[remap[v]];
+                c.x += q.x / 3.0f; c.y += q.y / 3.0f; c.z += q.z / 3.0f;
             }
+        }
+        trikeys[t] = std::make_pair(mortonCode(c, bbox, scale), t);
+    }
+    std::sort(trikeys.begin(), trikeys.end());
+#pragma omp parallel for
+    for(int t = 0; t < numtris; t++)
+        sortedtris[t] = tris[trikeys[t].second];
+    tris.swap(sortedtris);
+
+    // starting from curve order, triangles are reordered for the post-transform vertex cache and vertices by first use,
+    // once per change of topology rather than each time the mesh is packed for drawing
+    std::vector<int> faces, order;
+    faces.reserve(numtris * 3);
+    for(const Triangle & t: tris)
+        for(int p = 0; p < 3; p++)
+            faces.push_back(t.v[p]);
+    float acmr = computeACMR(faces, numverts);
+    optimizeVertexCache(faces, numverts, 32, &order);
+    if(numtris > 0)
+        cerr << "Vertex cache ACMR " << acmr << " before and " << computeACMR(faces, numverts) << " after optimisation" << endl;
+    if((int) order.size() == numtris)
+    {
+        optimizeVertexFetch(faces, numverts, remap);
+#pragma omp parallel for
+        for(int t = 0; t < numtris; t++)
+        {
+            sortedtris[t] = tris[order[t]];
+            for(int p = 0; p < 3; p++)
+                sortedtris[t].v[p] = faces[3*t+p];
+        }
+        tris.swap(sortedtris);
+#pragma omp parallel for
+        for(int v = 0; v < numverts; v++)
+        {
+            sortedverts[remap[v]] = verts[v];
+            if(hasnorms)
+                sortednorms[remap[v]] = norms[v];
+        }
+        verts.swap(sortedverts);
+        if(hasnorms)
+            norms.swap(sortednorms);
+    }
 
-            int limit = verts.size();
-            Triangle t;
-            t.v[0] = limit - 1;
-            t.v[1] = limit - 2;
-            t.v[2] = limit - 3;
+    // the sphere acceleration structure lists triangle indices, so is rebuilt on demand, while the vertices are
+    // only permuted and so still reflect the same deformation
+    boundspheres.clear();
+    adjvalid = false;
+    positionsChanged();
+}
+
+double Mesh::meanEdgeSpan()
+{
+    double sum = 0.0;
+    int numtris = (int) tris.size();
+
+    if(numtris == 0)
+        return 0.0;
+#pragma omp parallel for reduction(+:sum)
+    for(int t = 0; t < numtris; t++)
+        for(int p = 0; p < 3; p++)
+            sum += (double) abs(tris[t].v[p] - tris[t].v[(p+1)%3]);
+    return sum / (3.0 * (double) numtris);
+}
+
+bool Mesh::toCompact(CompactMesh & cmesh)
+{
+    return cmesh.encode(verts, tris);
+}
+
+void Mesh::fromCompact(const CompactMesh & cmesh)
+{
+    cmesh.decode(verts, tris);
+    norms.clear();
+    boundspheres.clear();
+    topologyChanged();
+    deriveVertNorms();
+}
+
+size_t Mesh::memoryBytes()
+{
+    return 3 * sizeof(float) * (size_t) (verts.size() + norms.size()) + sizeof(Triangle) * tris.size();
+}
+
+void Mesh::worldVerts(PointArray & points)
+{
+    glm::mat4x4 tfm;
+
+    buildTransform(tfm);
+    verts.transform(tfm, points);
+}
+
+cgp::BoundBox Mesh::bounds()
+{
+    PointArray points;
+
+    worldVerts(points);
+    return points.bounds();
+}
+
+float Mesh::containmentCost()
+{
+    int spheres = boundspheres.empty() ? sphperdim * sphperdim * sphperdim : (int) boundspheres.size();
+
+    return (float) (raysamples * spheres);
+}
+
+void Mesh::setGeometry(const PointArray & points, const std::vector<Triangle> & faces)
+{
+    verts = points;
+    tris = faces;
+    norms.clear();
+    boundspheres.clear();
+    topologyChanged();
+    deriveFaceNorms();
+    deriveVertNorms();
+}
+
+void Mesh::buildSphere(cgp::Point c, float r, int slices, int stacks)
+{
+    Triangle t;
+    int north, south;
+
+    clear();
+    slices = std::max(slices, 3);
+    stacks = std::max(stacks, 2);
+
+    // poles and stacks-1 rings of slices vertices, ring i at polar angle pi*i/stacks
+    north = 0;
+    verts.push_back(cgp::Point(c.x, c.y + r, c.z));
+    for(int i = 1; i < stacks; i++)
+    {
+        float theta = (float) M_PI * (float) i / (float) stacks;
+        for(int j = 0; j < slices; j++)
+        {
+            float phi = 2.0f * (float) M_PI * (float) j / (float) slices;
+            verts.push_back(cgp::Point(c.x + r * sinf(theta) * cosf(phi), c.y + r * cosf(theta), c.z - r * sinf(theta) * sinf(phi)));
+        }
+    }
+    south = verts.size();
+    verts.push_back(cgp::Point(c.x, c.y - r, c.z));
+
+    // rings advance counterclockwise seen from the north pole, so the caps and bands below wind outward
+    auto ring = [slices](int i, int j){ return 1 + (i - 1) * slices + (j % slices); };
+    for(int j = 0; j < slices; j++)
+    {
+        t.v[0] = north; t.v[1] = ring(1, j); t.v[2] = ring(1, j+1);
+        tris.push_back(t);
+        t.v[0] = south; t.v[1] = ring(stacks-1, j+1); t.v[2] = ring(stacks-1, j);
+        tris.push_back(t);
+    }
+    for(int i = 1; i < stacks-1; i++)
+        for(int j = 0; j < slices; j++)
+        {
+            t.v[0] = ring(i, j); t.v[1] = ring(i+1, j); t.v[2] = ring(i+1, j+1);
+            tris.push_back(t);
+            t.v[0] = ring(i, j); t.v[1] = ring(i+1, j+1); t.v[2] = ring(i, j+1);
             tris.push_back(t);
         }
+    topologyChanged();
+    deriveFaceNorms();
+    deriveVertNorms();
+}
+
+void Mesh::buildCylinder(cgp::Point s, cgp::Point e, float r, int slices)
+{
+    cgp::Vector axis, u, v, ref;
+    Triangle t;
+    int scap, ecap;
+
+    clear();
+    slices = std::max(slices, 3);
+
+    // orthonormal frame around the axis, with u x v along the axis
+    axis.diff(s, e);
+    axis.normalize();
+    ref = (fabs(axis.i) < 0.9f) ? cgp::Vector(1.0f, 0.0f, 0.0f) : cgp::Vector(0.0f, 1.0f, 0.0f);
+    u.cross(ref, axis);
+    u.normalize();
+    v.cross(axis, u);
+
+    // ring at each end and a center vertex for each cap
+    for(int end = 0; end < 2; end++)
+    {
+        cgp::Point base = (end == 0) ? s : e;
+        for(int j = 0; j < slices; j++)
+        {
+            float phi = 2.0f * (float) M_PI * (float) j / (float) slices;
+            float cu = r * cosf(phi), cv = r * sinf(phi);
+            verts.push_back(cgp::Point(base.x + cu * u.i + cv * v.i, base.y + cu * u.j + cv * v.j, base.z + cu * u.k + cv * v.k));
+        }
     }
+    scap = verts.size();
+    verts.push_back(s);
+    ecap = verts.size();
+    verts.push_back(e);
 
-    // clean up the mesh and calculate the normals
-    mergeVerts();
+    // rings turn counterclockwise about the axis, so the sides wind outward and the start cap is reversed
+    for(int j = 0; j < slices; j++)
+    {
+        int a = j, b = (j + 1) % slices;
+        t.v[0] = a; t.v[1] = b; t.v[2] = slices + b;
+        tris.push_back(t);
+        t.v[0] = a; t.v[1] = slices + b; t.v[2] = slices + a;
+        tris.push_back(t);
+        t.v[0] = scap; t.v[1] = b; t.v[2] = a;
+        tris.push_back(t);
+        t.v[0] = ecap; t.v[1] = slices + a; t.v[2] = slices + b;
+        tris.push_back(t);
+    }
+    topologyChanged();
     deriveFaceNorms();
     deriveVertNorms();
-    cerr << "Done marching!" << endl;
 }
 
-void Mesh::laplacianSmooth(int iter, float rate)
+void Mesh::updateNormals(const std::vector<int> & dirty)
 {
-    cerr << "Smoothing" << endl;
+    std::vector<int> faces, ring;
+    int numverts = (int) verts.size();
 
-    // get list of triangles adjacent to each vertex
-    std::vector<std::vector<int>> incident;
-    std::vector<int> empty_vec;
-    for(int v = 0; v < (int) verts.size(); v++)
-        incident.push_back(empty_vec);
-    for(int t = 0; t < (int) tris.size(); t++)
-        for(int i = 0; i < 3; i++)
-            incident[tris[t].v[i]].push_back(t);
+    // beyond a quarter of the mesh the full passes are cheaper than gathering the affected region
+    if(norms.size() != numverts || 4 * (int) dirty.size() > numverts)
+    {
+        deriveFaceNorms();
+        deriveVertNorms();
+        return;
+    }
 
+    // faces around the moved vertices change shape, and so do the normals at all of their corners
+    const MeshAdjacency & adj = getAdjacency();
+    for(int v: dirty)
+        faces.insert(faces.end(), adj.incident(v), adj.incident(v) + adj.numIncident(v));
+    std::sort(faces.begin(), faces.end());
+    faces.erase(std::unique(faces.begin(), faces.end()), faces.end());
+    for(int f: faces)
+        ring.insert(ring.end(), tris[f].v, tris[f].v + 3);
+    std::sort(ring.begin(), ring.end());
+    ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+
+#pragma omp parallel for
+    for(int f = 0; f < (int) faces.size(); f++)
+        tris[faces[f]].n = faceNormal(faces[f]);
+#pragma omp parallel for
+    for(int r = 0; r < (int) ring.size(); r++)
+        norms[ring[r]] = vertNormal(adj, ring[r]);
+}
+
+void Mesh::laplacianStep(const PointArray & src, PointArray & dst, float rate)
+{
+    // one-ring neighbours of each vertex, shared with the other topology passes
+    const MeshAdjacency & adj = getAdjacency();
+    const int * off = adj.neighbourOffsets().data();
+    const int * nbr = adj.neighbourIndices().data();
+    int numverts = (int) src.size();
+
+    dst.resize(numverts);
+    const float * px = src.xs(), * py = src.ys(), * pz = src.zs();
+    float * qx = dst.xs(), * qy = dst.ys(), * qz = dst.zs();
 
     // Implementation below based on algorithm described in slides below:
     // http://mesh.brown.edu/3dpgp-2008/notes/3DPGP-Smoothing-handout.pdf
-    for(int i = 0; i < iter; i++){
-        // for each vertex
-        for(int vert = 0; vert < verts.size(); vert++){
-            // get the list of neighbouring vertices by adding the vertices of all
-            // triangles around this vertex
-            std::set<int> neighbour_verts;
-            for(int tri = 0; tri < incident[vert].size(); tri++){
-                Triangle t = tris[incident[vert][tri]];
-
-                neighbour_verts.insert(t.v[0]);
-                neighbour_verts.insert(t.v[1]);
-                neighbour_verts.insert(t.v[2]);
-            }
-            neighbour_verts.erase(vert); //because we only want the neighbours
-
-            // compute the average difference (delta_v) between vert and neighbour_verts
-            cgp::Point delta_v(0.0f, 0.0f, 0.0f);
-            for(auto neighbour = neighbour_verts.begin(); neighbour != neighbour_verts.end(); neighbour++){
-                delta_v.x += (verts[*neighbour].x - verts[vert].x);
-                delta_v.y += (verts[*neighbour].y - verts[vert].y);
-                delta_v.z += (verts[*neighbour].z - verts[vert].z);
-            }
-            float avg_factor = 1.0f / neighbour_verts.size();
-            delta_v.x *= avg_factor;
-            delta_v.y *= avg_factor;
-            delta_v.z *= avg_factor;
-
-            // update this vertex to be smoother
-            verts[vert].x += (rate * delta_v.x);
-            verts[vert].y += (rate * delta_v.y);
-            verts[vert].z += (rate * delta_v.z);
+#pragma omp parallel for schedule(static)
+    for(int vert = 0; vert < numverts; vert++){
+        int start = off[vert], end = off[vert+1];
+        if(start == end){
+            qx[vert] = px[vert]; qy[vert] = py[vert]; qz[vert] = pz[vert];
+            continue;
         }
+
+        // average position of the neighbours, from which the umbrella vector follows
+        float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+#pragma omp simd reduction(+:sx,sy,sz)
+        for(int n = start; n < end; n++){
+            sx += px[nbr[n]];
+            sy += py[nbr[n]];
+            sz += pz[nbr[n]];
+        }
+        float avg_factor = 1.0f / (float) (end - start);
+        qx[vert] = px[vert] + rate * (sx * avg_factor - px[vert]);
+        qy[vert] = py[vert] + rate * (sy * avg_factor - py[vert]);
+        qz[vert] = pz[vert] + rate * (sz * avg_factor - pz[vert]);
+    }
+}
+
+void Mesh::laplacianSmooth(int iter, float rate)
+{
+    PointArray buffer;
+
+    cerr << "Smoothing" << endl;
+    positionsChanged();
+    for(int i = 0; i < iter; i++){
+        laplacianStep(verts, buffer, rate);
+        verts.swap(buffer);
     }
 
     // recalculate the normals so that the model looks good
@@ -1016,20 +1422,156 @@ void Mesh::laplacianSmooth(int iter, float rate)
     cerr << "Done smoothing!" << endl;
 }
 
-void Mesh::applyFFD(ffd * lat)
+void Mesh::taubinSmooth(int iter, float lambda, float mu)
 {
-    cerr << "Deforming" << endl;
-    // apply the deformation to every vertex in the mesh
-    for(int i = 0; i < verts.size(); i++){
-        lat->deform(verts[i]);
+    PointArray buffer;
+
+    cerr << "Taubin smoothing" << endl;
+    positionsChanged();
+    for(int i = 0; i < iter; i++){
+        laplacianStep(verts, buffer, lambda);
+        laplacianStep(buffer, verts, mu);
     }
 
-    // recalculate the normals so that they match the new deformed vertex positions
     deriveFaceNorms();
     deriveVertNorms();
+    cerr << "Done smoothing!" << endl;
+}
+
+bool Mesh::implicitSmooth(float lambda, int maxiter, float tol)
+{
+    const MeshAdjacency & adj = getAdjacency();
+    const std::vector<int> & off = adj.neighbourOffsets();
+    const std::vector<int> & nbr = adj.neighbourIndices();
+    int numverts = (int) verts.size();
+    std::vector<int> rowoff(numverts+1), colidx;
+    std::vector<double> b(numverts), x(numverts);
+    SparseMatrix A;
+    bool converged = true;
+
+    cerr << "Implicit smoothing" << endl;
+    positionsChanged();
+    if(numverts == 0)
+        return true;
+
+    // pattern of D + lambda (D - A): each neighbour list with the diagonal inserted in column order
+    for(int v = 0; v < numverts; v++)
+        rowoff[v+1] = rowoff[v] + (off[v+1] - off[v]) + 1;
+    colidx.resize(rowoff[numverts]);
+#pragma omp parallel for
+    for(int v = 0; v < numverts; v++)
+    {
+        int k = rowoff[v];
+        bool diagdone = false;
+
+        for(int n = off[v]; n < off[v+1]; n++)
+        {
+            if(!diagdone && nbr[n] > v)
+            {
+                colidx[k] = v; k++;
+                diagdone = true;
+            }
+            colidx[k] = nbr[n]; k++;
+        }
+        if(!diagdone)
+            colidx[k] = v;
+    }
+    A.setPattern(rowoff, colidx);
+#pragma omp parallel for
+    for(int v = 0; v < numverts; v++)
+    {
+        double valence = (double) (off[v+1] - off[v]);
+        for(int k = A.rowStart(v); k < A.rowEnd(v); k++)
+        {
+            if(A.column(k) == v)
+                A.value(k) = (valence > 0.0) ? valence * (1.0 + lambda) : 1.0; // isolated vertices stay put
+            else
+                A.value(k) = -lambda;
+        }
+    }
+
+    // solve for each coordinate in turn, right hand side D x0 and initial guess x0
+    for(int c = 0; c < 3; c++)
+    {
+        int iters;
+#pragma omp parallel for
+        for(int v = 0; v < numverts; v++)
+        {
+            double valence = (double) (off[v+1] - off[v]);
+            x[v] = (c == 0) ? verts[v].x : ((c == 1) ? verts[v].y : verts[v].z);
+            b[v] = (valence > 0.0) ? valence * x[v] : x[v];
+        }
+        if(!solveCG(A, b, x, maxiter, tol, iters))
+        {
+            cerr << "Error Mesh::implicitSmooth: solver did not converge in " << iters << " iterations" << endl;
+            converged = false;
+        }
+#pragma omp parallel for
+        for(int v = 0; v < numverts; v++)
+        {
+            if(c == 0) verts[v].x = (float) x[v];
+            else if(c == 1) verts[v].y = (float) x[v];
+            else verts[v].z = (float) x[v];
+        }
+    }
+
+    deriveFaceNorms();
+    deriveVertNorms();
+    cerr << "Done smoothing!" << endl;
+    return converged;
+}
+
+void Mesh::applyFFD(ffd * lat)
+{
+    PointArray deformed;
+
+    cerr << "Deforming" << endl;
+    positionsChanged();
+    deformed.resize(verts.size());
+    if(norms.size() == verts.size())
+    {
+        // carry the vertex normals through the deformation Jacobian in the same batch as the vertices
+        lat->deform(verts.xs(), verts.ys(), verts.zs(), deformed.xs(), deformed.ys(), deformed.zs(),
+                    norms.xs(), norms.ys(), norms.zs(), norms.xs(), norms.ys(), norms.zs(), verts.size());
+        verts.swap(deformed);
+        deriveFaceNorms();
+    }
+    else
+    {
+        // no normals to transport, so derive them from the deformed geometry
+        lat->deform(verts.xs(), verts.ys(), verts.zs(), deformed.xs(), deformed.ys(), deformed.zs(), verts.size());
+        verts.swap(deformed);
+        deriveFaceNorms();
+        deriveVertNorms();
+    }
     cerr << "Done deforming" << endl;
 }
 
+bool Mesh::followFFD(ffd * lat)
+{
+    std::vector<int> moved;
+
+    if(ffdbind.isBound(lat))
+        return true;
+    if(!ffdbind.bind(lat, verts.xs(), verts.ys(), verts.zs(), verts.size(), moved))
+        return false;
+    if(!moved.empty())
+        updateNormals(moved);
+    return true;
+}
+
+bool Mesh::moveFFDControlPoint(ffd * lat, int i, int j, int k, cgp::Point pnt)
+{
+    std::vector<int> moved;
+
+    if(!followFFD(lat))
+        return false;
+    if(!ffdbind.moveCP(i, j, k, pnt, verts.xs(), verts.ys(), verts.zs(), moved))
+        return false;
+    updateNormals(moved);
+    return true;
+}
+
 bool Mesh::readSTL(string filename)
 {
     ifstream infile;
@@ -1104,6 +1646,7 @@ bool Mesh::readSTL(string filename)
 
         // STL provides a triangle soup so merge vertices that are coincident
         mergeVerts();
+        reorder();
         // normal vectors at vertices are needed for rendering so derive from incident faces
         deriveVertNorms();
         if(basicValidity())
@@ -1446,163 +1989,254 @@ void Mesh::basicBreakTest()
     tris.push_back(t);
 }
 
-bool Mesh::manifoldValidity()
+void ManifoldReport::clear()
 {
-    std::unordered_multimap<long, int> trilookup; // key is sum of vertex indices, needs a multimap because this is not unique
-    long key;
-    int i, j, k, t, v, e, erest, mcount, ocount;
-    std::vector<std::vector<int>> incident;
-    std::vector<int> incempty;
-    std::vector<Edge> edges;
-    std::vector<bool> visited;
-    bool opposite, fin, found;
-    Edge edge1, edge2;
+    nonmanifoldedges.clear();
+    misorientededges.clear();
+    nonmanifoldverts.clear();
+    duplicatetris.clear();
+    boundaryloops.clear();
+}
 
-    /*
-     // inefficient search of triangle list for duplicates - O(n^2)
-     int t = 0, trest = 0;
-     bool found = false;
-     while(!found && t < (int) tris.size()-1)
-     {
-     // search remainder of list
-     trest = t+1;
-     while(!found && trest < (int) tris.size())
-     {
-     if(sameTriangle(tris[t], tris[trest]))
-     {
-     found = true;
-     }
-     trest++;
-     }
-     t++;
-     }
-     if(found)
-     {
-     cerr << "Error Mesh::manifoldValidity(): duplicate triangle found" << endl;
-     return false;
-     }
-     */
+bool ManifoldReport::valid() const
+{
+    return nonmanifoldedges.empty() && misorientededges.empty() && nonmanifoldverts.empty()
+        && duplicatetris.empty() && boundaryloops.empty();
+}
 
-    // search triangle list for duplicates
-    // usual trick for more efficient version using hash table but this time keys map to multiple values
-    for(i = 0; i < (int) tris.size(); i++)
+void ManifoldReport::print() const
+{
+    if(!duplicatetris.empty())
+        cerr << "Error Mesh::manifoldValidity(): " << duplicatetris.size() << " duplicate triangles, first pair " << duplicatetris[0].first << " and " << duplicatetris[0].second << endl;
+    if(!nonmanifoldedges.empty())
+        cerr << "Error Mesh::manifoldValidity(): " << nonmanifoldedges.size() << " edges with more than two incident triangles, first " << nonmanifoldedges[0].v[0] << "-" << nonmanifoldedges[0].v[1] << endl;
+    if(!misorientededges.empty())
+        cerr << "Error Mesh::manifoldValidity(): " << misorientededges.size() << " edges with inconsistently wound triangles, first " << misorientededges[0].v[0] << "-" << misorientededges[0].v[1] << endl;
+    if(!nonmanifoldverts.empty())
+        cerr << "Error Mesh::manifoldValidity(): " << nonmanifoldverts.size() << " vertices without a single cycle of incident triangles, first " << nonmanifoldverts[0] << endl;
+    if(!boundaryloops.empty())
+        cerr << "Error Mesh::manifoldValidity(): " << boundaryloops.size() << " boundary loops, first of length " << boundaryloops[0].size() << endl;
+}
+
+/// Incidence of a triangle edge on its lower endpoint, used to group the edges of a vertex
+struct EdgeUse
+{
+    int other;  ///< higher endpoint of the edge
+    int tri;    ///< triangle using the edge
+    bool fwd;   ///< true if the triangle traverses the edge from the lower to the higher endpoint
+};
+
+bool Mesh::manifoldCheck(ManifoldReport & report)
+{
+    // list of triangles incident on each vertex comes from the shared adjacency structure
+    const MeshAdjacency & adj = getAdjacency();
+    int numverts = adj.numVerts();
+    std::vector<Edge> boundary; // boundary edges in triangle winding order
+
+    report.clear();
+
+    // Each edge and each triangle is examined only at its lowest vertex, so vertices can be processed
+    // independently and the total work is linear in mesh size for bounded vertex valence
+#pragma omp parallel
     {
-        key = (long) tris[i].v[0] + (long) tris[i].v[1] + (long) tris[i].v[2]; // use sum of vertex indices as the key, not unique but a good start
-        if(!(trilookup.find(key) == trilookup.end())) // key in map
+        std::vector<Edge> nonmanifold, misoriented, open;
+        std::vector<int> pinched;
+        std::vector<std::pair<int, int>> duplicates;
+        std::vector<EdgeUse> uses;
+        std::vector<std::pair<long, int>> keys;
+        std::vector<std::pair<int, int>> spokes;
+        std::vector<int> parent;
+
+#pragma omp for schedule(dynamic, 256) nowait
+        for(int v = 0; v < numverts; v++)
         {
-            // cerr << "possible dup" << endl;
-            // iterate over triangles with the same key to see if any are duplicates
-            auto range = trilookup.equal_range(key);
-            for(auto it = range.first; it != range.second; it++) // now check if each truly is a duplicate, by looking at all values with the same key
+            const int * incident = adj.incident(v);
+            int numinc = adj.numIncident(v);
+            if(numinc == 0) // dangling vertices are picked up by basicValidity
+                continue;
+
+            uses.clear(); keys.clear(); spokes.clear();
+            for(int j = 0; j < numinc; j++)
             {
-                // cerr << tris[i].v[0] << " " << tris[i].v[1] << " " << tris[i].v[2] << " ?= " << tris[it->second].v[0] << " " << tris[it->second].v[1] << " " << tris[it->second].v[2] << endl;
-                if(sameTriangle(tris[i], tris[it->second]))
+                int t = incident[j];
+                if(j > 0 && incident[j-1] == t) // degenerate triangle listed twice for this vertex
+                    continue;
+                const int * tv = tris[t].v;
+                for(int k = 0; k < 3; k++)
                 {
-                    cerr << "Error Mesh::manifoldValidity(): duplicate triangle found" << endl;
-                    return false; // early out - exits on first duplicate encountered
+                    if(tv[k] != v)
+                        continue;
+                    int next = tv[(k+1)%3], prev = tv[(k+2)%3];
+
+                    // edges owned by this vertex
+                    if(next > v)
+                        uses.push_back({next, t, true});
+                    if(prev > v)
+                        uses.push_back({prev, t, false});
+
+                    // spokes connect triangles that share an edge around this vertex
+                    spokes.push_back(std::make_pair(next, j));
+                    spokes.push_back(std::make_pair(prev, j));
+
+                    // triangles owned by this vertex, keyed on the remaining two vertices
+                    if(next > v && prev > v)
+                    {
+                        long lo = std::min(next, prev), hi = std::max(next, prev);
+                        keys.push_back(std::make_pair(lo * (long) numverts + hi, t));
+                    }
                 }
             }
-        }
-        trilookup.emplace(key, i); // add triangle index to multimap
-    }
-
-    // make sure every edge appears exactly twice in triangle list, with edges traversed in different directions
-    // build list of triangles incident on each vertex - single pass over tris list
-    for(v = 0; v < (int) verts.size(); v++)
-        incident.push_back(incempty);
-    for(t = 0; t < (int) tris.size(); t++)
-        for(i = 0; i < 3; i++)
-            incident[tris[t].v[i]].push_back(t);
 
-    // make sure edges match up around each vertex. Each edge is shared by two triangles with opposite directions - single pass over incident list
-    for(i = 0; i < (int) incident.size(); i++)
-    {
-
-        // note: this edge counting approach does not pick up cases where two surfaces touch at a single vertex
-        edges.clear();
-        // gather incident edges
-        for(j = 0; j < (int) incident[i].size(); j++)
-        {
-            t = (incident[i])[j]; // index of incident triangle
-            for(k = 0; k < 3; k++) // gather edges incident on vertex
+            // classify each owned edge by the number and direction of triangles using it
+            std::sort(uses.begin(), uses.end(), [](const EdgeUse & a, const EdgeUse & b){ return a.other < b.other || (a.other == b.other && a.tri < b.tri); });
+            for(int a = 0, b = 0; a < (int) uses.size(); a = b)
             {
-                if(tris[t].v[k] == i) // vertex for incidence, gather edge before and after
+                int fwd = 0, bwd = 0;
+                for(b = a; b < (int) uses.size() && uses[b].other == uses[a].other; b++)
                 {
-                    edge1.v[0] = i; edge1.v[1] = tris[t].v[(k+1)%3]; // outgoing edge
-                    edges.push_back(edge1);
-
-                    // incoming edge
-                    edge2.v[0] = tris[t].v[(k+2)%3]; edge2.v[1] = i; // incoming edge
-                    edges.push_back(edge2);
+                    if(uses[b].fwd)
+                        fwd++;
+                    else
+                        bwd++;
+                }
+                Edge edge;
+                edge.v[0] = v; edge.v[1] = uses[a].other;
+                if(fwd + bwd > 2)
+                    nonmanifold.push_back(edge);
+                else if(fwd + bwd == 2 && fwd != 1)
+                    misoriented.push_back(edge);
+                else if(fwd + bwd == 1)
+                {
+                    if(!uses[a].fwd)
+                        std::swap(edge.v[0], edge.v[1]);
+                    open.push_back(edge);
                 }
             }
+
+            // duplicate triangles share their lowest vertex and have the same remaining pair
+            std::sort(keys.begin(), keys.end());
+            for(int a = 1; a < (int) keys.size(); a++)
+                if(keys[a].first == keys[a-1].first)
+                    duplicates.push_back(std::make_pair(keys[a-1].second, keys[a].second));
+
+            // the incident triangles should form a single fan, found as connected components over shared spokes
+            parent.resize(numinc);
+            for(int j = 0; j < numinc; j++)
+                parent[j] = j;
+            auto root = [&parent](int j){ while(parent[j] != j) j = parent[j] = parent[parent[j]]; return j; };
+            std::sort(spokes.begin(), spokes.end());
+            for(int a = 1; a < (int) spokes.size(); a++)
+                if(spokes[a].first == spokes[a-1].first)
+                    parent[root(spokes[a].second)] = root(spokes[a-1].second);
+            int fans = 0;
+            for(int j = 0; j < numinc; j++)
+                if((j == 0 || incident[j-1] != incident[j]) && root(j) == j)
+                    fans++;
+            if(fans > 1)
+                pinched.push_back(v);
         }
 
-        // compare edges - O(n^2) but small n
-        for(e = 0; e < (int) edges.size(); e++)
+#pragma omp critical
         {
-            mcount = 0; ocount = 0;
-            for(erest = 0; erest < (int) edges.size(); erest++)
-            {
-                if(e != erest)
-                    if(sameEdge(edges[e], edges[erest], opposite))
-                    {
-                        if(opposite)
-                            ocount++;
-                        else
-                            mcount++;
-                    }
-            }
-            if(ocount != 1 || mcount != 0) // only one matching edge wound oppositely
-            {
-                cerr << "Error Mesh::manifoldValidity(): edges do not have exactly two incident triangles correctly wound" << endl;
-                return false;
-            }
+            report.nonmanifoldedges.insert(report.nonmanifoldedges.end(), nonmanifold.begin(), nonmanifold.end());
+            report.misorientededges.insert(report.misorientededges.end(), misoriented.begin(), misoriented.end());
+            report.nonmanifoldverts.insert(report.nonmanifoldverts.end(), pinched.begin(), pinched.end());
+            report.duplicatetris.insert(report.duplicatetris.end(), duplicates.begin(), duplicates.end());
+            boundary.insert(boundary.end(), open.begin(), open.end());
         }
+    }
 
-        // check for reachability - there should only be a single cycle around a vertex
-        // more efficient if this was combined with the previous loop but less readable
-        visited.clear(); visited.resize((int) incident[i].size(), false);
-        e = 0; visited[0] = true; fin = false;
-        while(!fin)
+    // threads finish in arbitrary order, so sort for reproducible reports
+    auto edgeLess = [](const Edge & a, const Edge & b){ return a.v[0] < b.v[0] || (a.v[0] == b.v[0] && a.v[1] < b.v[1]); };
+    std::sort(report.nonmanifoldedges.begin(), report.nonmanifoldedges.end(), edgeLess);
+    std::sort(report.misorientededges.begin(), report.misorientededges.end(), edgeLess);
+    std::sort(report.nonmanifoldverts.begin(), report.nonmanifoldverts.end());
+    std::sort(report.duplicatetris.begin(), report.duplicatetris.end());
+    std::sort(boundary.begin(), boundary.end(), edgeLess);
+
+    // chain boundary edges into loops by following each edge to one leaving its end vertex
+    std::vector<bool> used(boundary.size(), false);
+    for(int e = 0; e < (int) boundary.size(); e++)
+    {
+        if(used[e])
+            continue;
+        std::vector<int> loop;
+        int cur = e;
+        while(cur >= 0)
         {
-            // find adjacent triangle to outgoing edge using incident edge table
-            found = false; erest = 0;
-            while(!found && erest < (int) edges.size())
-            {
-                if(e != erest)
-                    if(sameEdge(edges[e], edges[erest], opposite))
-                    {
-                        found = true;
-                        e = erest;
-
-                        // check if triangle is already visited
-                        if(visited[e/2])
-                            fin = true;
-                        else
-                            visited[e/2] = true;
-
-                        if(e % 2 == 0) // find outgoing edge, come in pairs
-                            e++;
-                        else
-                            e--;
-                    }
-                erest++;
-            }
+            used[cur] = true;
+            loop.push_back(boundary[cur].v[0]);
+            if(boundary[cur].v[1] == boundary[e].v[0]) // closed the loop
+                break;
+
+            Edge key; key.v[0] = boundary[cur].v[1]; key.v[1] = -1;
+            auto it = std::lower_bound(boundary.begin(), boundary.end(), key, edgeLess);
+            cur = -1;
+            for(; it != boundary.end() && it->v[0] == key.v[0]; it++)
+                if(!used[it - boundary.begin()])
+                {
+                    cur = (int) (it - boundary.begin());
+                    break;
+                }
+            if(cur < 0) // open chain, which can only happen alongside other errors
+                loop.push_back(key.v[0]);
         }
+        report.boundaryloops.push_back(loop);
+    }
+
+    // For true 2-manifold validity the surface must also be free of self-intersections, which selfIntersections tests separately
+    return report.valid();
+}
+
+void Mesh::selfIntersections(std::vector<std::pair<int, int>> & pairs)
+{
+    TriangleBVH bvh;
+    int numtris = (int) tris.size();
 
-        for(j = 0; j < (int) incident[i].size(); j++)
+    pairs.clear();
+    bvh.build(verts, tris);
+
+    // each triangle queries the hierarchy with its own bounds and keeps only higher indexed partners, so every pair is tested once
+#pragma omp parallel
+    {
+        std::vector<int> hits;
+        std::vector<std::pair<int, int>> found;
+
+#pragma omp for schedule(dynamic, 256) nowait
+        for(int t = 0; t < numtris; t++)
         {
-            if(!visited[j])
+            const int * tv = tris[t].v;
+            hits.clear();
+            bvh.query(bvh.triangleBox(t), hits);
+            for(int h: hits)
             {
-                cerr << "Error Mesh::manifoldValidity(): vertices do note have a single cycle of incident triangles" << endl;
-                return false;
+                if(h <= t)
+                    continue;
+                const int * hv = tris[h].v;
+                bool shared = false;
+                for(int i = 0; i < 3; i++)
+                    for(int j = 0; j < 3; j++)
+                        if(tv[i] == hv[j])
+                            shared = true;
+                if(!shared && triTriIntersect(verts[tv[0]], verts[tv[1]], verts[tv[2]], verts[hv[0]], verts[hv[1]], verts[hv[2]]))
+                    found.push_back(std::make_pair(t, h));
             }
         }
+
+#pragma omp critical
+        pairs.insert(pairs.end(), found.begin(), found.end());
     }
+    std::sort(pairs.begin(), pairs.end());
+}
 
-    // For true 2-manifold validity it would also be necessary to see if the object is self-intersecting by testing triangles against
-    // each other for intersection. This would require a spatial data structure such as a bounding sphere hierarchy to accelerate properly
-    // which is beyond the scope of this assignment
+bool Mesh::manifoldValidity()
+{
+    ManifoldReport report;
+
+    if(!manifoldCheck(report))
+    {
+        report.print();
+        return false;
+    }
     return true;
 }
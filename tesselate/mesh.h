@@ -8,11 +8,15 @@
 #define _MESH
 
 #include <vector>
+#include <unordered_map>
 #include <stdio.h>
 #include <iostream>
-#include "renderer.h"
+#include "shape.h"
 #include "ffd.h"
 #include "voxels.h"
+#include "adjacency.h"
+
+class CompactMesh;
 
 using namespace std;
 
@@ -35,6 +39,28 @@ struct Edge
     int v[2];   ///< indices into the vertex list for edge endpoints
 };
 
+/**
+ * Full diagnostics from a closed two-manifold check. Every problem found is listed rather than only the first.
+ * Edges are reported with their endpoints in increasing order.
+ */
+struct ManifoldReport
+{
+    std::vector<Edge> nonmanifoldedges;     ///< edges shared by more than two triangles
+    std::vector<Edge> misorientededges;     ///< edges shared by two triangles that traverse them in the same direction
+    std::vector<int> nonmanifoldverts;      ///< vertices whose incident triangles form more than one fan, e.g. surfaces touching at a point
+    std::vector<std::pair<int, int>> duplicatetris;   ///< pairs of triangles over the same three vertices, lower index first
+    std::vector<std::vector<int>> boundaryloops;    ///< chains of boundary edges as vertex sequences, following triangle winding
+
+    /// Remove all diagnostics
+    void clear();
+
+    /// Test whether no problems were found, which means the mesh is a closed two-manifold
+    bool valid() const;
+
+    /// Print a summary of the diagnostics to standard error
+    void print() const;
+};
+
 /**
  * Abstract base class for shapes
  */
@@ -59,6 +85,15 @@ public:
      * @retval false otherwise
      */
     virtual bool pointContainment(cgp::Point pnt)=0;
+
+    /**
+     * Axis aligned box in world space outside which pointContainment is always false
+     * @returns bounding box of the shape
+     */
+    virtual cgp::BoundBox bounds()=0;
+
+    /// Relative cost of a single pointContainment test, taking a sphere test as 1
+    virtual float containmentCost(){ return 1.0f; }
 };
 
 /**
@@ -104,6 +139,11 @@ public:
      */
     bool pointContainment(cgp::Point pnt);
 
+    /**
+     * Axis aligned bounding box of the sphere
+     * @returns bounding box
+     */
+    cgp::BoundBox bounds();
 };
 
 /**
@@ -150,6 +190,12 @@ public:
      * @retval false otherwise
      */
     bool pointContainment(cgp::Point pnt);
+
+    /**
+     * Tight axis aligned bounding box of the cylinder, including its end caps
+     * @returns bounding box
+     */
+    cgp::BoundBox bounds();
 };
 
 /**
@@ -158,14 +204,17 @@ public:
 class Mesh: public BaseShape
 {
 private:
-    std::vector<cgp::Point> verts; ///< vertices of the tesselation structure
-    std::vector<cgp::Vector> norms;  ///< per vertex normals
+    PointArray verts;           ///< vertices of the tesselation structure, stored as separate coordinate arrays
+    VectorArray norms;          ///< per vertex normals, stored as separate component arrays
     std::vector<Triangle> tris; ///< triangles that join to make up the mesh
     GLfloat * col;              ///< (r,g,b,a) colour
     float scale;                ///< scaling factor
     cgp::Vector trx;                 ///< translation
     float xrot, yrot, zrot;     ///< rotation angles about x, y, and z axes
     std::vector<Sphere> boundspheres; ///< bounding sphere accel structure
+    MeshAdjacency adjacency;    ///< lazily built vertex and triangle incidence
+    bool adjvalid;              ///< whether adjacency matches the current triangle list
+    FFDBinding ffdbind;         ///< lattice coordinates of the vertices for incremental deformation, and the moves they reflect
 
     /**
      * Search list of vertices to find matching point
@@ -195,12 +244,41 @@ private:
     /// Connect triangles together by merging duplicate vertices
     void mergeVerts();
 
+    /// Discard cached topology. Must be called whenever triangles are added, removed or re-indexed. New vertices reflect no deformation
+    void topologyChanged(){ adjvalid = false; ffdbind.clear(); }
+
+    /// Discard cached vertex positions. Must be called whenever vertices move other than through moveFFDControlPoint
+    void positionsChanged(){ ffdbind.unbind(); }
+
     /// Generate vertex normals by averaging normals of the surrounding faces
     void deriveVertNorms();
 
+    /**
+     * Apply one Jacobi step of the umbrella operator, reading only from src so that vertices can be updated in parallel
+     * @param src       vertex positions before the step
+     * @param[out] dst  vertex positions after the step, same size as src
+     * @param rate      proportion of the full Laplacian applied, negative values inflate the surface
+     */
+    void laplacianStep(const PointArray & src, PointArray & dst, float rate);
+
     /// Generate face normals from triangle vertex positions
     void deriveFaceNorms();
 
+    /**
+     * Calculate the unit normal of a single triangle from its vertex positions
+     * @param t     triangle index
+     * @returns     outward facing unit normal, by counterclockwise winding
+     */
+    cgp::Vector faceNormal(int t);
+
+    /**
+     * Calculate the normal of a single vertex by averaging the normals of its incident faces
+     * @param adj   vertex incidence of the mesh
+     * @param v     vertex index
+     * @returns     unit vertex normal
+     */
+    cgp::Vector vertNormal(const MeshAdjacency & adj, int v);
+
     /**
      * Composite rotations, translation and scaling into a single transformation matrix
      * @param tfm   composited transformation matrix
@@ -248,6 +326,12 @@ public:
     /// Test whether mesh is empty of any geometry (true if empty, false otherwise)
     bool empty(){ return verts.empty(); }
 
+    /**
+     * Access vertex and triangle incidence, which is rebuilt on demand if the topology has changed
+     * @returns shared adjacency structure, valid until the next topology change
+     */
+    const MeshAdjacency & getAdjacency();
+
     /// Setter for scale
     void setScale(float scf){ scale = scf; }
 
@@ -269,6 +353,9 @@ public:
     /// Setter for colour
     void setColour(GLfloat * setcol){ col = setcol; }
 
+    /// Getter for colour
+    GLfloat * getColour(){ return col; }
+
     /**
      * Generate and bind triangle mesh geometry for OpenGL rendering
      * @param view      current view parameters
@@ -293,6 +380,15 @@ public:
      */
     bool pointContainment(cgp::Point pnt);
 
+    /**
+     * Axis aligned bounding box of the mesh with its transformation applied
+     * @returns bounding box
+     */
+    cgp::BoundBox bounds();
+
+    /// Relative cost of pointContainment, which tests every bounding sphere along each of several rays
+    float containmentCost();
+
     /**
      * Scale geometry to fit bounding cube centered at origin
      * @param sidelen   length of one side of the bounding cube
@@ -305,23 +401,171 @@ public:
      * @param vox           voxel volume
      * @todo mesh::marchingCubes to be completed for CGP Assignment3
      */
-    void marchingCubes(VoxelVolume vox);
+    void marchingCubes(VoxelVolume & vox);
+
+    /**
+     * Apply marching cubes to a block of cells of a voxel volume, appending the triangles to existing geometry. Vertices
+     * are welded through a key identifying the voxel they are placed at, so blocks extracted separately with the same
+     * vertex keys stitch together exactly
+     * @param vox           voxel volume
+     * @param cells         block of cells, where cell (x, y, z) spans voxels x to x+1, y to y+1 and z to z+1
+     * @param skip          block of cells to leave out, or NULL
+     * @param[in,out] points    vertex positions
+     * @param[in,out] faces     triangles indexing into points
+     * @param[in,out] keys      global key of each vertex in points
+     * @param[in,out] welded    index into points of each key seen so far
+     */
+    static void marchCells(VoxelVolume & vox, const VoxelRange & cells, const VoxelRange * skip, PointArray & points,
+                           std::vector<Triangle> & faces, std::vector<long> & keys, std::unordered_map<long, int> & welded);
+
+    /**
+     * Sort vertices and then triangles along a Morton (Z-order) curve through the bounding box and remap the
+     * triangle indices, so that vertices which are close in space are also close in memory. Speeds up passes that
+     * gather the neighbours of each vertex or triangle, such as smoothing, normal derivation and containment tests.
+     * Triangles are then reordered for the post-transform vertex cache, and vertices by first use, which keeps them
+     * local while making the order ready to draw. Applied automatically after marching cubes extraction and STL loading
+     */
+    void reorder();
+
+    /**
+     * Measure how far apart connected vertices lie in the vertex list, as a proxy for the cache misses of
+     * neighbourhood gathers
+     * @returns mean absolute difference of endpoint indices over all triangle edges, 0 for an empty mesh
+     */
+    double meanEdgeSpan();
 
     /**
-     * Apply in-place simple Laplacian smoothing to the mesh
+     * Store the vertices and triangles in compact form, with quantised positions and narrow indices
+     * @param[out] cmesh    compact copy of the mesh
+     * @retval true if the mesh was encoded,
+     * @retval false if it has out of bounds triangle indices
+     */
+    bool toCompact(CompactMesh & cmesh);
+
+    /**
+     * Replace the vertices and triangles with the expansion of a compact mesh, deriving face and vertex normals.
+     * Transformation and colour settings are kept
+     * @param cmesh     compact mesh
+     */
+    void fromCompact(const CompactMesh & cmesh);
+
+    /// Bytes of storage used by the vertex, normal and triangle arrays
+    size_t memoryBytes();
+
+    /// Vertex positions in model space
+    const PointArray & getVerts(){ return verts; }
+
+    /// Triangles indexing into the vertex positions
+    const std::vector<Triangle> & getTris(){ return tris; }
+
+    /**
+     * Vertex positions with the scale, rotation and translation of the mesh applied, as used for containment tests
+     * @param[out] points   transformed positions, in vertex order
+     */
+    void worldVerts(PointArray & points);
+
+    /**
+     * Replace the vertices and triangles and derive normals. Vertices are used as given, without merging
+     * @param points    vertex positions
+     * @param faces     triangles indexing into points, with counterclockwise winding from outside
+     */
+    void setGeometry(const PointArray & points, const std::vector<Triangle> & faces);
+
+    /**
+     * Replace the mesh with a closed two-manifold tessellation of a sphere
+     * @param c         sphere center
+     * @param r         sphere radius
+     * @param slices    number of subdivisions around the polar axis, at least 3
+     * @param stacks    number of subdivisions from pole to pole, at least 2
+     */
+    void buildSphere(cgp::Point c, float r, int slices, int stacks);
+
+    /**
+     * Replace the mesh with a closed two-manifold tessellation of a capped cylinder
+     * @param s, e      start and end points of the cylinder axis
+     * @param r         cylinder radius
+     * @param slices    number of subdivisions around the axis, at least 3
+     */
+    void buildCylinder(cgp::Point s, cgp::Point e, float r, int slices);
+
+    /**
+     * Recompute normals after some vertices have moved. Only the faces incident on a moved vertex and the
+     * vertices of those faces are updated, so the cost depends on the size of the edit rather than the mesh.
+     * Falls back to a full recomputation if normals are missing or a large part of the mesh is dirty
+     * @param dirty indices of vertices whose positions have changed
+     */
+    void updateNormals(const std::vector<int> & dirty);
+
+    /**
+     * Apply simple Laplacian smoothing to the mesh. Each iteration is a Jacobi update, so the result
+     * does not depend on vertex order
      * @param iter  number of smoothing iterations
      * @param rate  proportion of full Laplacian that is applied on each iteration
-     * @todo mesh::laplacianSmooth to be completed for CGP Assignment3
      */
     void laplacianSmooth(int iter, float rate);
 
     /**
-     * Apply a free-form deformation to the mesh
+     * Apply Taubin lambda|mu smoothing, which alternates a shrinking and an inflating Laplacian step
+     * to remove high frequency noise without the volume loss of plain Laplacian smoothing
+     * @param iter      number of lambda|mu step pairs
+     * @param lambda    positive smoothing rate of the first step
+     * @param mu        negative inflation rate of the second step, with |mu| slightly larger than lambda
+     */
+    void taubinSmooth(int iter, float lambda, float mu);
+
+    /**
+     * Apply one implicit (backward Euler) step of Laplacian smoothing by solving (I + lambda L) x = x0 for the
+     * umbrella operator L. The system is symmetrised by scaling rows with vertex valence and solved for each
+     * coordinate with preconditioned conjugate gradients, warm started from the current vertex positions.
+     * Unlike explicit smoothing the step is stable for any lambda, so a single step can replace many explicit iterations
+     * @param lambda    smoothing strength, roughly equivalent to lambda explicit iterations at unit rate
+     * @param maxiter   maximum number of solver iterations per coordinate
+     * @param tol       solver convergence threshold on the relative residual
+     * @retval true  if the solver converged for all coordinates,
+     * @retval false otherwise, in which case the best approximation found is kept
+     */
+    bool implicitSmooth(float lambda, int maxiter = 200, float tol = 1.0e-6f);
+
+    /**
+     * Apply a free-form deformation to the mesh. Vertex normals are carried through the deformation Jacobian in
+     * the same pass as the vertices, so no adjacency is needed, and only the face normals are recomputed. The vertices
+     * are deformed as they stand, whatever moves they already reflect, so use followFFD to avoid deforming them twice
      * @param lat   ffd lattice being applied
      * @todo mesh::applyFFD to be completed for CGP Assignment3
      */
     void applyFFD(ffd * lat);
 
+    /**
+     * Bring the mesh up to date with a free-form deformation lattice, applying only the control point moves that the
+     * vertices do not already reflect. A newly built mesh receives the full deformation of the lattice, while a mesh
+     * smoothed after following the lattice only receives the moves made since. Leaves the mesh bound to the lattice
+     * @param lat   ffd lattice being applied
+     * @retval true if the mesh follows the lattice,
+     * @retval false if the lattice is not allocated
+     */
+    bool followFFD(ffd * lat);
+
+    /**
+     * Move one control point of a free-form deformation lattice and update the mesh incrementally. The first move
+     * binds the vertices to the lattice as followFFD does, after which each move only shifts the vertices within the
+     * support of the control point, by their basis weight times the move, and refreshes the normals around them.
+     * The binding lapses if the vertices are changed in any other way or the lattice layout changes
+     * @param lat       ffd lattice being edited
+     * @param i, j, k   control point index [0..dimx-1,0..dimy-1,0..dimz-1] in lattice
+     * @param pnt       new control point position
+     * @retval true if the move was applied,
+     * @retval false if the lattice is not allocated or the index is out of bounds
+     */
+    bool moveFFDControlPoint(ffd * lat, int i, int j, int k, cgp::Point pnt);
+
+    /**
+     * Test whether the vertices reflect incremental edits made through moveFFDControlPoint with a lattice
+     * @param lat   ffd lattice
+     * @retval true if the mesh is bound to the lattice,
+     * @retval false otherwise
+     */
+    bool boundToFFD(ffd * lat){ return ffdbind.isBound(lat); }
+
     /**
      * Read in triangle mesh from STL format binary file
      * @param filename  name of file to load (STL format)
@@ -352,6 +596,23 @@ public:
      */
     bool manifoldValidity();
 
+    /**
+     * Check that the mesh is a closed two-manifold, gathering every violation rather than stopping at the first.
+     * Runs in time linear in the mesh size, with vertices processed in parallel
+     * @param[out] report   non-manifold edges and vertices, misoriented edges, duplicate triangles and boundary loops
+     * @retval true if the mesh is two-manifold,
+     * @retval false otherwise
+     */
+    bool manifoldCheck(ManifoldReport & report);
+
+    /**
+     * Find all pairs of triangles that intersect but share no vertex, such as the folds produced by strong deformations.
+     * Candidate pairs come from a bounding volume hierarchy traversed in parallel and are confirmed with an exact
+     * triangle-triangle test. Triangles that share a vertex always touch and are not tested
+     * @param[out] pairs    intersecting triangle pairs, lower index first, in increasing order
+     */
+    void selfIntersections(std::vector<std::pair<int, int>> & pairs);
+
     /**
      * Build a simple valid 2-manifold tetrahedron with correct winding
      */
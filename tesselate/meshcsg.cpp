@@ -0,0 +1,519 @@
+//
+// MeshCSG
+//
+
+#include "meshcsg.h"
+#include "bvh.h"
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <array>
+#include <unordered_map>
+#include <iostream>
+
+using namespace std;
+
+/// Double precision 3D vector used for intersection and classification
+struct V3
+{
+    double x, y, z;
+};
+
+static inline V3 v3(const cgp::Point & p){ V3 r = {p.x, p.y, p.z}; return r; }
+static inline V3 vsub(const V3 & a, const V3 & b){ V3 r = {a.x - b.x, a.y - b.y, a.z - b.z}; return r; }
+static inline V3 vadd(const V3 & a, const V3 & b){ V3 r = {a.x + b.x, a.y + b.y, a.z + b.z}; return r; }
+static inline V3 vscale(const V3 & a, double s){ V3 r = {a.x * s, a.y * s, a.z * s}; return r; }
+static inline double vdot(const V3 & a, const V3 & b){ return a.x * b.x + a.y * b.y + a.z * b.z; }
+static inline V3 vcross(const V3 & a, const V3 & b)
+{
+    V3 r = {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+    return r;
+}
+static inline double vlen(const V3 & a){ return sqrt(vdot(a, a)); }
+static inline double vcomp(const V3 & a, int axis){ return (axis == 0) ? a.x : ((axis == 1) ? a.y : a.z); }
+
+/// Part of a triangle's plane bounded by a convex polygon, with vertices in the triangle's winding order
+typedef std::vector<V3> Polygon;
+
+/// Segment along which two triangles of opposite operands meet
+struct CutRecord
+{
+    int l, r;   ///< triangle indices in the left and right operands
+    V3 s0, s1;  ///< segment endpoints
+};
+
+/// Sum of the signed solid angles subtended by the triangles at a point, by the formula of van Oosterom and Strackee
+static double solidAngleSum(const PointArray & verts, const std::vector<Triangle> & tris, const V3 & p)
+{
+    double sum = 0.0;
+
+    for(const Triangle & t: tris)
+    {
+        V3 a = vsub(v3(verts[t.v[0]]), p), b = vsub(v3(verts[t.v[1]]), p), c = vsub(v3(verts[t.v[2]]), p);
+        double la = vlen(a), lb = vlen(b), lc = vlen(c);
+        double num = vdot(a, vcross(b, c));
+        double den = la * lb * lc + vdot(a, b) * lc + vdot(b, c) * la + vdot(c, a) * lb;
+        sum += 2.0 * atan2(num, den);
+    }
+    return sum;
+}
+
+double windingNumber(const PointArray & verts, const std::vector<Triangle> & tris, const cgp::Point & pnt)
+{
+    return solidAngleSum(verts, tris, v3(pnt)) / (4.0 * M_PI);
+}
+
+double enclosedVolume(const PointArray & verts, const std::vector<Triangle> & tris)
+{
+    double sum = 0.0;
+    int numtris = (int) tris.size();
+
+    // divergence theorem over tetrahedra formed with the origin
+#pragma omp parallel for reduction(+:sum)
+    for(int t = 0; t < numtris; t++)
+        sum += vdot(v3(verts[tris[t].v[0]]), vcross(v3(verts[tris[t].v[1]]), v3(verts[tris[t].v[2]])));
+    return sum / 6.0;
+}
+
+/**
+ * Points where a triangle meets the plane of another
+ * @param t         triangle vertices
+ * @param n         plane normal, not necessarily unit length
+ * @param o         point on the plane
+ * @param tol       distance from the plane, scaled by |n|, treated as lying on it
+ * @param[out] pts  vertices on the plane and crossings of edges that straddle it
+ * @returns         number of points found, or -1 if the whole triangle lies in the plane
+ */
+static int planeCrossings(const V3 t[3], const V3 & n, const V3 & o, double tol, V3 pts[3])
+{
+    double d[3];
+    int count = 0;
+
+    for(int i = 0; i < 3; i++)
+    {
+        d[i] = vdot(n, vsub(t[i], o));
+        if(fabs(d[i]) <= tol)
+            d[i] = 0.0;
+    }
+    if(d[0] == 0.0 && d[1] == 0.0 && d[2] == 0.0)
+        return -1;
+    for(int i = 0; i < 3 && count < 3; i++)
+    {
+        int j = (i + 1) % 3;
+        if(d[i] == 0.0)
+            pts[count++] = t[i];
+        if(count < 3 && ((d[i] > 0.0 && d[j] < 0.0) || (d[i] < 0.0 && d[j] > 0.0)))
+            pts[count++] = vadd(t[i], vscale(vsub(t[j], t[i]), d[i] / (d[i] - d[j])));
+    }
+    return count;
+}
+
+/**
+ * Segment shared by two triangles already known to meet
+ * @param p, q          triangle vertices
+ * @param[out] s0, s1   ends of the segment
+ * @retval true if the triangles cross along a segment of non-zero length,
+ * @retval false if they are coplanar or touch at a single point
+ */
+static bool intersectionSegment(const V3 p[3], const V3 q[3], V3 & s0, V3 & s1)
+{
+    V3 np = vcross(vsub(p[1], p[0]), vsub(p[2], p[0]));
+    V3 nq = vcross(vsub(q[1], q[0]), vsub(q[2], q[0]));
+    V3 pp[3], qp[3], dir;
+    double len = 0.0, lo, hi, tmin[2], tmax[2];
+    int np0, nq0, imin[2], imax[2];
+
+    for(int i = 0; i < 3; i++)
+        len = std::max(len, std::max(vlen(vsub(p[(i+1)%3], p[i])), vlen(vsub(q[(i+1)%3], q[i]))));
+
+    // each triangle covers an interval of the line where the two planes meet
+    np0 = planeCrossings(p, nq, q[0], 1.0e-12 * vlen(nq) * len, pp);
+    nq0 = planeCrossings(q, np, p[0], 1.0e-12 * vlen(np) * len, qp);
+    if(np0 <= 0 || nq0 <= 0)
+        return false;
+    dir = vcross(np, nq);
+    if(vlen(dir) <= 1.0e-12 * vlen(np) * vlen(nq))
+        return false;
+
+    const V3 * sets[2] = {pp, qp};
+    int counts[2] = {np0, nq0};
+    for(int s = 0; s < 2; s++)
+    {
+        imin[s] = imax[s] = 0;
+        tmin[s] = tmax[s] = vdot(dir, sets[s][0]);
+        for(int i = 1; i < counts[s]; i++)
+        {
+            double t = vdot(dir, sets[s][i]);
+            if(t < tmin[s]) { tmin[s] = t; imin[s] = i; }
+            if(t > tmax[s]) { tmax[s] = t; imax[s] = i; }
+        }
+    }
+
+    // overlap of the two intervals, taking the ends from whichever triangle bounds it
+    lo = std::max(tmin[0], tmin[1]);
+    hi = std::min(tmax[0], tmax[1]);
+    if(hi <= lo)
+        return false;
+    s0 = (tmin[0] >= tmin[1]) ? pp[imin[0]] : qp[imin[1]];
+    s1 = (tmax[0] <= tmax[1]) ? pp[imax[0]] : qp[imax[1]];
+    return vlen(vsub(s1, s0)) > 1.0e-9 * len;
+}
+
+/**
+ * Split a triangle into convex pieces along the full lines through a set of segments in its plane, so that no segment
+ * crosses the interior of any piece
+ * @param tri       triangle vertices
+ * @param segs      segments lying in the plane of the triangle
+ * @param[out] pieces   convex polygons covering the triangle, in its winding order
+ */
+static void splitTriangle(const V3 tri[3], const std::vector<std::pair<V3, V3>> & segs, std::vector<Polygon> & pieces)
+{
+    V3 n = vcross(vsub(tri[1], tri[0]), vsub(tri[2], tri[0]));
+    int i0, i1;
+    double len = 0.0;
+
+    // work in the coordinate plane onto which the triangle projects with greatest area
+    double ax = fabs(n.x), ay = fabs(n.y), az = fabs(n.z);
+    if(ax >= ay && ax >= az) { i0 = 1; i1 = 2; }
+    else if(ay >= az) { i0 = 0; i1 = 2; }
+    else { i0 = 0; i1 = 1; }
+    for(int i = 0; i < 3; i++)
+        len = std::max(len, vlen(vsub(tri[(i+1)%3], tri[i])));
+
+    pieces.assign(1, Polygon(tri, tri + 3));
+    for(const std::pair<V3, V3> & seg: segs)
+    {
+        double ax0 = vcomp(seg.first, i0), ay0 = vcomp(seg.first, i1);
+        double dx = vcomp(seg.second, i0) - ax0, dy = vcomp(seg.second, i1) - ay0;
+        double tol = 1.0e-10 * sqrt(dx * dx + dy * dy) * len;
+        std::vector<Polygon> next;
+
+        if(sqrt(dx * dx + dy * dy) <= 1.0e-9 * len)
+            continue;
+        for(const Polygon & poly: pieces)
+        {
+            int m = (int) poly.size(), pos = 0, neg = 0;
+            std::vector<double> side(m);
+            Polygon front, back;
+
+            for(int i = 0; i < m; i++)
+            {
+                side[i] = dx * (vcomp(poly[i], i1) - ay0) - dy * (vcomp(poly[i], i0) - ax0);
+                if(fabs(side[i]) <= tol)
+                    side[i] = 0.0;
+                if(side[i] > 0.0) pos++;
+                if(side[i] < 0.0) neg++;
+            }
+            if(pos == 0 || neg == 0)
+            {
+                next.push_back(poly);
+                continue;
+            }
+            for(int i = 0; i < m; i++)
+            {
+                int j = (i + 1) % m;
+                if(side[i] >= 0.0)
+                    front.push_back(poly[i]);
+                if(side[i] <= 0.0)
+                    back.push_back(poly[i]);
+                if((side[i] > 0.0 && side[j] < 0.0) || (side[i] < 0.0 && side[j] > 0.0))
+                {
+                    V3 x = vadd(poly[i], vscale(vsub(poly[j], poly[i]), side[i] / (side[i] - side[j])));
+                    front.push_back(x);
+                    back.push_back(x);
+                }
+            }
+            if(front.size() >= 3)
+                next.push_back(front);
+            if(back.size() >= 3)
+                next.push_back(back);
+        }
+        pieces.swap(next);
+    }
+}
+
+/// Find the representative of a set in a union-find forest, with path halving
+static int findSet(std::vector<int> & parent, int i)
+{
+    while(parent[i] != i)
+    {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+/// Hash of the exact bit pattern of a point, for merging vertices that coincide exactly
+struct PointKeyHash
+{
+    size_t operator()(const std::array<uint32_t, 3> & k) const
+    {
+        return ((size_t) k[0] * 73856093u) ^ ((size_t) k[1] * 19349663u) ^ ((size_t) k[2] * 83492791u);
+    }
+};
+
+bool MeshCSG::tessellate(BaseShape * shape, PointArray & verts, std::vector<Triangle> & tris)
+{
+    Mesh prim;
+
+    if(Sphere * sph = dynamic_cast<Sphere *>(shape))
+        prim.buildSphere(sph->c, sph->r, slices, std::max(2, slices / 2));
+    else if(Cylinder * cyl = dynamic_cast<Cylinder *>(shape))
+        prim.buildCylinder(cyl->s, cyl->e, cyl->r, slices);
+    else if(Mesh * mesh = dynamic_cast<Mesh *>(shape))
+    {
+        mesh->worldVerts(verts);
+        tris = mesh->getTris();
+        return true;
+    }
+    else
+    {
+        cerr << "Error MeshCSG::tessellate: unsupported shape type" << endl;
+        return false;
+    }
+    verts = prim.getVerts();
+    tris = prim.getTris();
+    return true;
+}
+
+void MeshCSG::apply(SetOp op, const PointArray & lverts, const std::vector<Triangle> & ltris,
+                    const PointArray & rverts, const std::vector<Triangle> & rtris,
+                    PointArray & verts, std::vector<Triangle> & tris)
+{
+    const PointArray * opverts[2] = {&lverts, &rverts};
+    const std::vector<Triangle> * optris[2] = {&ltris, &rtris};
+    std::vector<std::vector<std::pair<V3, V3>>> cuts[2];
+    std::vector<CutRecord> records;
+    std::vector<cgp::Point> outpnts;
+    std::vector<std::array<int, 3>> outtris;
+    TriangleBVH bvh;
+
+    cuts[0].resize(ltris.size());
+    cuts[1].resize(rtris.size());
+
+    // candidate pairs from the hierarchy over the right operand, confirmed and intersected in parallel
+    bvh.build(rverts, rtris);
+    int numl = (int) ltris.size();
+#pragma omp parallel
+    {
+        std::vector<int> hits;
+        std::vector<CutRecord> local;
+
+#pragma omp for schedule(dynamic, 64)
+        for(int l = 0; l < numl; l++)
+        {
+            cgp::BoundBox box;
+            V3 p[3];
+            for(int i = 0; i < 3; i++)
+            {
+                box.includePnt(lverts[ltris[l].v[i]]);
+                p[i] = v3(lverts[ltris[l].v[i]]);
+            }
+            hits.clear();
+            bvh.query(box, hits);
+            for(int r: hits)
+            {
+                cgp::Point q0 = rverts[rtris[r].v[0]], q1 = rverts[rtris[r].v[1]], q2 = rverts[rtris[r].v[2]];
+                CutRecord rec;
+                V3 q[3] = {v3(q0), v3(q1), v3(q2)};
+                if(!triTriIntersect(lverts[ltris[l].v[0]], lverts[ltris[l].v[1]], lverts[ltris[l].v[2]], q0, q1, q2))
+                    continue;
+                if(intersectionSegment(p, q, rec.s0, rec.s1))
+                {
+                    rec.l = l; rec.r = r;
+                    local.push_back(rec);
+                }
+            }
+        }
+#pragma omp critical
+        records.insert(records.end(), local.begin(), local.end());
+    }
+
+    // the same segment is applied to both triangles, so cut vertices coincide exactly across the operands
+    std::sort(records.begin(), records.end(), [](const CutRecord & a, const CutRecord & b){
+        return (a.l != b.l) ? a.l < b.l : a.r < b.r; });
+    for(const CutRecord & rec: records)
+    {
+        cuts[0][rec.l].push_back(std::make_pair(rec.s0, rec.s1));
+        cuts[1][rec.r].push_back(std::make_pair(rec.s0, rec.s1));
+    }
+
+    for(int s = 0; s < 2; s++)
+    {
+        const PointArray & sverts = * opverts[s];
+        const std::vector<Triangle> & stris = * optris[s];
+        const PointArray & overts = * opverts[1-s];
+        const std::vector<Triangle> & otris = * optris[1-s];
+        int numtris = (int) stris.size(), numverts = sverts.size();
+        std::vector<int> parent(numtris), rep, compinside;
+        std::vector<std::vector<Polygon>> pieces(numtris);
+        std::vector<V3> queries;
+        std::vector<int> queryof(numtris, -1), piecequery(numtris, -1);
+        std::unordered_map<int64_t, int> edgeowner;
+        bool flip = (s == 1 && op == SetOp::DIFFERENCE);
+
+        // connected patches of uncut triangles share a classification
+        for(int t = 0; t < numtris; t++)
+            parent[t] = t;
+        for(int t = 0; t < numtris; t++)
+        {
+            if(!cuts[s][t].empty())
+                continue;
+            for(int i = 0; i < 3; i++)
+            {
+                int a = std::min(stris[t].v[i], stris[t].v[(i+1)%3]), b = std::max(stris[t].v[i], stris[t].v[(i+1)%3]);
+                int64_t key = (int64_t) a * (int64_t) numverts + (int64_t) b;
+                auto it = edgeowner.find(key);
+                if(it == edgeowner.end())
+                    edgeowner[key] = t;
+                else
+                    parent[findSet(parent, t)] = findSet(parent, it->second);
+            }
+        }
+
+        // one query point per patch and per piece of a split triangle
+        for(int t = 0; t < numtris; t++)
+        {
+            V3 tri[3] = {v3(sverts[stris[t].v[0]]), v3(sverts[stris[t].v[1]]), v3(sverts[stris[t].v[2]])};
+            if(cuts[s][t].empty())
+            {
+                int root = findSet(parent, t);
+                if(queryof[root] < 0)
+                {
+                    queryof[root] = (int) queries.size();
+                    queries.push_back(vscale(vadd(vadd(tri[0], tri[1]), tri[2]), 1.0 / 3.0));
+                }
+                queryof[t] = queryof[root];
+            }
+            else
+            {
+                splitTriangle(tri, cuts[s][t], pieces[t]);
+                piecequery[t] = (int) queries.size();
+                for(const Polygon & poly: pieces[t])
+                {
+                    V3 c = {0.0, 0.0, 0.0};
+                    for(const V3 & v: poly)
+                        c = vadd(c, v);
+                    queries.push_back(vscale(c, 1.0 / (double) poly.size()));
+                }
+            }
+        }
+
+        std::vector<char> inside(queries.size());
+        int numqueries = (int) queries.size();
+#pragma omp parallel for schedule(dynamic, 4)
+        for(int i = 0; i < numqueries; i++)
+            inside[i] = (solidAngleSum(overts, otris, queries[i]) > 2.0 * M_PI); // winding number above one half
+
+        // keep the parts of this operand that bound the result, reversing the subtracted operand
+        auto keep = [op, s](bool in){
+            if(op == SetOp::UNION) return !in;
+            if(op == SetOp::INTERSECTION) return in;
+            return (s == 0) ? !in : in;
+        };
+        for(int t = 0; t < numtris; t++)
+        {
+            if(cuts[s][t].empty())
+            {
+                if(!keep(inside[queryof[t]]))
+                    continue;
+                int base = (int) outpnts.size();
+                for(int i = 0; i < 3; i++)
+                    outpnts.push_back(sverts[stris[t].v[i]]);
+                if(flip)
+                    outtris.push_back({base, base + 2, base + 1});
+                else
+                    outtris.push_back({base, base + 1, base + 2});
+                continue;
+            }
+            for(int k = 0; k < (int) pieces[t].size(); k++)
+            {
+                const Polygon & poly = pieces[t][k];
+                if(!keep(inside[piecequery[t] + k]))
+                    continue;
+                int base = (int) outpnts.size();
+                for(const V3 & v: poly)
+                    outpnts.push_back(cgp::Point((float) v.x, (float) v.y, (float) v.z));
+                for(int i = 1; i + 1 < (int) poly.size(); i++)
+                {
+                    if(flip)
+                        outtris.push_back({base, base + i + 1, base + i});
+                    else
+                        outtris.push_back({base, base + i, base + i + 1});
+                }
+            }
+        }
+    }
+
+    // merge exactly coincident vertices and drop triangles that collapse as a result
+    std::unordered_map<std::array<uint32_t, 3>, int, PointKeyHash> lookup;
+    std::vector<int> index(outpnts.size());
+    verts.clear();
+    tris.clear();
+    for(int i = 0; i < (int) outpnts.size(); i++)
+    {
+        std::array<uint32_t, 3> key;
+        float c[3] = {outpnts[i].x + 0.0f, outpnts[i].y + 0.0f, outpnts[i].z + 0.0f}; // folds -0 onto +0
+        for(int k = 0; k < 3; k++)
+            memcpy(&key[k], &c[k], sizeof(float));
+        auto it = lookup.find(key);
+        if(it == lookup.end())
+        {
+            index[i] = verts.size();
+            lookup[key] = index[i];
+            verts.push_back(outpnts[i]);
+        }
+        else
+            index[i] = it->second;
+    }
+    for(const std::array<int, 3> & ot: outtris)
+    {
+        Triangle t;
+        for(int i = 0; i < 3; i++)
+            t.v[i] = index[ot[i]];
+        if(t.v[0] != t.v[1] && t.v[1] != t.v[2] && t.v[2] != t.v[0])
+        {
+            t.n = cgp::Vector(0.0f, 0.0f, 0.0f);
+            tris.push_back(t);
+        }
+    }
+}
+
+bool MeshCSG::evaluate(SceneNode * root, PointArray & verts, std::vector<Triangle> & tris)
+{
+    if(ShapeNode * leaf = dynamic_cast<ShapeNode *>(root))
+        return tessellate(leaf->shape, verts, tris);
+
+    if(OpNode * opnode = dynamic_cast<OpNode *>(root))
+    {
+        PointArray lverts, rverts;
+        std::vector<Triangle> ltris, rtris;
+
+        if(!evaluate(opnode->left, lverts, ltris) || !evaluate(opnode->right, rverts, rtris))
+            return false;
+        apply(opnode->op, lverts, ltris, rverts, rtris, verts, tris);
+        return true;
+    }
+
+    if(NaryOpNode * narynode = dynamic_cast<NaryOpNode *>(root))
+    {
+        // fold the operands in order, as a chain of binary operations would
+        if(narynode->children.empty() || !evaluate(narynode->children[0], verts, tris))
+            return false;
+        for(int i = 1; i < (int) narynode->children.size(); i++)
+        {
+            PointArray lverts = verts, rverts;
+            std::vector<Triangle> ltris = tris, rtris;
+
+            if(!evaluate(narynode->children[i], rverts, rtris))
+                return false;
+            verts.clear();
+            tris.clear();
+            apply(narynode->op, lverts, ltris, rverts, rtris, verts, tris);
+        }
+        return true;
+    }
+    cerr << "Error MeshCSG::evaluate: csg tree is not properly formed" << endl;
+    return false;
+}
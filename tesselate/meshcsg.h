@@ -0,0 +1,86 @@
+#ifndef _MESHCSG
+#define _MESHCSG
+/**
+ * @file
+ *
+ * Evaluation of CSG trees by boolean operations on closed triangle meshes, as an alternative to voxelisation.
+ */
+
+#include <vector>
+#include "csg.h"
+#include "soa.h"
+
+/**
+ * Generalised winding number of a closed triangle mesh about a point, summing the signed solid angles of its triangles.
+ * Close to 1 inside and 0 outside, and unlike ray parity it degrades gracefully on small cracks and needs no choice of ray
+ * @param verts     vertex positions
+ * @param tris      triangles with counterclockwise winding seen from outside
+ * @param pnt       query point
+ * @returns         winding number, about 0.5 on the surface itself
+ */
+double windingNumber(const PointArray & verts, const std::vector<Triangle> & tris, const cgp::Point & pnt);
+
+/**
+ * Signed volume enclosed by a closed triangle mesh, positive for outward winding
+ * @param verts     vertex positions
+ * @param tris      triangles indexing into verts
+ * @returns         enclosed volume
+ */
+double enclosedVolume(const PointArray & verts, const std::vector<Triangle> & tris);
+
+/**
+ * Boolean set operations evaluated directly on closed triangle meshes. Sphere and cylinder leaves are tessellated first
+ * and mesh leaves are taken with their transformation applied. For each operation, triangle pairs that meet are found
+ * through a bounding volume hierarchy and intersected in parallel, the triangles crossed by the other surface are split
+ * along the lines of intersection into convex pieces, and every piece is classified as inside or outside the other
+ * operand by its winding number. Triangles away from the intersection are classified a connected patch at a time.
+ * Memory scales with the size of the surfaces rather than the volume they enclose.
+ *
+ * Split pieces meet their uncut neighbours at T-junctions, so results are geometrically closed but not always
+ * two-manifold, and faces of the two operands that overlap in a common plane are not merged.
+ */
+class MeshCSG
+{
+private:
+    int slices;     ///< subdivisions around the axis of tessellated spheres and cylinders
+
+    /**
+     * Tessellate a leaf shape in world coordinates
+     * @param shape         sphere, cylinder or mesh
+     * @param[out] verts    vertex positions
+     * @param[out] tris     triangles with outward winding
+     * @retval true if the shape is of a supported type,
+     * @retval false otherwise
+     */
+    bool tessellate(BaseShape * shape, PointArray & verts, std::vector<Triangle> & tris);
+
+public:
+
+    /**
+     * Constructor
+     * @param primslices    subdivisions around the axis used when tessellating spheres and cylinders
+     */
+    MeshCSG(int primslices = 48){ slices = primslices; }
+
+    /**
+     * Apply a boolean set operation to two closed meshes
+     * @param op        boolean set operation, applied as left op right
+     * @param lverts, ltris     left operand
+     * @param rverts, rtris     right operand
+     * @param[out] verts, tris  result, with coincident vertices merged and unused vertices removed
+     */
+    void apply(SetOp op, const PointArray & lverts, const std::vector<Triangle> & ltris,
+               const PointArray & rverts, const std::vector<Triangle> & rtris,
+               PointArray & verts, std::vector<Triangle> & tris);
+
+    /**
+     * Evaluate a CSG tree with a recursive depth-first walk
+     * @param root          root node of the CSG tree
+     * @param[out] verts, tris  boundary of the solid described by the tree
+     * @retval true if the tree is well formed with supported leaves,
+     * @retval false otherwise
+     */
+    bool evaluate(SceneNode * root, PointArray & verts, std::vector<Triangle> & tris);
+};
+
+#endif
@@ -0,0 +1,62 @@
+//
+// PipelineWorker
+//
+
+#include "pipelineworker.h"
+#include <iostream>
+
+using namespace std;
+
+PipelineWorker::PipelineWorker(Scene * target, ffd * lattice)
+{
+    scene = target;
+    def = lattice;
+    front = 0;
+    running = false;
+}
+
+bool PipelineWorker::start(PipelineStage stage, float voxlen)
+{
+    if(running)
+    {
+        cerr << "Error PipelineWorker::start: a stage is already running" << endl;
+        return false;
+    }
+    running = true;
+    progress.reset();
+    QMetaObject::invokeMethod(this, "runStage", Qt::QueuedConnection, Q_ARG(int, (int) stage), Q_ARG(float, voxlen));
+    return true;
+}
+
+void PipelineWorker::acceptResult()
+{
+    front = 1 - front;
+    running = false;
+}
+
+void PipelineWorker::runStage(int stage, float voxlen)
+{
+    bool completed = true;
+
+    scene->setProgress(&progress);
+    switch((PipelineStage) stage)
+    {
+        case PipelineStage::VOXELISE:
+            completed = scene->voxelise(voxlen);
+            break;
+        case PipelineStage::ISOEXTRACT:
+            completed = scene->isoextract();
+            break;
+        case PipelineStage::SMOOTH:
+            scene->smooth();
+            break;
+        case PipelineStage::DEFORM:
+            scene->deform(def);
+            break;
+    }
+    scene->setProgress(NULL);
+
+    // the front buffer may still be drawn, so the result goes into the back buffer
+    scene->genGeometry(&buffers[1 - front]);
+    emit stageFinished(stage, completed);
+}
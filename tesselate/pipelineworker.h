@@ -0,0 +1,105 @@
+#ifndef _PIPELINEWORKER
+#define _PIPELINEWORKER
+/**
+ * @file
+ *
+ * Runs the stages of the tesselation pipeline away from the thread that draws the scene.
+ */
+
+#include <QObject>
+#include "csg.h"
+#include "ffd.h"
+#include "progress.h"
+
+/**
+ * Stages of the pipeline that can be run in the background
+ */
+enum class PipelineStage
+{
+    VOXELISE,   ///< convert the csg tree into voxels
+    ISOEXTRACT, ///< extract the isosurface of the voxels
+    SMOOTH,     ///< smooth the isosurface
+    DEFORM      ///< deform the isosurface with the ffd lattice
+};
+
+/**
+ * Whether a stage checks for cancellation, in which case it leaves the scene as it was. Smoothing and deformation
+ * always run to completion
+ * @param stage     stage to check
+ * @retval true if the stage can be cancelled,
+ * @retval false otherwise
+ */
+inline bool stageCancellable(PipelineStage stage){ return stage == PipelineStage::VOXELISE || stage == PipelineStage::ISOEXTRACT; }
+
+/**
+ * Runs one pipeline stage at a time on the thread the worker has been moved to, so that the interface keeps drawing
+ * while it works. Once a stage finishes the worker packs geometry for the new representation into the back of two
+ * buffers, and the drawing thread swaps it to the front with acceptResult and binds it, so only the drawing thread
+ * touches OpenGL. While a stage runs the scene and lattice belong to the worker, and the drawing thread must not
+ * change them or read the scene.
+ */
+class PipelineWorker : public QObject
+{
+    Q_OBJECT
+
+private:
+    Scene * scene;              ///< scene the stages are applied to
+    ffd * def;                  ///< lattice used by the deformation stage
+    StageProgress progress;     ///< progress of the running stage, read and cancelled from the drawing thread
+    ShapeGeometry buffers[2];   ///< geometry of the scene after the last two stages
+    int front;                  ///< buffer holding the geometry handed to the drawing thread
+    bool running;               ///< whether a stage has started and its result not yet been accepted, only used by the drawing thread
+
+public:
+
+    /**
+     * Constructor
+     * @param target    scene the stages are applied to
+     * @param lattice   lattice used by the deformation stage
+     */
+    PipelineWorker(Scene * target, ffd * lattice);
+
+    /**
+     * Start a stage on the worker's thread, which emits stageFinished when it is done. Called from the drawing thread
+     * @param stage     stage to run
+     * @param voxlen    side length of an individual voxel, used by the voxelisation stage
+     * @retval @c true  if the stage was started,
+     * @retval @c false if another stage is still running
+     */
+    bool start(PipelineStage stage, float voxlen);
+
+    /// Whether a stage is running or its result awaits acceptResult
+    bool busy() const { return running; }
+
+    /// Ask the running stage to stop early, which only stages for which stageCancellable holds do
+    void cancel(){ progress.cancel(); }
+
+    /// Progress of the running stage
+    const StageProgress & getProgress() const { return progress; }
+
+    /// Swap the geometry packed by the finished stage to the front, ready to start another stage
+    void acceptResult();
+
+    /// Geometry of the scene after the last accepted stage, to be bound by the drawing thread
+    ShapeGeometry * frontGeometry(){ return &buffers[front]; }
+
+signals:
+
+    /**
+     * Signal that a stage has finished and its geometry is packed
+     * @param stage     the PipelineStage that ran
+     * @param completed false if it was cancelled, in which case the scene keeps its previous representation
+     */
+    void stageFinished(int stage, bool completed);
+
+private slots:
+
+    /**
+     * Run a stage and pack the geometry of its result, on the worker's thread
+     * @param stage     the PipelineStage to run
+     * @param voxlen    side length of an individual voxel, used by the voxelisation stage
+     */
+    void runStage(int stage, float voxlen);
+};
+
+#endif
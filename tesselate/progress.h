@@ -0,0 +1,62 @@
+#ifndef _PROGRESS
+#define _PROGRESS
+/**
+ * @file
+ *
+ * Progress and cancellation of long running pipeline stages, shared between the thread running a stage and those
+ * watching it.
+ */
+
+#include <atomic>
+#include <algorithm>
+
+/**
+ * Count of the work done by a pipeline stage, and a request to stop it early. A stage calls start with the amount of
+ * work it expects and step as parts of it finish, and checks cancelled wherever it can stop cleanly. Any thread may
+ * read the progress or ask for cancellation while the stage runs.
+ */
+class StageProgress
+{
+private:
+    std::atomic<long> total;    ///< units of work expected in the current stage
+    std::atomic<long> done;     ///< units of work finished so far
+    std::atomic<bool> stop;     ///< whether the stage has been asked to stop
+
+public:
+
+    /// Default constructor
+    StageProgress(){ reset(); }
+
+    /// Clear the progress and any request to stop, ready for a new stage
+    void reset(){ total = 0; done = 0; stop = false; }
+
+    /**
+     * Begin counting the work of a stage. A request to stop made before the stage starts still applies
+     * @param work  units of work expected, which need only be an estimate
+     */
+    void start(long work){ done = 0; total = work; }
+
+    /**
+     * Record finished work
+     * @param work  units of work finished
+     */
+    void step(long work = 1){ done += work; }
+
+    /// Record that all of the expected work is finished
+    void finish(){ done = total.load(); }
+
+    /// Ask the stage to stop at its next opportunity
+    void cancel(){ stop = true; }
+
+    /// Whether the stage has been asked to stop
+    bool cancelled() const { return stop.load(); }
+
+    /// Proportion of the expected work that is finished, in [0, 1]
+    float fraction() const
+    {
+        long t = total.load();
+        return (t > 0) ? std::min(1.0f, (float) done.load() / (float) t) : 0.0f;
+    }
+};
+
+#endif
@@ -0,0 +1,372 @@
+//
+// ResultCache
+//
+
+#include "resultcache.h"
+#include "csg.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <ctime>
+#include <stdexcept>
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <boost/archive/binary_iarchive.hpp>
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+/// Version of the entry format, stored in every entry so that entries in an older format are treated as misses
+static const int cacheVersion = 1;
+
+static const std::uint64_t fnvOffset = 14695981039346656037ULL;
+static const std::uint64_t fnvPrime = 1099511628211ULL;
+
+/// Fold bytes into a 64-bit FNV-1a hash
+static void fnvBytes(std::uint64_t & hash, const void * data, size_t len)
+{
+    const unsigned char * bytes = (const unsigned char *) data;
+
+    for(size_t b = 0; b < len; b++)
+    {
+        hash ^= (std::uint64_t) bytes[b];
+        hash *= fnvPrime;
+    }
+}
+
+/// Fold a value into a 64-bit FNV-1a hash by its bytes
+template<typename T> static void fnvValue(std::uint64_t & hash, T val)
+{
+    fnvBytes(hash, &val, sizeof(T));
+}
+
+/// Fold a point into a 64-bit FNV-1a hash
+static void fnvPoint(std::uint64_t & hash, const cgp::Point & pnt)
+{
+    fnvValue(hash, pnt.x);
+    fnvValue(hash, pnt.y);
+    fnvValue(hash, pnt.z);
+}
+
+ResultCache::ResultCache()
+{
+    cap = 0;
+    hits = misses = 0;
+}
+
+bool ResultCache::open(const std::string & directory, std::uintmax_t capbytes)
+{
+    boost::system::error_code err;
+
+    dir.clear();
+    fs::create_directories(fs::path(directory), err);
+    if(err || !fs::is_directory(fs::path(directory)))
+    {
+        cerr << "Error ResultCache::open: unable to use " << directory << " as a cache directory" << endl;
+        return false;
+    }
+    dir = directory;
+    cap = capbytes;
+    evict();
+    return true;
+}
+
+std::uint64_t ResultCache::hashNode(SceneNode * node, std::map<SceneNode *, std::uint64_t> & memo)
+{
+    std::uint64_t hash = fnvOffset;
+
+    if(node == NULL)
+        return hash;
+    auto it = memo.find(node);
+    if(it != memo.end())
+        return it->second;
+
+    if(ShapeNode * leaf = dynamic_cast<ShapeNode *>(node))
+    {
+        if(Sphere * sph = dynamic_cast<Sphere *>(leaf->shape))
+        {
+            fnvValue(hash, 's');
+            fnvPoint(hash, sph->c);
+            fnvValue(hash, sph->r);
+        }
+        else if(Cylinder * cyl = dynamic_cast<Cylinder *>(leaf->shape))
+        {
+            fnvValue(hash, 'c');
+            fnvPoint(hash, cyl->s);
+            fnvPoint(hash, cyl->e);
+            fnvValue(hash, cyl->r);
+        }
+        else if(Mesh * mesh = dynamic_cast<Mesh *>(leaf->shape))
+        {
+            // a mesh is identified by its content and placement rather than the file it came from
+            const PointArray & verts = mesh->getVerts();
+            const std::vector<Triangle> & tris = mesh->getTris();
+            cgp::Vector trs = mesh->getTranslation();
+            float ax, ay, az;
+            mesh->getRotations(ax, ay, az);
+            fnvValue(hash, 'm');
+            fnvValue(hash, mesh->getScale());
+            fnvValue(hash, ax);
+            fnvValue(hash, ay);
+            fnvValue(hash, az);
+            fnvValue(hash, trs.i);
+            fnvValue(hash, trs.j);
+            fnvValue(hash, trs.k);
+            fnvValue(hash, (int) verts.size());
+            for(int v = 0; v < (int) verts.size(); v++)
+                fnvPoint(hash, verts[v]);
+            fnvValue(hash, (int) tris.size());
+            for(const Triangle & t: tris)
+                fnvBytes(hash, t.v, sizeof(t.v));
+        }
+        else
+        {
+            // unknown shapes are keyed by identity, so they are never matched in another run
+            fnvValue(hash, 'u');
+            fnvValue(hash, leaf->shape);
+        }
+    }
+    else if(OpNode * op = dynamic_cast<OpNode *>(node))
+    {
+        fnvValue(hash, 'o');
+        fnvValue(hash, (int) op->op);
+        fnvValue(hash, hashNode(op->left, memo));
+        fnvValue(hash, hashNode(op->right, memo));
+    }
+    else if(NaryOpNode * nop = dynamic_cast<NaryOpNode *>(node))
+    {
+        fnvValue(hash, 'n');
+        fnvValue(hash, (int) nop->op);
+        fnvValue(hash, (int) nop->children.size());
+        for(SceneNode * child: nop->children)
+            fnvValue(hash, hashNode(child, memo));
+    }
+    memo[node] = hash;
+    return hash;
+}
+
+std::uint64_t ResultCache::sceneKey(SceneNode * root, float voxlen)
+{
+    std::map<SceneNode *, std::uint64_t> memo;
+    std::uint64_t key = fnvOffset;
+
+    fnvValue(key, cacheVersion);
+    fnvValue(key, hashNode(root, memo));
+    fnvValue(key, voxlen);
+    return key;
+}
+
+std::string ResultCache::entryPath(std::uint64_t key, const std::string & kind) const
+{
+    std::ostringstream name;
+
+    name << hex << setw(16) << setfill('0') << key << "." << kind;
+    return (fs::path(dir) / name.str()).string();
+}
+
+void ResultCache::touch(const std::string & path)
+{
+    boost::system::error_code err;
+
+    fs::last_write_time(fs::path(path), std::time(NULL), err);
+}
+
+void ResultCache::evict()
+{
+    struct Entry
+    {
+        std::time_t when;
+        std::string path;
+        std::uintmax_t size;
+    };
+    std::vector<Entry> entries;
+    std::uintmax_t total = 0;
+    boost::system::error_code err;
+
+    for(fs::directory_iterator it(fs::path(dir), err), end; !err && it != end; it.increment(err))
+    {
+        std::string ext = it->path().extension().string();
+        if(ext != ".vox" && ext != ".iso")
+            continue;
+        Entry entry = {fs::last_write_time(it->path(), err), it->path().string(), fs::file_size(it->path(), err)};
+        if(err)
+            continue;
+        entries.push_back(entry);
+        total += entry.size;
+    }
+
+    // oldest first, with ties broken by name so that every job evicts in the same order
+    std::sort(entries.begin(), entries.end(), [](const Entry & a, const Entry & b)
+        { return a.when < b.when || (a.when == b.when && a.path < b.path); });
+    for(const Entry & entry: entries)
+    {
+        if(total <= cap)
+            break;
+        fs::remove(fs::path(entry.path), err);
+        total -= entry.size;
+    }
+}
+
+/**
+ * Read an entry, checking its header
+ * @param path      entry file
+ * @param key       content key the entry must carry
+ * @param[out] obj  object to read
+ * @param read      function that reads the object from the archive
+ * @retval @c true  if the entry exists and was read,
+ * @retval @c false otherwise
+ */
+template<typename T, typename Read> static bool readEntry(const std::string & path, std::uint64_t key, T & obj, Read read)
+{
+    ifstream infile(path.c_str(), ios_base::in | ios_base::binary);
+    int version;
+    std::uint64_t stored;
+
+    if(!infile.is_open())
+        return false;
+    try
+    {
+        boost::archive::binary_iarchive ar(infile);
+        ar & version & stored;
+        if(version != cacheVersion || stored != key)
+            return false;
+        read(ar, obj);
+    }
+    catch(std::exception & e)
+    {
+        cerr << "Error ResultCache: discarding unreadable entry " << path << ": " << e.what() << endl;
+        boost::system::error_code err;
+        fs::remove(fs::path(path), err);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Write an entry under a temporary name and move it into place
+ * @param path  entry file
+ * @param key   content key of the entry
+ * @param obj   object to write
+ * @param write function that writes the object to the archive
+ */
+template<typename T, typename Write> static void writeEntry(const std::string & path, std::uint64_t key, T & obj, Write write)
+{
+    boost::system::error_code err;
+    fs::path tmp = fs::unique_path(fs::path(path).parent_path() / "%%%%-%%%%-%%%%-%%%%.tmp", err);
+    int version = cacheVersion;
+
+    if(err)
+        return;
+    {
+        ofstream outfile(tmp.string().c_str(), ios_base::out | ios_base::binary);
+        if(!outfile.is_open())
+        {
+            cerr << "Error ResultCache: unable to write " << tmp.string() << endl;
+            return;
+        }
+        boost::archive::binary_oarchive ar(outfile);
+        ar & version & key;
+        write(ar, obj);
+    }
+    fs::rename(tmp, fs::path(path), err);
+    if(err)
+        fs::remove(tmp, err);
+}
+
+bool ResultCache::loadVoxels(std::uint64_t key, VoxelVolume & voxels)
+{
+    VoxelVolume read;
+
+    if(!enabled())
+        return false;
+    std::string path = entryPath(key, "vox");
+    if(!readEntry(path, key, read, [](boost::archive::binary_iarchive & ar, VoxelVolume & v){ ar & v; }))
+    {
+        misses++;
+        return false;
+    }
+    voxels = read;
+    touch(path);
+    hits++;
+    return true;
+}
+
+void ResultCache::storeVoxels(std::uint64_t key, const VoxelVolume & voxels)
+{
+    if(!enabled())
+        return;
+    writeEntry(entryPath(key, "vox"), key, voxels, [](boost::archive::binary_oarchive & ar, const VoxelVolume & v){ ar & v; });
+    evict();
+}
+
+bool ResultCache::loadMesh(std::uint64_t key, Mesh & mesh)
+{
+    PointArray verts;
+    std::vector<Triangle> tris;
+
+    if(!enabled())
+        return false;
+    std::string path = entryPath(key, "iso");
+    bool found = readEntry(path, key, verts, [&tris](boost::archive::binary_iarchive & ar, PointArray & pnts)
+    {
+        int numv, numt;
+        cgp::Point pnt;
+        Triangle t;
+
+        ar & numv;
+        for(int v = 0; v < numv; v++)
+        {
+            ar & pnt;
+            pnts.push_back(pnt);
+        }
+        ar & numt;
+        tris.reserve(numt);
+        for(int i = 0; i < numt; i++)
+        {
+            ar & t.v[0] & t.v[1] & t.v[2];
+            for(int p = 0; p < 3; p++)
+                if(t.v[p] < 0 || t.v[p] >= numv)
+                    throw std::runtime_error("triangle index out of range");
+            tris.push_back(t);
+        }
+    });
+    if(!found)
+    {
+        misses++;
+        return false;
+    }
+    mesh.setGeometry(verts, tris); // normals are derived again in the same way as on extraction
+    touch(path);
+    hits++;
+    return true;
+}
+
+void ResultCache::storeMesh(std::uint64_t key, Mesh & mesh)
+{
+    if(!enabled())
+        return;
+    writeEntry(entryPath(key, "iso"), key, mesh, [](boost::archive::binary_oarchive & ar, Mesh & m)
+    {
+        const PointArray & verts = m.getVerts();
+        const std::vector<Triangle> & tris = m.getTris();
+        int numv = (int) verts.size(), numt = (int) tris.size();
+
+        ar & numv;
+        for(int v = 0; v < numv; v++)
+        {
+            cgp::Point pnt = verts[v];
+            ar & pnt;
+        }
+        ar & numt;
+        for(const Triangle & t: tris)
+        {
+            int a = t.v[0], b = t.v[1], c = t.v[2];
+            ar & a & b & c;
+        }
+    });
+    evict();
+}
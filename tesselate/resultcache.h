@@ -0,0 +1,118 @@
+#ifndef _RESULTCACHE
+#define _RESULTCACHE
+/**
+ * @file
+ *
+ * On-disk cache of pipeline results, keyed by the content of the scene that produced them.
+ */
+
+#include <string>
+#include <cstdint>
+#include <map>
+
+class SceneNode;
+class VoxelVolume;
+class Mesh;
+
+/**
+ * Content-addressed store of voxel volumes and extracted isosurfaces, kept as files in a directory so that they are
+ * shared between runs. Entries are keyed by a hash of everything that determines a result, so an identical scene gives
+ * the same key in every run and an edited one gives a new key; stale entries are never looked up again and age out.
+ * The directory is held to a size cap by evicting the least recently used entries, with recency given by file
+ * modification times, which are refreshed on every hit. Entries are written under a temporary name and renamed into
+ * place, so that jobs sharing a directory never read a partly written entry.
+ */
+class ResultCache
+{
+private:
+    std::string dir;        ///< directory holding the entries, empty while the cache is disabled
+    std::uintmax_t cap;     ///< total size of the entries in bytes above which the oldest are evicted
+    int hits, misses;       ///< lookups that found or failed to find an entry
+
+    /**
+     * Hash of a subtree, combining the hashes of its children with its own operation or shape parameters
+     * @param node          subtree root
+     * @param[in,out] memo  hash of each subtree visited so far, so that shared subtrees are visited once
+     * @returns             64-bit FNV-1a hash
+     */
+    std::uint64_t hashNode(SceneNode * node, std::map<SceneNode *, std::uint64_t> & memo);
+
+    /**
+     * File holding an entry
+     * @param key   content key
+     * @param kind  file extension distinguishing results of different stages
+     */
+    std::string entryPath(std::uint64_t key, const std::string & kind) const;
+
+    /// Refresh the recency of an entry on a hit
+    void touch(const std::string & path);
+
+    /// Delete the least recently used entries until the directory fits within the size cap
+    void evict();
+
+public:
+
+    /// Default constructor, with the cache disabled
+    ResultCache();
+
+    /**
+     * Enable the cache, creating its directory if need be
+     * @param directory directory holding the entries
+     * @param capbytes  total size of the entries in bytes above which the least recently used are evicted
+     * @retval @c true  if the directory is usable,
+     * @retval @c false otherwise, in which case the cache stays disabled
+     */
+    bool open(const std::string & directory, std::uintmax_t capbytes);
+
+    /// Whether lookups and stores go to disk
+    bool enabled() const { return !dir.empty(); }
+
+    /**
+     * Key for the results of voxelising a CSG tree, covering its structure, the parameters of its shapes, the content
+     * and placement of its meshes and the voxel size. Stable across runs on the same platform
+     * @param root      root of the tree, may be NULL or share subtrees
+     * @param voxlen    side length of an individual voxel
+     * @returns         content key
+     */
+    std::uint64_t sceneKey(SceneNode * root, float voxlen);
+
+    /**
+     * Look up a voxel volume
+     * @param key           content key
+     * @param[out] voxels   volume read from the cache, unchanged on a miss
+     * @retval @c true  if an entry was found and read,
+     * @retval @c false otherwise
+     */
+    bool loadVoxels(std::uint64_t key, VoxelVolume & voxels);
+
+    /**
+     * Store a voxel volume, evicting old entries if the cap is exceeded
+     * @param key       content key
+     * @param voxels    volume to store
+     */
+    void storeVoxels(std::uint64_t key, const VoxelVolume & voxels);
+
+    /**
+     * Look up an isosurface
+     * @param key           content key of the scene it was extracted from
+     * @param[out] mesh     mesh read from the cache, unchanged on a miss
+     * @retval @c true  if an entry was found and read,
+     * @retval @c false otherwise
+     */
+    bool loadMesh(std::uint64_t key, Mesh & mesh);
+
+    /**
+     * Store an isosurface, evicting old entries if the cap is exceeded
+     * @param key   content key of the scene it was extracted from
+     * @param mesh  mesh to store
+     */
+    void storeMesh(std::uint64_t key, Mesh & mesh);
+
+    /// Number of lookups that found an entry
+    int numHits() const { return hits; }
+
+    /// Number of lookups that found no entry
+    int numMisses() const { return misses; }
+};
+
+#endif
@@ -0,0 +1,348 @@
+//
+// SceneParser
+//
+
+#include "sceneparser.h"
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <set>
+#include <iostream>
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace std;
+
+/// Optional placement of a scene node, composed as in Mesh::buildTransform
+struct Placement
+{
+    cgp::Vector trs;            ///< translation
+    float ax, ay, az;           ///< rotation angles about the x, y and z axes
+    float scf;                  ///< uniform scale factor
+    float fit;                  ///< side length to fit a mesh bounding box to, if positive
+
+    Placement(){ trs = cgp::Vector(0.0f, 0.0f, 0.0f); ax = ay = az = 0.0f; scf = 1.0f; fit = 0.0f; }
+
+    /// Composite transformation matrix
+    glm::mat4x4 matrix() const
+    {
+        glm::mat4x4 tfm = glm::translate(glm::mat4(1.0f), glm::vec3(trs.i, trs.j, trs.k));
+        tfm = glm::rotate(tfm, az, glm::vec3(0.0f, 0.0f, 1.0f));
+        tfm = glm::rotate(tfm, ay, glm::vec3(0.0f, 1.0f, 0.0f));
+        tfm = glm::rotate(tfm, ax, glm::vec3(1.0f, 0.0f, 0.0f));
+        return glm::scale(tfm, glm::vec3(scf));
+    }
+
+    /// Apply the transformation to a point
+    cgp::Point apply(const cgp::Point & pnt) const
+    {
+        glm::vec4 p = matrix() * glm::vec4(pnt.x, pnt.y, pnt.z, 1.0f);
+        return cgp::Point(p.x, p.y, p.z);
+    }
+};
+
+/**
+ * Split a line into whitespace separated tokens, keeping double quoted strings whole and dropping comments
+ * @param line          line of a scene description
+ * @param[out] tokens   tokens in order, with quotes removed
+ * @retval true if every quoted string is closed,
+ * @retval false otherwise
+ */
+static bool tokenise(const string & line, vector<string> & tokens)
+{
+    size_t i = 0, n = line.size();
+
+    tokens.clear();
+    while(i < n)
+    {
+        if(isspace((unsigned char) line[i]))
+            i++;
+        else if(line[i] == '#')
+            break;
+        else if(line[i] == '"')
+        {
+            size_t close = line.find('"', i + 1);
+            if(close == string::npos)
+                return false;
+            tokens.push_back(line.substr(i + 1, close - i - 1));
+            i = close + 1;
+        }
+        else
+        {
+            size_t start = i;
+            while(i < n && !isspace((unsigned char) line[i]) && line[i] != '#')
+                i++;
+            tokens.push_back(line.substr(start, i - start));
+        }
+    }
+    return true;
+}
+
+/**
+ * Convert consecutive tokens to floats
+ * @param tokens    tokens of a line
+ * @param first     index of the first token to convert
+ * @param count     number of values
+ * @param[out] vals converted values
+ * @retval true if the tokens exist and are all numbers,
+ * @retval false otherwise
+ */
+static bool toFloats(const vector<string> & tokens, int first, int count, float * vals)
+{
+    if(first + count > (int) tokens.size())
+        return false;
+    for(int i = 0; i < count; i++)
+    {
+        const char * str = tokens[first + i].c_str();
+        char * end;
+        vals[i] = strtof(str, &end);
+        if(end == str || * end != '\0')
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Read the optional placement clauses that end a shape definition
+ * @param tokens        tokens of a line
+ * @param first         index of the first clause
+ * @param allowfit      whether a fit clause is permitted
+ * @param[out] place    placement with the clauses applied
+ * @param[out] err      description of the problem on failure
+ * @retval true if all remaining tokens form valid clauses,
+ * @retval false otherwise
+ */
+static bool parsePlacement(const vector<string> & tokens, int first, bool allowfit, Placement & place, string & err)
+{
+    float v[3];
+    int i = first;
+
+    while(i < (int) tokens.size())
+    {
+        const string & key = tokens[i];
+        if(key == "translate" && toFloats(tokens, i + 1, 3, v))
+        {
+            place.trs = cgp::Vector(v[0], v[1], v[2]);
+            i += 4;
+        }
+        else if(key == "rotate" && toFloats(tokens, i + 1, 3, v))
+        {
+            place.ax = v[0]; place.ay = v[1]; place.az = v[2];
+            i += 4;
+        }
+        else if(key == "scale" && toFloats(tokens, i + 1, 1, v) && v[0] > 0.0f)
+        {
+            place.scf = v[0];
+            i += 2;
+        }
+        else if(allowfit && key == "fit" && toFloats(tokens, i + 1, 1, v) && v[0] > 0.0f)
+        {
+            place.fit = v[0];
+            i += 2;
+        }
+        else
+        {
+            err = "bad transform clause at '" + key + "'";
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Free a set of nodes one by one, which frees nothing twice since operation nodes do not own their children
+ * @param nodes     nodes to free, each listed once
+ */
+static void deleteNodes(const vector<SceneNode *> & nodes)
+{
+    for(SceneNode * node: nodes)
+        delete node;
+}
+
+Mesh * SceneParser::loadMesh(const std::string & path)
+{
+    Mesh * mesh = new Mesh();
+    auto it = meshcache.find(path);
+
+    if(it != meshcache.end())
+    {
+        mesh->setGeometry(it->second.verts, it->second.tris);
+        return mesh;
+    }
+    if(!mesh->readSTL(path))
+    {
+        delete mesh;
+        return NULL;
+    }
+    MeshGeometry & geom = meshcache[path];
+    geom.verts = mesh->getVerts();
+    geom.tris = mesh->getTris();
+    return mesh;
+}
+
+bool SceneParser::parse(std::istream & in, const std::string & basedir, SceneNode * & root)
+{
+    std::map<string, SceneNode *> named;
+    std::map<string, SceneNode *> placed; // mesh leaf for each file and placement seen in this description
+    vector<SceneNode *> created;
+    SceneNode * last = NULL, * chosen = NULL;
+    vector<string> tokens;
+    string line, err;
+    int lineno = 0;
+
+    root = NULL;
+    while(getline(in, line))
+    {
+        float v[7];
+        Placement place;
+
+        lineno++;
+        if(!tokenise(line, tokens))
+            err = "unterminated string";
+        else if(tokens.empty())
+            continue;
+        else if(tokens.size() < 2)
+            err = "missing node name";
+        else if(tokens[0] == "root")
+        {
+            auto it = named.find(tokens[1]);
+            if(tokens.size() != 2)
+                err = "root takes a single node name";
+            else if(it == named.end())
+                err = "undefined node " + tokens[1];
+            else
+                chosen = it->second;
+        }
+        else if(named.count(tokens[1]))
+            err = "redefinition of " + tokens[1];
+        else if(tokens[0] == "sphere")
+        {
+            if(!toFloats(tokens, 2, 4, v) || v[3] <= 0.0f)
+                err = "sphere needs a center and positive radius";
+            else if(parsePlacement(tokens, 6, false, place, err))
+            {
+                ShapeNode * leaf = new ShapeNode();
+                leaf->shape = new Sphere(place.apply(cgp::Point(v[0], v[1], v[2])), v[3] * place.scf);
+                created.push_back(leaf);
+                named[tokens[1]] = last = leaf;
+            }
+        }
+        else if(tokens[0] == "cylinder")
+        {
+            if(!toFloats(tokens, 2, 7, v) || v[6] <= 0.0f)
+                err = "cylinder needs start and end points and a positive radius";
+            else if(parsePlacement(tokens, 9, false, place, err))
+            {
+                ShapeNode * leaf = new ShapeNode();
+                leaf->shape = new Cylinder(place.apply(cgp::Point(v[0], v[1], v[2])), place.apply(cgp::Point(v[3], v[4], v[5])), v[6] * place.scf);
+                created.push_back(leaf);
+                named[tokens[1]] = last = leaf;
+            }
+        }
+        else if(tokens[0] == "mesh")
+        {
+            if(tokens.size() < 3)
+                err = "mesh needs a file name";
+            else if(parsePlacement(tokens, 3, true, place, err))
+            {
+                string path = tokens[2];
+                if(!basedir.empty() && path[0] != '/')
+                    path = basedir + "/" + path;
+                std::ostringstream placement;
+                placement.precision(9);
+                placement << path << '|' << place.fit << ' ' << place.trs.i << ' ' << place.trs.j << ' ' << place.trs.k
+                          << ' ' << place.ax << ' ' << place.ay << ' ' << place.az << ' ' << place.scf;
+                auto found = placed.find(placement.str());
+                Mesh * mesh = (found == placed.end()) ? loadMesh(path) : NULL;
+                if(found != placed.end()) // the same file placed in the same way is one shared leaf
+                    named[tokens[1]] = last = found->second;
+                else if(mesh == NULL)
+                    err = "unable to read mesh " + path;
+                else
+                {
+                    if(place.fit > 0.0f)
+                        mesh->boxFit(place.fit);
+                    mesh->setTranslation(place.trs);
+                    mesh->setRotations(place.ax, place.ay, place.az);
+                    mesh->setScale(place.scf);
+                    ShapeNode * leaf = new ShapeNode();
+                    leaf->shape = mesh;
+                    created.push_back(leaf);
+                    placed[placement.str()] = leaf;
+                    named[tokens[1]] = last = leaf;
+                }
+            }
+        }
+        else if(tokens[0] == "union" || tokens[0] == "intersection" || tokens[0] == "difference")
+        {
+            if(tokens.size() != 4)
+                err = tokens[0] + " needs a name and two operands";
+            else if(!named.count(tokens[2]) || !named.count(tokens[3]))
+                err = "undefined node " + (named.count(tokens[2]) ? tokens[3] : tokens[2]);
+            else
+            {
+                OpNode * op = new OpNode();
+                if(tokens[0] == "union")
+                    op->op = SetOp::UNION;
+                else if(tokens[0] == "intersection")
+                    op->op = SetOp::INTERSECTION;
+                else
+                    op->op = SetOp::DIFFERENCE;
+                op->left = named[tokens[2]];
+                op->right = named[tokens[3]];
+                created.push_back(op);
+                named[tokens[1]] = last = op;
+            }
+        }
+        else
+            err = "unknown statement " + tokens[0];
+
+        if(!err.empty())
+        {
+            cerr << "Error SceneParser::parse: line " << lineno << ": " << err << endl;
+            deleteNodes(created);
+            return false;
+        }
+    }
+
+    root = (chosen != NULL) ? chosen : last;
+    if(root == NULL)
+    {
+        cerr << "Error SceneParser::parse: scene defines no nodes" << endl;
+        return false;
+    }
+
+    // free definitions that the root does not use
+    std::set<SceneNode *> reachable;
+    vector<SceneNode *> pending(1, root), unused;
+    while(!pending.empty())
+    {
+        SceneNode * node = pending.back();
+        pending.pop_back();
+        if(!reachable.insert(node).second)
+            continue;
+        if(OpNode * op = dynamic_cast<OpNode *>(node))
+        {
+            pending.push_back(op->left);
+            pending.push_back(op->right);
+        }
+    }
+    for(SceneNode * node: created)
+        if(!reachable.count(node))
+            unused.push_back(node);
+    deleteNodes(unused);
+    return true;
+}
+
+bool SceneParser::parseFile(const std::string & filename, SceneNode * & root)
+{
+    ifstream infile(filename.c_str());
+    size_t slash = filename.find_last_of('/');
+
+    root = NULL;
+    if(!infile.is_open())
+    {
+        cerr << "Error SceneParser::parseFile: unable to open " << filename << endl;
+        return false;
+    }
+    return parse(infile, (slash == string::npos) ? string() : filename.substr(0, slash), root);
+}
@@ -0,0 +1,82 @@
+#ifndef _SCENEPARSER
+#define _SCENEPARSER
+/**
+ * @file
+ *
+ * Reader for text descriptions of CSG scenes.
+ */
+
+#include <string>
+#include <vector>
+#include <map>
+#include <istream>
+#include "csg.h"
+
+/**
+ * Builds CSG trees from a line based text format, so that scenes can be changed without recompiling. Each line defines
+ * one named node, and later lines refer to earlier nodes by name, so a node used more than once is shared rather than
+ * copied and the result is a directed acyclic graph. Blank lines and anything after a # are ignored.
+ *
+ *     sphere NAME cx cy cz r [transform]
+ *     cylinder NAME sx sy sz ex ey ez r [transform]
+ *     mesh NAME "file.stl" [fit SIDELEN] [transform]
+ *     union|intersection|difference NAME LEFT RIGHT
+ *     root NAME
+ *
+ * where the optional transform is any of translate x y z, rotate ax ay az and scale s, composed in the same order as
+ * a Mesh applies them and with the same rotation units as Mesh::setRotations. Spheres and cylinders have the transform
+ * applied to their parameters, meshes keep it as their own transformation. Mesh files are resolved relative to the scene
+ * file and read once per parser. Within a description, references to the same file with the same fit and transform
+ * share a single leaf and Mesh, in the same way as a node used twice. Since a Mesh carries its own transformation,
+ * differently placed references, and those in later scenes loaded by the same parser, each get a Mesh with a copy of
+ * the cached geometry instead of reading and merging the file again. Without a root line the last node defined is the
+ * root.
+ */
+class SceneParser
+{
+private:
+    /// Merged geometry of a mesh file as read from disk
+    struct MeshGeometry
+    {
+        PointArray verts;               ///< vertex positions
+        std::vector<Triangle> tris;     ///< triangles indexing into verts
+    };
+
+    std::map<std::string, MeshGeometry> meshcache; ///< geometry of each mesh file read so far, by resolved path
+
+    /**
+     * Create a mesh with the geometry of a file, reading it only if it is not already cached
+     * @param path  resolved path of an STL file
+     * @returns     new mesh, or NULL if the file could not be read
+     */
+    Mesh * loadMesh(const std::string & path);
+
+public:
+
+    /**
+     * Build a CSG tree from a scene description
+     * @param in        scene description
+     * @param basedir   directory against which relative mesh paths are resolved, empty for the working directory
+     * @param[out] root root node of the tree, owned by the caller and possibly sharing subtrees
+     * @retval true if the description was parsed, in which case nodes not reachable from root have been freed,
+     * @retval false on a syntax error or unreadable mesh, in which case root is NULL and nothing is allocated
+     */
+    bool parse(std::istream & in, const std::string & basedir, SceneNode * & root);
+
+    /**
+     * Build a CSG tree from a scene file
+     * @param filename  path of the scene file
+     * @param[out] root root node of the tree, as for parse
+     * @retval true if the file was read and parsed,
+     * @retval false otherwise
+     */
+    bool parseFile(const std::string & filename, SceneNode * & root);
+
+    /// Number of distinct mesh files held in the cache
+    int cachedMeshes() const { return (int) meshcache.size(); }
+
+    /// Discard cached mesh geometry, for instance when files may have changed on disk
+    void clearCache(){ meshcache.clear(); }
+};
+
+#endif
@@ -1,5 +1,7 @@
+#ifndef TESS_HEADLESS
 // #include <glew.h>
 #include <GL/glew.h> // changed to work on mac
+#endif
 #include "shape.h"
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -124,25 +126,31 @@ void ShapeGeometry::genSphere(float radius, int slices, int stacks, glm::mat4x4
     }
 }
 
-void ShapeGeometry::genMesh(std::vector<cgp::Point> * points, std::vector<cgp::Vector> * norms, std::vector<int> * faces, glm::mat4x4 trm)
+void ShapeGeometry::genMesh(PointArray * points, VectorArray * norms, std::vector<int> * faces, glm::mat4x4 trm)
 {
-    int i, base;
-    glm::vec4 p;
-    glm::vec3 v;
+    int i, base, num;
+    PointArray tpoints;
+    VectorArray tnorms;
+
+    // apply transformation, with normals transformed by the inverse transpose
+    points->transform(trm, tpoints);
+    norms->transform(glm::transpose(glm::inverse(glm::mat3(trm))), tnorms);
+    tnorms.normalize();
 
+    // interleave into the vertex buffer layout
     base = int(verts.size()) / 8;
-    for(i = 0; i < (int) points->size(); i++)
+    num = points->size();
+    verts.resize(verts.size() + 8 * num);
+    float * dst = verts.data() + 8 * base;
+    const float * px = tpoints.xs(), * py = tpoints.ys(), * pz = tpoints.zs();
+    const float * nx = tnorms.xs(), * ny = tnorms.ys(), * nz = tnorms.zs();
+#pragma omp parallel for schedule(static)
+    for(i = 0; i < num; i++)
     {
-        // apply transformation
-        p = trm * glm::vec4((* points)[i].x, (* points)[i].y, (* points)[i].z, 1.0f);
-        // v = glm::mat3(trm) * glm::normalize(glm::vec3(x, y, z));
-        v = glm::transpose(glm::inverse(glm::mat3(trm))) * glm::normalize(glm::vec3((* norms)[i].i, (* norms)[i].j, (* norms)[i].k));
-        v = glm::normalize(v);
-
-
-        verts.push_back(p.x); verts.push_back(p.y); verts.push_back(p.z); // position
-        verts.push_back(0.0f); verts.push_back(0.0f); // texture coordinates
-        verts.push_back(v.x); verts.push_back(v.y); verts.push_back(v.z); // normal
+        float * v = dst + 8 * i;
+        v[0] = px[i]; v[1] = py[i]; v[2] = pz[i]; // position
+        v[3] = 0.0f; v[4] = 0.0f; // texture coordinates
+        v[5] = nx[i]; v[6] = ny[i]; v[7] = nz[i]; // normal
     }
 
     for(i = 0; i < (int) faces->size(); i++)
@@ -171,6 +179,10 @@ ShapeDrawData ShapeGeometry::getDrawParameters()
 
 bool ShapeGeometry::bindBuffers(View * view)
 {
+#ifdef TESS_HEADLESS
+    // no rendering context to bind to
+    return false;
+#else
     if((int) indices.size() > 0)
     {
         if (vboGeom != 0)
@@ -222,4 +234,5 @@ bool ShapeGeometry::bindBuffers(View * view)
     {
         return false;
     }
+#endif
 }
@@ -6,7 +6,9 @@
  * ShapeGeometry class for rendering shapes in triangle mesh format
  */
 
+#include "gltypes.h"
 #include "view.h"
+#include "soa.h"
 
 /**
  * Container for rendering properties, primarily colour
@@ -94,13 +96,14 @@ public:
     void genSphere(float radius, int slices, int stacks, glm::mat4x4 trm);
 
     /**
-     * Convert a mesh structure to openGL geometry
+     * Convert a mesh structure to openGL geometry, keeping the order of its triangles and vertices, so meshes should
+     * already be ordered for the vertex cache (see Mesh::reorder)
      * @param points    list of vertices
      * @param norms     list of vertex normals
      * @param faces     flattened list of vertex indices, with each group of 3 indices representing a triangle
      * @param trm       model transformation matrix
      */
-    void genMesh(std::vector<cgp::Point> * points, std::vector<cgp::Vector> * norms, std::vector<int> * faces, glm::mat4x4 trm);
+    void genMesh(PointArray * points, VectorArray * norms, std::vector<int> * faces, glm::mat4x4 trm);
 
     /**
      * Return data required for a draw call, such as the VAO, colour, etc.
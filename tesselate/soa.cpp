@@ -0,0 +1,113 @@
+//
+// Structure-of-arrays point and vector storage
+//
+
+#include "soa.h"
+#include <cmath>
+
+using namespace std;
+
+std::vector<cgp::Point> PointArray::toVector() const
+{
+    std::vector<cgp::Point> pnts(size());
+
+    for(int i = 0; i < size(); i++)
+        pnts[i] = cgp::Point(xv[i], yv[i], zv[i]);
+    return pnts;
+}
+
+void PointArray::transform(const glm::mat4 & tfm, PointArray & out) const
+{
+    int n = size();
+    // glm matrices are column major, so tfm[c][r] is the entry in row r and column c
+    float m00 = tfm[0][0], m01 = tfm[1][0], m02 = tfm[2][0], m03 = tfm[3][0];
+    float m10 = tfm[0][1], m11 = tfm[1][1], m12 = tfm[2][1], m13 = tfm[3][1];
+    float m20 = tfm[0][2], m21 = tfm[1][2], m22 = tfm[2][2], m23 = tfm[3][2];
+
+    out.resize(n);
+    const float * px = xs(), * py = ys(), * pz = zs();
+    float * ox = out.xs(), * oy = out.ys(), * oz = out.zs();
+#pragma omp parallel for simd schedule(static)
+    for(int i = 0; i < n; i++)
+    {
+        float x = px[i], y = py[i], z = pz[i];
+        ox[i] = m00 * x + m01 * y + m02 * z + m03;
+        oy[i] = m10 * x + m11 * y + m12 * z + m13;
+        oz[i] = m20 * x + m21 * y + m22 * z + m23;
+    }
+}
+
+cgp::BoundBox PointArray::bounds() const
+{
+    cgp::BoundBox bbox;
+    int n = size();
+    float minx = HUGE_VALF, miny = HUGE_VALF, minz = HUGE_VALF;
+    float maxx = -HUGE_VALF, maxy = -HUGE_VALF, maxz = -HUGE_VALF;
+    const float * px = xs(), * py = ys(), * pz = zs();
+
+#pragma omp parallel for simd reduction(min:minx,miny,minz) reduction(max:maxx,maxy,maxz) schedule(static)
+    for(int i = 0; i < n; i++)
+    {
+        minx = std::min(minx, px[i]); maxx = std::max(maxx, px[i]);
+        miny = std::min(miny, py[i]); maxy = std::max(maxy, py[i]);
+        minz = std::min(minz, pz[i]); maxz = std::max(maxz, pz[i]);
+    }
+    if(n > 0)
+    {
+        bbox.min = cgp::Point(minx, miny, minz);
+        bbox.max = cgp::Point(maxx, maxy, maxz);
+    }
+    return bbox;
+}
+
+void VectorArray::transform(const glm::mat3 & tfm, VectorArray & out) const
+{
+    int n = size();
+    float m00 = tfm[0][0], m01 = tfm[1][0], m02 = tfm[2][0];
+    float m10 = tfm[0][1], m11 = tfm[1][1], m12 = tfm[2][1];
+    float m20 = tfm[0][2], m21 = tfm[1][2], m22 = tfm[2][2];
+
+    out.resize(n);
+    const float * vx = xs(), * vy = ys(), * vz = zs();
+    float * ox = out.xs(), * oy = out.ys(), * oz = out.zs();
+#pragma omp parallel for simd schedule(static)
+    for(int i = 0; i < n; i++)
+    {
+        float x = vx[i], y = vy[i], z = vz[i];
+        ox[i] = m00 * x + m01 * y + m02 * z;
+        oy[i] = m10 * x + m11 * y + m12 * z;
+        oz[i] = m20 * x + m21 * y + m22 * z;
+    }
+}
+
+void VectorArray::normalize()
+{
+    int n = size();
+    float * vx = xs(), * vy = ys(), * vz = zs();
+
+#pragma omp parallel for simd schedule(static)
+    for(int i = 0; i < n; i++)
+    {
+        float lensq = vx[i] * vx[i] + vy[i] * vy[i] + vz[i] * vz[i];
+        float inv = (lensq > 0.0f) ? 1.0f / sqrtf(lensq) : 1.0f;
+        vx[i] *= inv; vy[i] *= inv; vz[i] *= inv;
+    }
+}
+
+void VectorArray::cross(const VectorArray & a, const VectorArray & b, VectorArray & out)
+{
+    int n = a.size();
+
+    out.resize(n);
+    const float * ax = a.xs(), * ay = a.ys(), * az = a.zs();
+    const float * bx = b.xs(), * by = b.ys(), * bz = b.zs();
+    float * ox = out.xs(), * oy = out.ys(), * oz = out.zs();
+#pragma omp parallel for simd schedule(static)
+    for(int i = 0; i < n; i++)
+    {
+        float cx = ay[i] * bz[i] - az[i] * by[i];
+        float cy = az[i] * bx[i] - ax[i] * bz[i];
+        float cz = ax[i] * by[i] - ay[i] * bx[i];
+        ox[i] = cx; oy[i] = cy; oz[i] = cz;
+    }
+}
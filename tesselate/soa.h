@@ -0,0 +1,164 @@
+#ifndef _SOA
+#define _SOA
+/**
+ * @file
+ *
+ * Structure-of-arrays storage for points and vectors, with vectorised kernels for bulk per-vertex passes.
+ */
+
+#include <vector>
+#include <initializer_list>
+#include <glm/glm.hpp>
+#include "vecpnt.h"
+
+/**
+ * Three parallel float arrays holding the components of a list of 3D tuples. Each component is
+ * contiguous, so loops over all tuples vectorise without gathers.
+ */
+class Float3Array
+{
+protected:
+    std::vector<float> xv;  ///< first components
+    std::vector<float> yv;  ///< second components
+    std::vector<float> zv;  ///< third components
+
+public:
+
+    /// Number of tuples stored
+    int size() const { return (int) xv.size(); }
+
+    /// Test whether no tuples are stored
+    bool empty() const { return xv.empty(); }
+
+    /// Remove all tuples
+    void clear(){ xv.clear(); yv.clear(); zv.clear(); }
+
+    /// Change the number of tuples, zero filling any new ones
+    void resize(int n){ xv.resize(n, 0.0f); yv.resize(n, 0.0f); zv.resize(n, 0.0f); }
+
+    /// Reserve space for @a n tuples
+    void reserve(int n){ xv.reserve(n); yv.reserve(n); zv.reserve(n); }
+
+    /// Exchange contents with another array in constant time
+    void swap(Float3Array & other){ xv.swap(other.xv); yv.swap(other.yv); zv.swap(other.zv); }
+
+    /// Contiguous first components, for use in kernels
+    float * xs(){ return xv.data(); }
+    const float * xs() const { return xv.data(); }
+
+    /// Contiguous second components, for use in kernels
+    float * ys(){ return yv.data(); }
+    const float * ys() const { return yv.data(); }
+
+    /// Contiguous third components, for use in kernels
+    float * zs(){ return zv.data(); }
+    const float * zs() const { return zv.data(); }
+};
+
+/**
+ * Reference to one element of a PointArray that behaves like a cgp::Point, so that existing
+ * per-point code such as verts[i].x += d continues to work on structure-of-arrays storage
+ */
+struct PointRef
+{
+    float & x, & y, & z;
+
+    PointRef(float & px, float & py, float & pz): x(px), y(py), z(pz){}
+    operator cgp::Point() const { return cgp::Point(x, y, z); }
+    PointRef & operator=(const cgp::Point & p){ x = p.x; y = p.y; z = p.z; return * this; }
+    PointRef & operator=(const PointRef & p){ x = p.x; y = p.y; z = p.z; return * this; }
+};
+
+/**
+ * Reference to one element of a VectorArray that behaves like a cgp::Vector
+ */
+struct VectorRef
+{
+    float & i, & j, & k;
+
+    VectorRef(float & vi, float & vj, float & vk): i(vi), j(vj), k(vk){}
+    operator cgp::Vector() const { return cgp::Vector(i, j, k); }
+    VectorRef & operator=(const cgp::Vector & v){ i = v.i; j = v.j; k = v.k; return * this; }
+    VectorRef & operator=(const VectorRef & v){ i = v.i; j = v.j; k = v.k; return * this; }
+};
+
+/**
+ * List of points in structure-of-arrays form, with element access compatible with std::vector<cgp::Point>
+ */
+class PointArray: public Float3Array
+{
+public:
+
+    /// Default constructor
+    PointArray(){}
+
+    /// Construct from a list of points
+    PointArray(std::initializer_list<cgp::Point> pnts){ assign(pnts.begin(), pnts.end()); }
+
+    /// Replace contents with a list of points
+    PointArray & operator=(const std::vector<cgp::Point> & pnts){ assign(pnts.begin(), pnts.end()); return * this; }
+    PointArray & operator=(std::initializer_list<cgp::Point> pnts){ assign(pnts.begin(), pnts.end()); return * this; }
+
+    /// Replace contents with the points in [first, last)
+    template<class It> void assign(It first, It last)
+    {
+        clear();
+        for(It it = first; it != last; it++)
+            push_back(* it);
+    }
+
+    /// Copy contents out as a list of points
+    std::vector<cgp::Point> toVector() const;
+
+    /// Append a point
+    void push_back(const cgp::Point & p){ xv.push_back(p.x); yv.push_back(p.y); zv.push_back(p.z); }
+
+    /// Access point @a i
+    PointRef operator[](int i){ return PointRef(xv[i], yv[i], zv[i]); }
+    cgp::Point operator[](int i) const { return cgp::Point(xv[i], yv[i], zv[i]); }
+
+    /**
+     * Apply an affine transformation to every point
+     * @param tfm       transformation matrix, with the point treated as having homogeneous coordinate 1
+     * @param[out] out  transformed points, which may be this array for an in-place transform
+     */
+    void transform(const glm::mat4 & tfm, PointArray & out) const;
+
+    /// Bounding box of all points
+    cgp::BoundBox bounds() const;
+};
+
+/**
+ * List of vectors in structure-of-arrays form, with element access compatible with std::vector<cgp::Vector>
+ */
+class VectorArray: public Float3Array
+{
+public:
+
+    /// Append a vector
+    void push_back(const cgp::Vector & v){ xv.push_back(v.i); yv.push_back(v.j); zv.push_back(v.k); }
+
+    /// Access vector @a i
+    VectorRef operator[](int i){ return VectorRef(xv[i], yv[i], zv[i]); }
+    cgp::Vector operator[](int i) const { return cgp::Vector(xv[i], yv[i], zv[i]); }
+
+    /**
+     * Apply a linear transformation to every vector
+     * @param tfm       transformation matrix
+     * @param[out] out  transformed vectors, which may be this array for an in-place transform
+     */
+    void transform(const glm::mat3 & tfm, VectorArray & out) const;
+
+    /// Scale every vector to unit length, leaving zero length vectors unchanged
+    void normalize();
+
+    /**
+     * Elementwise cross product of two arrays of equal size
+     * @param a         left operands
+     * @param b         right operands
+     * @param[out] out  a[i] x b[i] for every i, which may alias either operand
+     */
+    static void cross(const VectorArray & a, const VectorArray & b, VectorArray & out);
+};
+
+#endif
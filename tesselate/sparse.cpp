@@ -0,0 +1,143 @@
+//
+// SparseMatrix and conjugate gradient solver
+//
+
+#include "sparse.h"
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+void SparseMatrix::setPattern(const std::vector<int> & offsets, const std::vector<int> & columns)
+{
+    rowoff = offsets;
+    colidx = columns;
+    vals.assign(colidx.size(), 0.0);
+}
+
+void SparseMatrix::clear()
+{
+    rowoff.clear();
+    colidx.clear();
+    vals.clear();
+}
+
+void SparseMatrix::diagonal(std::vector<double> & diag) const
+{
+    int n = size();
+
+    diag.assign(n, 0.0);
+#pragma omp parallel for
+    for(int r = 0; r < n; r++)
+        for(int k = rowoff[r]; k < rowoff[r+1]; k++)
+            if(colidx[k] == r)
+                diag[r] = vals[k];
+}
+
+void SparseMatrix::multiply(const std::vector<double> & x, std::vector<double> & y) const
+{
+    int n = size();
+    const int * off = rowoff.data();
+    const int * col = colidx.data();
+    const double * val = vals.data();
+    const double * xp = x.data();
+
+    y.resize(n);
+#pragma omp parallel for schedule(static)
+    for(int r = 0; r < n; r++)
+    {
+        double sum = 0.0;
+#pragma omp simd reduction(+:sum)
+        for(int k = off[r]; k < off[r+1]; k++)
+            sum += val[k] * xp[col[k]];
+        y[r] = sum;
+    }
+}
+
+/// Parallel dot product of two equal length vectors
+static double dot(const std::vector<double> & a, const std::vector<double> & b)
+{
+    double sum = 0.0;
+    int n = (int) a.size();
+
+#pragma omp parallel for simd reduction(+:sum) schedule(static)
+    for(int i = 0; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+bool solveCG(const SparseMatrix & A, const std::vector<double> & b, std::vector<double> & x, int maxiter, double tol, int & iters)
+{
+    int n = A.size();
+    std::vector<double> r, z, p, q, invdiag;
+    double rz, rznew, alpha, beta, bnorm, pq;
+
+    iters = 0;
+    if((int) b.size() != n)
+    {
+        cerr << "Error solveCG: right hand side has " << b.size() << " entries for a system of size " << n << endl;
+        return false;
+    }
+    if((int) x.size() != n)
+        x.assign(n, 0.0);
+
+    // Jacobi preconditioner, falling back to the identity on rows without a usable diagonal
+    A.diagonal(invdiag);
+#pragma omp parallel for
+    for(int i = 0; i < n; i++)
+        invdiag[i] = (invdiag[i] > 0.0) ? 1.0 / invdiag[i] : 1.0;
+
+    bnorm = sqrt(dot(b, b));
+    if(bnorm == 0.0)
+    {
+        x.assign(n, 0.0);
+        return true;
+    }
+
+    // residual of the initial guess
+    A.multiply(x, r);
+#pragma omp parallel for
+    for(int i = 0; i < n; i++)
+        r[i] = b[i] - r[i];
+    if(sqrt(dot(r, r)) <= tol * bnorm)
+        return true;
+
+    z.resize(n);
+#pragma omp parallel for
+    for(int i = 0; i < n; i++)
+        z[i] = invdiag[i] * r[i];
+    p = z;
+    rz = dot(r, z);
+
+    for(iters = 1; iters <= maxiter; iters++)
+    {
+        A.multiply(p, q);
+        pq = dot(p, q);
+        if(pq <= 0.0)
+        {
+            cerr << "Error solveCG: matrix is not positive definite" << endl;
+            return false;
+        }
+        alpha = rz / pq;
+#pragma omp parallel for simd schedule(static)
+        for(int i = 0; i < n; i++)
+        {
+            x[i] += alpha * p[i];
+            r[i] -= alpha * q[i];
+        }
+        if(sqrt(dot(r, r)) <= tol * bnorm)
+            return true;
+
+#pragma omp parallel for simd schedule(static)
+        for(int i = 0; i < n; i++)
+            z[i] = invdiag[i] * r[i];
+        rznew = dot(r, z);
+        beta = rznew / rz;
+        rz = rznew;
+#pragma omp parallel for simd schedule(static)
+        for(int i = 0; i < n; i++)
+            p[i] = z[i] + beta * p[i];
+    }
+    iters = maxiter;
+    return false;
+}
@@ -0,0 +1,85 @@
+#ifndef _SPARSE
+#define _SPARSE
+/**
+ * @file
+ *
+ * Sparse symmetric matrices in compressed sparse row form and a preconditioned conjugate gradient solver.
+ */
+
+#include <vector>
+
+/**
+ * Square sparse matrix in compressed sparse row (CSR) form. The nonzeros of row r are stored in
+ * column order, starting at colidx[rowoff[r]] and ending before colidx[rowoff[r+1]].
+ */
+class SparseMatrix
+{
+private:
+    std::vector<int> rowoff;    ///< start of each row in colidx and vals, with a trailing end marker
+    std::vector<int> colidx;    ///< column of each nonzero
+    std::vector<double> vals;   ///< value of each nonzero
+
+public:
+
+    /// Default constructor
+    SparseMatrix(){}
+
+    /**
+     * Set up the sparsity pattern, zeroing all values
+     * @param offsets   start of each row, of length n+1 for an n x n matrix
+     * @param columns   column of each nonzero, sorted within each row
+     */
+    void setPattern(const std::vector<int> & offsets, const std::vector<int> & columns);
+
+    /// Release all storage
+    void clear();
+
+    /// Number of rows (and columns) in the matrix
+    int size() const { return rowoff.empty() ? 0 : (int) rowoff.size() - 1; }
+
+    /// Number of stored nonzeros
+    int numNonZeros() const { return (int) colidx.size(); }
+
+    /// Start of row @a r in the nonzero arrays
+    int rowStart(int r) const { return rowoff[r]; }
+
+    /// End of row @a r in the nonzero arrays
+    int rowEnd(int r) const { return rowoff[r+1]; }
+
+    /// Column of nonzero @a k
+    int column(int k) const { return colidx[k]; }
+
+    /// Modifiable value of nonzero @a k
+    double & value(int k){ return vals[k]; }
+
+    /// Value of nonzero @a k
+    double value(int k) const { return vals[k]; }
+
+    /**
+     * Extract the main diagonal
+     * @param[out] diag diagonal entries, zero where no diagonal entry is stored
+     */
+    void diagonal(std::vector<double> & diag) const;
+
+    /**
+     * Sparse matrix-vector product y = Ax, parallelised over rows
+     * @param x         input vector, of length size()
+     * @param[out] y    output vector, resized to size()
+     */
+    void multiply(const std::vector<double> & x, std::vector<double> & y) const;
+};
+
+/**
+ * Solve Ax = b for a symmetric positive definite sparse matrix using conjugate gradients with a Jacobi (diagonal) preconditioner
+ * @param A             symmetric positive definite system matrix
+ * @param b             right hand side
+ * @param[in,out] x     initial guess on entry, which allows warm starts from a previous solution, and the solution on exit
+ * @param maxiter       maximum number of iterations
+ * @param tol           convergence threshold on the residual norm relative to the norm of b
+ * @param[out] iters    number of iterations performed
+ * @retval true  if the solver converged within maxiter iterations,
+ * @retval false otherwise
+ */
+bool solveCG(const SparseMatrix & A, const std::vector<double> & b, std::vector<double> & x, int maxiter, double tol, int & iters);
+
+#endif
@@ -0,0 +1,187 @@
+//
+// Vertex cache optimisation
+//
+
+#include "vcache.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+
+// scoring constants tuned by Forsyth for typical hardware
+const float cachedecaypower = 1.5f;     ///< falloff of the score with position in the cache
+const float lasttriscore = 0.75f;       ///< score of the vertices of the most recent triangle, kept below the next few so that strips are not favoured
+const float valenceboostscale = 2.0f;   ///< weight of the bonus for vertices with few triangles left
+const float valenceboostpower = 0.5f;   ///< falloff of that bonus with the number of triangles left
+
+float computeACMR(const std::vector<int> & indices, int numverts, int cachesize)
+{
+    std::vector<int> stamp(numverts, -1);
+    int numtris = (int) indices.size() / 3, misses = 0;
+
+    if(numtris == 0)
+        return 0.0f;
+
+    // a vertex is in the cache if it was loaded fewer than cachesize misses ago
+    for(int i = 0; i < numtris * 3; i++)
+    {
+        int v = indices[i];
+        if(v < 0 || v >= numverts)
+            continue;
+        if(stamp[v] < 0 || misses - stamp[v] >= cachesize)
+        {
+            stamp[v] = misses;
+            misses++;
+        }
+    }
+    return (float) misses / (float) numtris;
+}
+
+/**
+ * Score a vertex for selection by the cache optimiser
+ * @param cachepos  position in the simulated cache, most recent first, or -1 if not cached
+ * @param remaining number of triangles using the vertex that are still to be emitted
+ * @param cachesize size of the simulated cache
+ * @returns score, higher for vertices whose triangles should be emitted sooner, -1 once all are emitted
+ */
+static float vertexScore(int cachepos, int remaining, int cachesize)
+{
+    float score = 0.0f;
+
+    if(remaining == 0)
+        return -1.0f;
+    if(cachepos >= 0)
+    {
+        if(cachepos < 3)
+            score = lasttriscore;
+        else
+            score = powf(1.0f - (float) (cachepos - 3) / (float) (cachesize - 3), cachedecaypower);
+    }
+    score += valenceboostscale * powf((float) remaining, -valenceboostpower);
+    return score;
+}
+
+void optimizeVertexCache(std::vector<int> & indices, int numverts, int cachesize, std::vector<int> * order)
+{
+    int numtris = (int) indices.size() / 3, cursor = 0, best = -1;
+    std::vector<int> offsets(numverts + 1, 0), active, remaining(numverts, 0), cachepos(numverts, -1);
+    std::vector<float> vscore(numverts), tscore(numtris, 0.0f);
+    std::vector<bool> emitted(numtris, false);
+    std::vector<int> cache, newcache, output;
+
+    if(order != NULL)
+        order->clear();
+    if(numtris == 0)
+        return;
+    cachesize = std::max(cachesize, 4);
+    for(int i = 0; i < numtris * 3; i++)
+        if(indices[i] < 0 || indices[i] >= numverts)
+        {
+            cerr << "Error optimizeVertexCache: index " << indices[i] << " out of bounds" << endl;
+            return;
+        }
+
+    // triangles of each vertex, with the unemitted ones kept at the front of each run
+    for(int i = 0; i < numtris * 3; i++)
+        offsets[indices[i] + 1]++;
+    for(int v = 0; v < numverts; v++)
+    {
+        remaining[v] = offsets[v + 1];
+        offsets[v + 1] += offsets[v];
+    }
+    active.resize(offsets[numverts]);
+    std::vector<int> fill(offsets.begin(), offsets.end() - 1);
+    for(int t = 0; t < numtris; t++)
+        for(int p = 0; p < 3; p++)
+            active[fill[indices[3*t+p]]++] = t;
+
+    for(int v = 0; v < numverts; v++)
+        vscore[v] = vertexScore(-1, remaining[v], cachesize);
+    for(int t = 0; t < numtris; t++)
+    {
+        tscore[t] = vscore[indices[3*t]] + vscore[indices[3*t+1]] + vscore[indices[3*t+2]];
+        if(best < 0 || tscore[t] > tscore[best])
+            best = t;
+    }
+
+    output.reserve(numtris * 3);
+    cache.reserve(cachesize + 3);
+    newcache.reserve(cachesize + 3);
+    for(int count = 0; count < numtris; count++)
+    {
+        // when nothing in the cache has triangles left, continue from the next triangle in input order
+        if(best < 0)
+        {
+            while(emitted[cursor])
+                cursor++;
+            best = cursor;
+        }
+
+        emitted[best] = true;
+        if(order != NULL)
+            order->push_back(best);
+        newcache.clear();
+        for(int p = 0; p < 3; p++)
+        {
+            int v = indices[3*best+p];
+            output.push_back(v);
+            newcache.push_back(v);
+
+            // retire the triangle from the vertex's active run
+            int * run = active.data() + offsets[v];
+            for(int k = 0; k < remaining[v]; k++)
+                if(run[k] == best)
+                {
+                    std::swap(run[k], run[remaining[v] - 1]);
+                    break;
+                }
+            remaining[v]--;
+        }
+
+        // least recently used update, with the triangle's vertices moved to the front
+        for(int v: cache)
+            if(v != newcache[0] && v != newcache[1] && v != newcache[2])
+                newcache.push_back(v);
+        for(int i = 0; i < (int) newcache.size(); i++)
+        {
+            int v = newcache[i];
+            cachepos[v] = (i < cachesize) ? i : -1;
+            vscore[v] = vertexScore(cachepos[v], remaining[v], cachesize);
+        }
+
+        // rescore the triangles touched by the cache and pick the best of them
+        best = -1;
+        for(int v: newcache)
+            for(int k = offsets[v]; k < offsets[v] + remaining[v]; k++)
+            {
+                int t = active[k];
+                tscore[t] = vscore[indices[3*t]] + vscore[indices[3*t+1]] + vscore[indices[3*t+2]];
+                if(best < 0 || tscore[t] > tscore[best])
+                    best = t;
+            }
+
+        if((int) newcache.size() > cachesize)
+            newcache.resize(cachesize);
+        cache.swap(newcache);
+    }
+    indices.swap(output);
+}
+
+void optimizeVertexFetch(std::vector<int> & indices, int numverts, std::vector<int> & remap)
+{
+    int next = 0;
+
+    remap.assign(numverts, -1);
+    for(int & v: indices)
+    {
+        if(v < 0 || v >= numverts)
+            continue;
+        if(remap[v] < 0)
+            remap[v] = next++;
+        v = remap[v];
+    }
+    for(int v = 0; v < numverts; v++)
+        if(remap[v] < 0)
+            remap[v] = next++;
+}
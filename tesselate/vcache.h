@@ -0,0 +1,43 @@
+#ifndef _VCACHE
+#define _VCACHE
+/**
+ * @file
+ *
+ * Reordering of triangle index buffers for the post-transform vertex cache of the GPU, and of vertex buffers for fetch locality.
+ */
+
+#include <vector>
+#include <cstddef>
+
+/**
+ * Simulate a first-in first-out post-transform vertex cache over an index buffer
+ * @param indices   flattened triangle vertex indices, three per triangle
+ * @param numverts  number of vertices referenced by indices
+ * @param cachesize number of cache entries simulated, 16 being typical of current hardware
+ * @returns average cache miss ratio, the number of vertex shader invocations per triangle, which lies
+ *          between about 0.5 for an ideal ordering of a large closed mesh and 3 for no reuse at all
+ */
+float computeACMR(const std::vector<int> & indices, int numverts, int cachesize = 16);
+
+/**
+ * Reorder triangles to improve vertex cache reuse, using Forsyth's linear-speed algorithm. Each vertex is scored by its
+ * position in a simulated least recently used cache and by the number of its triangles still to be emitted, and the
+ * triangle with the highest total score among those touching the cache is emitted next. Winding is preserved
+ * @param[in,out] indices   flattened triangle vertex indices, three per triangle, reordered in place
+ * @param numverts  number of vertices referenced by indices
+ * @param cachesize size of the simulated cache, which should be at least as large as the hardware cache
+ * @param[out] order    if not NULL, the input triangle emitted at each position of the output, for carrying other
+ *                      per-triangle data along with the reordering
+ */
+void optimizeVertexCache(std::vector<int> & indices, int numverts, int cachesize = 32, std::vector<int> * order = NULL);
+
+/**
+ * Renumber vertices in the order of their first use by the index buffer, so that vertex fetches move steadily through
+ * memory. Vertices not referenced by any triangle are placed after the others in their existing order
+ * @param[in,out] indices   flattened triangle vertex indices, rewritten to use the new numbering
+ * @param numverts  number of vertices referenced by indices
+ * @param[out] remap        new index of each original vertex, for use in permuting the vertex data
+ */
+void optimizeVertexFetch(std::vector<int> & indices, int numverts, std::vector<int> & remap);
+
+#endif
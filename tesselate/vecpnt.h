@@ -9,6 +9,7 @@
 
 #include <math.h>
 #include <fstream>
+#include <algorithm>
 #include <boost/archive/text_oarchive.hpp>
 #include <boost/archive/text_iarchive.hpp>
 #include <boost/serialization/base_object.hpp>
@@ -356,6 +357,22 @@ public:
             max.z = pnt.z;
     }
 
+    /// Expand the bounding box to enclose another bounding box
+    inline void includeBox(const BoundBox & box)
+    {
+        min.x = std::min(min.x, box.min.x); max.x = std::max(max.x, box.max.x);
+        min.y = std::min(min.y, box.min.y); max.y = std::max(max.y, box.max.y);
+        min.z = std::min(min.z, box.min.z); max.z = std::max(max.z, box.max.z);
+    }
+
+    /// Return true if the bounding box shares any points, including boundary points, with another bounding box
+    inline bool overlaps(const BoundBox & box) const
+    {
+        return min.x <= box.max.x && box.min.x <= max.x
+            && min.y <= box.max.y && box.min.y <= max.y
+            && min.z <= box.max.z && box.min.z <= max.z;
+    }
+
     /// Return the length of the diagonal of the bounding box
     inline float diagLen()
     {
@@ -8,6 +8,7 @@
 #include <string.h>
 #include <iostream>
 #include <limits>
+#include <algorithm>
 
 using namespace std;
 
@@ -85,6 +86,8 @@ VoxelVolume::VoxelVolume()
 {
     xdim = ydim = zdim = 0;
     xspan = 0;
+    xoff = yoff = zoff = 0;
+    intsize = (sizeof(int) * 8);
     voxgrid = NULL;
     setFrame(cgp::Point(0.0f, 0.0f, 0.0f), cgp::Vector(0.0f, 0.0f, 0.0f));
 }
@@ -96,6 +99,46 @@ VoxelVolume::VoxelVolume(int xsize, int ysize, int zsize, cgp::Point corner, cgp
     setFrame(corner, diag);
 }
 
+VoxelVolume::VoxelVolume(const VoxelVolume & other)
+{
+    voxgrid = NULL;
+    *this = other;
+}
+
+VoxelVolume & VoxelVolume::operator=(const VoxelVolume & other)
+{
+    if(this == &other)
+        return *this;
+
+    clear();
+    xdim = other.xdim; ydim = other.ydim; zdim = other.zdim;
+    xspan = other.xspan;
+    intsize = other.intsize;
+    xoff = other.xoff; yoff = other.yoff; zoff = other.zoff;
+    origin = other.origin;
+    diagonal = other.diagonal;
+    cell = other.cell;
+    if(other.voxgrid != NULL)
+    {
+        int memsize = xspan * ydim * zdim;
+        voxgrid = new int[memsize];
+        memcpy(voxgrid, other.voxgrid, memsize * sizeof(int));
+    }
+    return *this;
+}
+
+void VoxelVolume::swap(VoxelVolume & other)
+{
+    std::swap(voxgrid, other.voxgrid);
+    std::swap(xdim, other.xdim); std::swap(ydim, other.ydim); std::swap(zdim, other.zdim);
+    std::swap(xspan, other.xspan);
+    std::swap(intsize, other.intsize);
+    std::swap(xoff, other.xoff); std::swap(yoff, other.yoff); std::swap(zoff, other.zoff);
+    std::swap(origin, other.origin);
+    std::swap(diagonal, other.diagonal);
+    std::swap(cell, other.cell);
+}
+
 VoxelVolume::~VoxelVolume()
 {
     clear();
@@ -121,6 +164,120 @@ void VoxelVolume::fill(bool setval)
     memset(voxgrid, fillval, memsize);
 }
 
+void VoxelVolume::setSubVolume(VoxelVolume & grid, const VoxelRange & range)
+{
+    int dx, dy, dz, gx, gy, gz;
+    cgp::Vector spacing;
+
+    // start on a word boundary of the grid, so that the rows of both volumes share word boundaries
+    grid.getDim(gx, gy, gz);
+    spacing = cgp::Vector(grid.diagonal.i / (float) std::max(1, gx-1), grid.diagonal.j / (float) std::max(1, gy-1), grid.diagonal.k / (float) std::max(1, gz-1));
+    if(range.empty())
+    {
+        dx = dy = dz = 0;
+        xoff = yoff = zoff = 0;
+    }
+    else
+    {
+        dx = range.x1 - (range.x0 - range.x0 % intsize) + 1;
+        dy = range.y1 - range.y0 + 1;
+        dz = range.z1 - range.z0 + 1;
+    }
+    setDim(dx, dy, dz);
+    if(!range.empty())
+    {
+        xoff = range.x0 - range.x0 % intsize;
+        yoff = range.y0;
+        zoff = range.z0;
+    }
+    setFrame(cgp::Point(grid.origin.x + (float) (xoff - grid.xoff) * spacing.i, grid.origin.y + (float) (yoff - grid.yoff) * spacing.j,
+                        grid.origin.z + (float) (zoff - grid.zoff) * spacing.k),
+             cgp::Vector((float) std::max(0, xdim-1) * spacing.i, (float) std::max(0, ydim-1) * spacing.j, (float) std::max(0, zdim-1) * spacing.k));
+}
+
+bool VoxelVolume::combineRange(const VoxelVolume & src, const VoxelRange & range, VoxelOp op)
+{
+    int w0, w1, sw0, sw1;
+    VoxelRange held, have;
+
+    if(range.empty())
+        return true;
+    held = getGridRange();
+    if(range.x0 < held.x0 || range.y0 < held.y0 || range.z0 < held.z0 || range.x1 > held.x1 || range.y1 > held.y1 || range.z1 > held.z1)
+    {
+        cerr << "Error VoxelVolume::combineRange: block lies outside the volume" << endl;
+        return false;
+    }
+    if(xoff % intsize != 0 || src.xoff % intsize != 0)
+    {
+        cerr << "Error VoxelVolume::combineRange: volumes do not share word boundaries" << endl;
+        return false;
+    }
+
+    // whole words within each row, in grid word indices, masking the bits of the first and last word that lie outside the block
+    have = src.getGridRange();
+    w0 = range.x0 / intsize;
+    w1 = range.x1 / intsize;
+    sw0 = src.xoff / intsize;
+    sw1 = sw0 + src.xspan - 1;
+#pragma omp parallel for
+    for(int z = range.z0; z <= range.z1; z++)
+        for(int y = range.y0; y <= range.y1; y++)
+        {
+            bool srcrow = z >= have.z0 && z <= have.z1 && y >= have.y0 && y <= have.y1;
+            int rowidx = (z - zoff) * (xspan * ydim) + (y - yoff) * xspan - xoff / intsize;
+            int srcidx = (z - src.zoff) * (src.xspan * src.ydim) + (y - src.yoff) * src.xspan - sw0;
+
+            for(int w = w0; w <= w1; w++)
+            {
+                unsigned int mask = 0xffffffffu, dst, val = 0, res;
+
+                if(w == w0)
+                    mask &= 0xffffffffu >> (range.x0 % intsize);
+                if(w == w1)
+                    mask &= 0xffffffffu << (intsize - 1 - range.x1 % intsize);
+                dst = (unsigned int) voxgrid[rowidx + w];
+                if(srcrow && w >= sw0 && w <= sw1)
+                    val = (unsigned int) src.voxgrid[srcidx + w];
+                switch(op)
+                {
+                    case VoxelOp::COPY:
+                        res = val;
+                        break;
+                    case VoxelOp::OR:
+                        res = dst | val;
+                        break;
+                    case VoxelOp::AND:
+                        res = dst & val;
+                        break;
+                    default: // ANDNOT
+                        res = dst & ~val;
+                        break;
+                }
+                voxgrid[rowidx + w] = (int) ((dst & ~mask) | (res & mask));
+            }
+        }
+    return true;
+}
+
+bool VoxelVolume::copyRange(const VoxelVolume & src, const VoxelRange & range)
+{
+    VoxelRange held = getGridRange();
+
+    if(range.x0 < held.x0 || range.y0 < held.y0 || range.z0 < held.z0 || range.x1 > held.x1 || range.y1 > held.y1 || range.z1 > held.z1)
+    {
+        cerr << "Error VoxelVolume::copyRange: block lies outside the volume" << endl;
+        return false;
+    }
+    fill(false);
+    return pasteRange(src, range);
+}
+
+bool VoxelVolume::pasteRange(const VoxelVolume & src, const VoxelRange & range)
+{
+    return combineRange(src, range, VoxelOp::COPY);
+}
+
 void VoxelVolume::calcCellDiag()
 {
     if(xdim > 0 && ydim > 0 && zdim > 0)
@@ -142,6 +299,7 @@ void VoxelVolume::setDim(int &dimx, int &dimy, int &dimz)
     xdim = dimx;
     ydim = dimy;
     zdim = dimz;
+    xoff = yoff = zoff = 0;
     intsize = (sizeof(int) * 8); // because size of an integer is supposedly platform dependent, although typically 32 bits
     // will address individual bits in x dimension, so must be divisible by integer size
     xspan = (int) ceil((float) xdim / (float) intsize);
@@ -213,6 +371,39 @@ cgp::Point VoxelVolume::getVoxelPos(int x, int y, int z)
     return pnt;
 }
 
+bool VoxelVolume::getVoxelIndex(cgp::Point pnt, int &x, int &y, int &z)
+{
+    if(xdim < 2 || ydim < 2 || zdim < 2)
+        return false;
+
+    // inverse of getVoxelPos, rounded to the nearest voxel
+    x = (int) floor((pnt.x - origin.x) / diagonal.i * (float) (xdim-1) + 0.5f);
+    y = (int) floor((pnt.y - origin.y) / diagonal.j * (float) (ydim-1) + 0.5f);
+    z = (int) floor((pnt.z - origin.z) / diagonal.k * (float) (zdim-1) + 0.5f);
+    return x >= 0 && x < xdim && y >= 0 && y < ydim && z >= 0 && z < zdim;
+}
+
+bool VoxelVolume::getBoxRange(const cgp::BoundBox & box, VoxelRange & range)
+{
+    float sx, sy, sz;
+
+    range = {0, 0, 0, -1, -1, -1};
+    if(xdim < 2 || ydim < 2 || zdim < 2 || box.min.x > box.max.x || box.min.y > box.max.y || box.min.z > box.max.z)
+        return false;
+
+    // inverse of getVoxelPos
+    sx = (diagonal.i > 0.0f) ? (float) (xdim-1) / diagonal.i : 0.0f;
+    sy = (diagonal.j > 0.0f) ? (float) (ydim-1) / diagonal.j : 0.0f;
+    sz = (diagonal.k > 0.0f) ? (float) (zdim-1) / diagonal.k : 0.0f;
+    range.x0 = std::max(0, (int) floor((box.min.x - origin.x) * sx) - 1);
+    range.y0 = std::max(0, (int) floor((box.min.y - origin.y) * sy) - 1);
+    range.z0 = std::max(0, (int) floor((box.min.z - origin.z) * sz) - 1);
+    range.x1 = std::min(xdim-1, (int) ceil((box.max.x - origin.x) * sx) + 1);
+    range.y1 = std::min(ydim-1, (int) ceil((box.max.y - origin.y) * sy) + 1);
+    range.z1 = std::min(zdim-1, (int) ceil((box.max.z - origin.z) * sz) + 1);
+    return !range.empty();
+}
+
 int VoxelVolume::getMCVertIdx(int x, int y, int z)
 {
     // stub, needs completing
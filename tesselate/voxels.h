@@ -10,10 +10,53 @@
 #include <vector>
 #include <stdio.h>
 #include <iostream>
+#include <algorithm>
+#include <boost/serialization/array.hpp>
+#include <boost/serialization/split_member.hpp>
 #include "vecpnt.h"
 
+/// Inclusive block of voxel indices, empty if any first index exceeds the matching last index
+struct VoxelRange
+{
+    int x0, y0, z0; ///< first voxel of the block
+    int x1, y1, z1; ///< last voxel of the block
+
+    /// Test whether the block holds no voxels
+    bool empty() const { return x0 > x1 || y0 > y1 || z0 > z1; }
+
+    /// Voxels common to this block and another
+    VoxelRange intersect(const VoxelRange & r) const
+    {
+        return {std::max(x0, r.x0), std::max(y0, r.y0), std::max(z0, r.z0),
+                std::min(x1, r.x1), std::min(y1, r.y1), std::min(z1, r.z1)};
+    }
+
+    /// Smallest block holding the voxels of this block and another
+    VoxelRange enclose(const VoxelRange & r) const
+    {
+        if(empty())
+            return r;
+        if(r.empty())
+            return * this;
+        return {std::min(x0, r.x0), std::min(y0, r.y0), std::min(z0, r.z0),
+                std::max(x1, r.x1), std::max(y1, r.y1), std::max(z1, r.z1)};
+    }
+};
+
+/// Bitwise rule applied by VoxelVolume::combineRange to each voxel of a block
+enum class VoxelOp
+{
+    COPY,   ///< take the voxel of the source
+    OR,     ///< occupied if occupied in either volume
+    AND,    ///< occupied if occupied in both volumes
+    ANDNOT, ///< occupied if occupied in this volume but not the source
+};
+
 /**
  * A cuboid volume regularly subdivided into uniformly sized cubes (voxels). Bit packing is used to compress storage.
+ * A volume may hold just a block of a larger grid, so that intermediate results need only cover the voxels they can
+ * occupy. Its offset places it within the grid, and is a whole number of words along x so that rows of volumes on the
+ * same grid can be combined a word at a time.
  */
 class VoxelVolume
 {
@@ -24,6 +67,7 @@ private:
     int zdim;       ///< number of voxels in z dimension
     int xspan;      ///< number of integers used to represent xdim
     int intsize;    ///< size of an integer in bits
+    int xoff, yoff, zoff;   ///< grid index of voxel (0, 0, 0), with xoff a multiple of intsize
 
     cgp::Point origin;     ///< corner point in world space
     cgp::Vector diagonal;  ///< diagonal extent of the volume in world space
@@ -42,6 +86,31 @@ private:
     /// Calculate the diagonal extent of a single cell and store internally
     void calcCellDiag();
 
+    friend class boost::serialization::access;
+    /// Boost serialization of the dimensions, placement and voxels
+    template<class Archive> void save(Archive & ar, const unsigned int version) const
+    {
+        ar & xdim & ydim & zdim;
+        ar & xoff & yoff & zoff;
+        ar & origin & diagonal;
+        ar & boost::serialization::make_array(voxgrid, xspan * ydim * zdim);
+    }
+    template<class Archive> void load(Archive & ar, const unsigned int version)
+    {
+        int dx, dy, dz, ox, oy, oz;
+        cgp::Point corner;
+        cgp::Vector diag;
+
+        ar & dx & dy & dz;
+        ar & ox & oy & oz;
+        ar & corner & diag;
+        setDim(dx, dy, dz);
+        setFrame(corner, diag);
+        xoff = ox; yoff = oy; zoff = oz;
+        ar & boost::serialization::make_array(voxgrid, xspan * ydim * zdim);
+    }
+    BOOST_SERIALIZATION_SPLIT_MEMBER()
+
 public:
 
     /// Default constructor
@@ -55,6 +124,25 @@ public:
      */
     VoxelVolume(int xsize, int ysize, int zsize, cgp::Point corner, cgp::Vector diag);
 
+    /**
+     * Copy constructor, which duplicates the voxel grid
+     * @param other     volume to copy
+     */
+    VoxelVolume(const VoxelVolume & other);
+
+    /**
+     * Assignment, which duplicates the voxel grid
+     * @param other     volume to copy
+     * @returns         this volume
+     */
+    VoxelVolume & operator=(const VoxelVolume & other);
+
+    /**
+     * Exchange contents with another volume, without copying either voxel grid
+     * @param other     volume to exchange with
+     */
+    void swap(VoxelVolume & other);
+
     /// Destructor
     ~VoxelVolume();
 
@@ -69,6 +157,46 @@ public:
      */
     void fill(bool setval);
 
+    /**
+     * Reallocate as a block of the grid of another volume, holding at least the voxels in a range of grid indices.
+     * The block is widened along x to whole words. All voxels are left empty
+     * @param grid      any volume on the grid, which supplies the voxel spacing
+     * @param range     grid indices to hold, which may be empty
+     */
+    void setSubVolume(VoxelVolume & grid, const VoxelRange & range);
+
+    /// Block of grid indices held by the volume
+    VoxelRange getGridRange() const { return {xoff, yoff, zoff, xoff+xdim-1, yoff+ydim-1, zoff+zdim-1}; }
+
+    /**
+     * Combine a block of voxels with those of another volume on the same grid, a word at a time. Voxels of the source
+     * outside the block it holds count as empty, and voxels of this volume outside the range are unchanged
+     * @param src       volume to combine with
+     * @param range     grid indices of the voxels to update, which must be held by this volume
+     * @param op        rule that gives each updated voxel from its value in this volume and in src
+     * @retval true if the block was combined,
+     * @retval false if the range lies outside this volume or the volumes do not share word boundaries, in which case nothing is changed
+     */
+    bool combineRange(const VoxelVolume & src, const VoxelRange & range, VoxelOp op);
+
+    /**
+     * Copy a block of voxels from a volume on the same grid, leaving every voxel outside the block empty
+     * @param src       volume to copy from
+     * @param range     grid indices of the voxels to copy
+     * @retval true if the block is held by this volume,
+     * @retval false otherwise, in which case nothing is changed
+     */
+    bool copyRange(const VoxelVolume & src, const VoxelRange & range);
+
+    /**
+     * Overwrite a block of voxels with those of a volume on the same grid, leaving every voxel outside the block unchanged
+     * @param src       volume to copy from
+     * @param range     grid indices of the voxels to replace
+     * @retval true if the block is held by this volume,
+     * @retval false otherwise, in which case nothing is changed
+     */
+    bool pasteRange(const VoxelVolume & src, const VoxelRange & range);
+
     /**
      * Obtain the dimensions of the voxel volume
      * @param dimx, dimy, dimz     number of voxels in x, y, z dimensions
@@ -76,7 +204,7 @@ public:
     void getDim(int &dimx, int &dimy, int &dimz);
 
     /**
-     * Set the dimensions of the voxel volume and allocate memory accordingly
+     * Set the dimensions of the voxel volume and allocate memory accordingly. The volume becomes a grid of its own, with no offset
      * @param dimx, dimy, dimz     number of voxels in x, y, z dimensions
      */
     void setDim(int &dimx, int &dimy, int &dimz);
@@ -119,6 +247,28 @@ public:
      */
     cgp::Point getVoxelPos(int x, int y, int z);
 
+    /**
+     * Find the voxels whose positions, as given by getVoxelPos, fall within a box. The range is widened by one voxel
+     * on each side so that rounding never excludes a voxel on the boundary
+     * @param box         region in world space
+     * @param[out] range    voxels within the region, clamped to the volume
+     * @retval @c true  if the range contains at least one voxel,
+     * @retval @c false otherwise
+     */
+    bool getBoxRange(const cgp::BoundBox & box, VoxelRange & range);
+
+    /**
+     * Find the voxel whose position, as given by getVoxelPos, is nearest to a point
+     * @param pnt           point in world space
+     * @param[out] x, y, z  voxel index
+     * @retval @c true  if the point lies within the volume,
+     * @retval @c false otherwise
+     */
+    bool getVoxelIndex(cgp::Point pnt, int &x, int &y, int &z);
+
+    /// Block of indices covering the whole volume
+    VoxelRange getFullRange(){ return {0, 0, 0, xdim-1, ydim-1, zdim-1}; }
+
     /**
      * Return the marching cubes vertex bit code for a voxel cell
      * (Required to shoehorn Bloyd's code into current framework - see http://paulbourke.net/geometry/polygonise/marchingsource.cpp)
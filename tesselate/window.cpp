@@ -188,6 +188,19 @@ Window::Window()
     defButton->setEnabled(false);
     paramLayout->addWidget(defButton);
 
+    // progress of the stage running in the background
+    stageProgress = new QProgressBar;
+    stageProgress->setRange(0, 100);
+    stageProgress->setValue(0);
+    paramLayout->addWidget(stageProgress);
+
+    // button for stopping the running stage
+    cancelButton = new QPushButton(tr("Cancel"));
+    cancelButton->setEnabled(false);
+    paramLayout->addWidget(cancelButton);
+
+    progressTimer = new QTimer(this);
+
     // signal to slot connections
     connect(perspectiveView, SIGNAL(signalRepaintAllGL()), this, SLOT(repaintAllGL()));
     connect(checkModel, SIGNAL(stateChanged(int)), this, SLOT(showModel(int)));
@@ -196,6 +209,9 @@ Window::Window()
     connect(marchButton, &QPushButton::clicked, this, &Window::marchPress);
     connect(smoothButton, &QPushButton::clicked, this, &Window::smoothPress);
     connect(defButton, &QPushButton::clicked, this, &Window::defPress);
+    connect(cancelButton, &QPushButton::clicked, this, &Window::cancelPress);
+    connect(progressTimer, &QTimer::timeout, this, &Window::progressTick);
+    connect(perspectiveView->getWorker(), &PipelineWorker::stageFinished, this, &Window::stageFinished);
     connect(iEdit, SIGNAL(editingFinished()), this, SLOT(lineEditChange()));
     connect(jEdit, SIGNAL(editingFinished()), this, SLOT(lineEditChange()));
     connect(kEdit, SIGNAL(editingFinished()), this, SLOT(lineEditChange()));
@@ -255,6 +271,14 @@ void Window::saveFile()
 
 void Window::saveAs()
 {
+    if(perspectiveView->getWorker()->busy())
+    {
+        QMessageBox msgBox;
+        msgBox.setText("Unable to save mesh while it is being processed");
+        msgBox.exec();
+        return;
+    }
+
     QFileDialog::Options options;
     QString selectedFilter;
     tessfilename = QFileDialog::getSaveFileName(this,
@@ -295,19 +319,19 @@ void Window::sliderChange(int value)
     {
         cgp::Point trs = perspectiveView->getDef()->getCP(cpi, cpj, cpk);
         trs.x = (float) value / sliderange;
-        perspectiveView->getDef()->setCP(cpi, cpj, cpk, trs);
+        perspectiveView->getScene()->moveControlPoint(perspectiveView->getDef(), cpi, cpj, cpk, trs);
     }
     else if(sender() == ytrslider)
     {
         cgp::Point trs = perspectiveView->getDef()->getCP(cpi, cpj, cpk);
         trs.y = (float) value / sliderange;
-        perspectiveView->getDef()->setCP(cpi, cpj, cpk, trs);
+        perspectiveView->getScene()->moveControlPoint(perspectiveView->getDef(), cpi, cpj, cpk, trs);
     }
     else if(sender() == ztrslider)
     {
         cgp::Point trs = perspectiveView->getDef()->getCP(cpi, cpj, cpk);
         trs.z = (float) value / sliderange;
-        perspectiveView->getDef()->setCP(cpi, cpj, cpk, trs);
+        perspectiveView->getScene()->moveControlPoint(perspectiveView->getDef(), cpi, cpj, cpk, trs);
     }
     perspectiveView->setGeometryUpdate(true);
     repaintAllGL();
@@ -374,35 +398,100 @@ void Window::showParamOptions()
 
 void Window::voxPress()
 {
-    perspectiveView->getScene()->voxelise(0.05f);
-    perspectiveView->setGeometryUpdate(true);
-    marchButton->setEnabled(true); // only now can marching cubes be applied
-    repaintAllGL();
+    runStage(PipelineStage::VOXELISE);
 }
 
 void Window::marchPress()
 {
-    perspectiveView->getScene()->isoextract();
-    perspectiveView->setGeometryUpdate(true);
-    smoothButton->setEnabled(true); // only now can smoothing be applied
-    repaintAllGL();
+    runStage(PipelineStage::ISOEXTRACT);
 }
 
 void Window::smoothPress()
 {
-    perspectiveView->getScene()->smooth();
-    perspectiveView->setGeometryUpdate(true);
-    defButton->setEnabled(true); // only now can deformation be applied
-    repaintAllGL();
+    runStage(PipelineStage::SMOOTH);
 }
 
 void Window::defPress()
 {
-    perspectiveView->getScene()->deform(perspectiveView->getDef());
-    perspectiveView->setGeometryUpdate(true);
+    runStage(PipelineStage::DEFORM);
+}
+
+void Window::cancelPress()
+{
+    perspectiveView->getWorker()->cancel();
+    cancelButton->setEnabled(false);
+}
+
+void Window::progressTick()
+{
+    stageProgress->setValue(int(std::round(100.0f * perspectiveView->getWorker()->getProgress().fraction())));
+}
+
+void Window::runStage(PipelineStage stage)
+{
+    if(!perspectiveView->getWorker()->start(stage, 0.05f))
+        return;
+    lockControls(true, stageCancellable(stage));
+    stageProgress->setValue(0);
+    progressTimer->start(100);
+}
+
+void Window::stageFinished(int stage, bool completed)
+{
+    progressTimer->stop();
+    stageProgress->setValue(completed ? 100 : 0);
+    perspectiveView->acceptStageResult();
+    lockControls(false);
+
+    switch((PipelineStage) stage)
+    {
+        case PipelineStage::VOXELISE:
+            if(completed)
+                marchButton->setEnabled(true); // only now can marching cubes be applied
+            break;
+        case PipelineStage::ISOEXTRACT:
+            if(completed)
+                smoothButton->setEnabled(true); // only now can smoothing be applied
+            break;
+        case PipelineStage::SMOOTH:
+            if(completed)
+                defButton->setEnabled(true); // only now can deformation be applied
+            break;
+        case PipelineStage::DEFORM:
+            break;
+    }
     repaintAllGL();
 }
 
+void Window::lockControls(bool lock, bool cancellable)
+{
+    QPushButton * buttons[] = {voxButton, marchButton, smoothButton, defButton};
+
+    if(lock)
+    {
+        unlocked.clear();
+        for(QPushButton * button: buttons)
+        {
+            unlocked.push_back(button->isEnabled());
+            button->setEnabled(false);
+        }
+    }
+    else
+    {
+        for(int b = 0; b < (int) unlocked.size(); b++)
+            buttons[b]->setEnabled(unlocked[b]);
+    }
+
+    // moving control points changes the lattice and mesh that a stage may be using
+    xtrslider->setEnabled(!lock);
+    ytrslider->setEnabled(!lock);
+    ztrslider->setEnabled(!lock);
+    iEdit->setEnabled(!lock);
+    jEdit->setEnabled(!lock);
+    kEdit->setEnabled(!lock);
+    cancelButton->setEnabled(lock && cancellable);
+}
+
 void Window::createActions()
 {
     newAct = new QAction(tr("&New"), this);
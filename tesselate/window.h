@@ -129,6 +129,19 @@ public slots:
     /// deform isosurface
     void defPress();
 
+    /// stop the running pipeline stage
+    void cancelPress();
+
+    /// show the progress of the running pipeline stage
+    void progressTick();
+
+    /**
+     * Take the result of a pipeline stage and allow the next stages
+     * @param stage     the PipelineStage that ran
+     * @param completed false if it was cancelled
+     */
+    void stageFinished(int stage, bool completed);
+
 protected:
 
     /// Handle key press event
@@ -140,6 +153,19 @@ protected:
     /// Handle changes in parameter settings
     void optionsChanged();
 
+    /**
+     * Run a pipeline stage in the background, with the controls that would change the scene disabled until it finishes
+     * @param stage     stage to run
+     */
+    void runStage(PipelineStage stage);
+
+    /**
+     * Disable or restore the stage buttons and control point inputs, and the reverse for the cancel button
+     * @param lock  true to disable them while a stage runs, false to restore them
+     * @param cancellable   whether the running stage honours cancellation, without which the cancel button stays disabled
+     */
+    void lockControls(bool lock, bool cancellable = false);
+
 private:
     GLWidget * perspectiveView; ///< openGL render view
     QWidget * paramPanel;       ///< side panel for user access to parameters
@@ -151,6 +177,10 @@ private:
     QPushButton * marchButton; ///< button to activate marching cubes
     QPushButton * smoothButton; ///< button to activate smoothing
     QPushButton * defButton; ///< button to activate deformation
+    QPushButton * cancelButton; ///< button to stop the running stage
+    QProgressBar * stageProgress; ///< progress of the running stage
+    QTimer * progressTimer; ///< polls the progress of the running stage
+    vector<bool> unlocked; ///< whether each stage button was enabled before the running stage locked them
 
     // active control point
     int cpi, cpj, cpk;    ///< coordinates of currently active ffd control point
@@ -7,6 +7,9 @@
 #include <stdio.h>
 #include <cstdint>
 #include <sstream>
+#include <fstream>
+#include <set>
+#include <atomic>
 #include <stdlib.h>
 #include <time.h>
 #include <cppunit/extensions/TestFactoryRegistry.h>
@@ -25,6 +28,14 @@ void TestCSG::tearDown()
     // delete csg;
 }
 
+/// State of the voxel nearest to a point, false outside the volume
+static bool voxelAt(VoxelVolume * vox, cgp::Point pnt)
+{
+    int x, y, z;
+
+    return vox->getVoxelIndex(pnt, x, y, z) && vox->get(x, y, z);
+}
+
 void TestCSG::testSimpleCSG()
 {
     // unit tests could be made much more comprehensive than this
@@ -32,14 +43,587 @@ void TestCSG::testSimpleCSG()
 
     csg->sampleScene();
     csg->voxelise(0.1f);
-    CPPUNIT_ASSERT(!csg->getVox()->get(100,100,100)); // inside extracted cylinder
-    CPPUNIT_ASSERT(!csg->getVox()->get(50,150,100)); // just outside central sphere
-    CPPUNIT_ASSERT(csg->getVox()->get(70,100,100)); // just inside central sphere
-    CPPUNIT_ASSERT(csg->getVox()->get(150,150,100)); // inside extruding cylinder
+    CPPUNIT_ASSERT(!voxelAt(csg->getVox(), cgp::Point(-1.04f, -0.05f, -0.05f))); // inside extracted cylinder
+    CPPUNIT_ASSERT(!voxelAt(csg->getVox(), cgp::Point(-5.57f, 4.97f, -0.05f))); // just outside central sphere
+    CPPUNIT_ASSERT(voxelAt(csg->getVox(), cgp::Point(-3.76f, -0.05f, -0.05f))); // just inside central sphere
+    CPPUNIT_ASSERT(voxelAt(csg->getVox(), cgp::Point(3.49f, 4.97f, -0.05f))); // inside extruding cylinder
+
+    // the volume is fitted to the scene with voxels exactly 0.1 apart
+    cgp::Point o;
+    cgp::Vector d;
+    int dx, dy, dz;
+    csg->getVox()->getDim(dx, dy, dz);
+    csg->getVox()->getFrame(o, d);
+    CPPUNIT_ASSERT(fabs(d.j / (float) (dy-1) - 0.1f) < 0.0001f && fabs(d.k / (float) (dz-1) - 0.1f) < 0.0001f);
+    CPPUNIT_ASSERT(dy < 200 && dz < 200);
 
     cerr << "CSG SIMPLE SCENE PASSED" << endl << endl;
 }
 
+void TestCSG::testMeshCSG()
+{
+    Mesh a, b;
+    MeshCSG mcsg(48);
+    PointArray uverts, iverts, dverts;
+    std::vector<Triangle> utris, itris, dtris;
+    double va, vb, vu, vi, vd;
+
+    a.buildSphere(cgp::Point(0.0f, 0.0f, 0.0f), 1.0f, 48, 24);
+    b.buildSphere(cgp::Point(1.0f, 0.0f, 0.0f), 1.0f, 48, 24);
+    va = enclosedVolume(a.getVerts(), a.getTris());
+    vb = enclosedVolume(b.getVerts(), b.getTris());
+    CPPUNIT_ASSERT(fabs(va - 4.0 * M_PI / 3.0) < 0.05 * va);
+
+    mcsg.apply(SetOp::UNION, a.getVerts(), a.getTris(), b.getVerts(), b.getTris(), uverts, utris);
+    mcsg.apply(SetOp::INTERSECTION, a.getVerts(), a.getTris(), b.getVerts(), b.getTris(), iverts, itris);
+    mcsg.apply(SetOp::DIFFERENCE, a.getVerts(), a.getTris(), b.getVerts(), b.getTris(), dverts, dtris);
+    vu = enclosedVolume(uverts, utris);
+    vi = enclosedVolume(iverts, itris);
+    vd = enclosedVolume(dverts, dtris);
+
+    // lens of two unit spheres one radius apart has volume 5 pi / 12
+    CPPUNIT_ASSERT(fabs(vi - 5.0 * M_PI / 12.0) < 0.05 * vi);
+    CPPUNIT_ASSERT(fabs(va + vb - vu - vi) < 0.002 * (va + vb));
+    CPPUNIT_ASSERT(fabs(va - vi - vd) < 0.002 * va);
+
+    CPPUNIT_ASSERT(windingNumber(uverts, utris, cgp::Point(-0.5f, 0.0f, 0.0f)) > 0.99);
+    CPPUNIT_ASSERT(windingNumber(uverts, utris, cgp::Point(1.5f, 0.0f, 0.0f)) > 0.99);
+    CPPUNIT_ASSERT(windingNumber(uverts, utris, cgp::Point(0.5f, 1.5f, 0.0f)) < 0.01);
+    CPPUNIT_ASSERT(windingNumber(iverts, itris, cgp::Point(0.5f, 0.0f, 0.0f)) > 0.99);
+    CPPUNIT_ASSERT(windingNumber(iverts, itris, cgp::Point(-0.5f, 0.0f, 0.0f)) < 0.01);
+    CPPUNIT_ASSERT(windingNumber(dverts, dtris, cgp::Point(-0.5f, 0.0f, 0.0f)) > 0.99);
+    CPPUNIT_ASSERT(windingNumber(dverts, dtris, cgp::Point(0.5f, 0.0f, 0.0f)) < 0.01);
+
+    // scene hook evaluates the sample tree without voxelising
+    csg->sampleScene();
+    CPPUNIT_ASSERT(csg->meshEvaluate(32));
+
+    cerr << "MESH CSG PASSED" << endl << endl;
+}
+
+void TestCSG::testSceneFile()
+{
+    SceneParser parser;
+    SceneNode * root;
+    OpNode * diff, * combine;
+    ShapeNode * leaf;
+
+    // the sample scene, with the central sphere placed by a transform
+    std::istringstream sample(
+        "# sample scene\n"
+        "sphere ball 0 0 -2 2 scale 2 translate 0 0 4\n"
+        "cylinder rod -7 -7 0 7 7 0 2   # diagonal\n"
+        "cylinder hole 0 -7 0 0 7 0 2.5\n"
+        "union body ball rod\n"
+        "difference part body hole\n");
+    CPPUNIT_ASSERT(parser.parse(sample, "", root));
+    diff = dynamic_cast<OpNode *>(root);
+    CPPUNIT_ASSERT(diff != NULL && diff->op == SetOp::DIFFERENCE);
+    combine = dynamic_cast<OpNode *>(diff->left);
+    CPPUNIT_ASSERT(combine != NULL && combine->op == SetOp::UNION);
+    leaf = dynamic_cast<ShapeNode *>(combine->left);
+    CPPUNIT_ASSERT(leaf != NULL);
+    Sphere * ball = dynamic_cast<Sphere *>(leaf->shape);
+    CPPUNIT_ASSERT(ball != NULL);
+    CPPUNIT_ASSERT(fabs(ball->r - 4.0f) < 1.0e-5f);
+    CPPUNIT_ASSERT(fabs(ball->c.x) < 1.0e-5f && fabs(ball->c.y) < 1.0e-5f && fabs(ball->c.z) < 1.0e-5f);
+    deleteSceneGraph(root);
+
+    // a named node used twice is shared, unused definitions are dropped and repeated files are read once
+    std::istringstream shared(
+        "mesh bunny \"../meshes/bunny.stl\" fit 10\n"
+        "mesh bunny2 \"../meshes/bunny.stl\" fit 10 translate 1 0 0\n"
+        "cylinder rod -7 -7 0 7 7 0 2\n"
+        "union body bunny rod\n"
+        "difference part body bunny\n"
+        "union spare bunny2 rod\n"
+        "root part\n");
+    CPPUNIT_ASSERT(parser.parse(shared, "", root));
+    diff = dynamic_cast<OpNode *>(root);
+    CPPUNIT_ASSERT(diff != NULL);
+    combine = dynamic_cast<OpNode *>(diff->left);
+    CPPUNIT_ASSERT(combine != NULL && combine->left == diff->right);
+    CPPUNIT_ASSERT(parser.cachedMeshes() == 1);
+    deleteSceneGraph(root);
+
+    // the same file placed in the same way under two names is a single mesh
+    std::istringstream twice(
+        "mesh one \"../meshes/bunny.stl\" fit 10 translate 1 0 0\n"
+        "mesh two \"../meshes/bunny.stl\" fit 10 translate 1 0 0\n"
+        "mesh moved \"../meshes/bunny.stl\" fit 10 translate 2 0 0\n"
+        "union pair one two\n"
+        "union all pair moved\n");
+    CPPUNIT_ASSERT(parser.parse(twice, "", root));
+    combine = dynamic_cast<OpNode *>(dynamic_cast<OpNode *>(root)->left);
+    CPPUNIT_ASSERT(combine != NULL && combine->left == combine->right);
+    CPPUNIT_ASSERT(dynamic_cast<OpNode *>(root)->right != combine->left);
+    deleteSceneGraph(root);
+
+    // malformed descriptions are rejected without leaving a tree behind
+    std::istringstream undefined("sphere a 0 0 0 1\nunion b a c\n");
+    CPPUNIT_ASSERT(!parser.parse(undefined, "", root));
+    CPPUNIT_ASSERT(root == NULL);
+    std::istringstream badradius("sphere a 0 0 0 -1\n");
+    CPPUNIT_ASSERT(!parser.parse(badradius, "", root));
+    std::istringstream redefined("sphere a 0 0 0 1\nsphere a 1 0 0 1\n");
+    CPPUNIT_ASSERT(!parser.parse(redefined, "", root));
+    std::istringstream badclause("cylinder a 0 0 0 1 0 0 1 fit 3\n");
+    CPPUNIT_ASSERT(!parser.parse(badclause, "", root));
+    std::istringstream missing("mesh m \"no_such_file.stl\"\n");
+    CPPUNIT_ASSERT(!parser.parse(missing, "", root));
+
+    cerr << "CSG SCENE FILE PASSED" << endl << endl;
+}
+
+/// Sphere that counts its containment tests
+class CountingSphere: public Sphere
+{
+public:
+    std::atomic<long> tests;    ///< number of calls to pointContainment
+
+    CountingSphere(cgp::Point center, float radius): Sphere(center, radius), tests(0) {}
+
+    bool pointContainment(cgp::Point pnt){ tests++; return Sphere::pointContainment(pnt); }
+};
+
+/// Evaluate a CSG tree at a point by recursing through it as written
+static bool treeContains(SceneNode * node, cgp::Point pnt)
+{
+    if(ShapeNode * leaf = dynamic_cast<ShapeNode *>(node))
+        return leaf->shape->pointContainment(pnt);
+    OpNode * op = dynamic_cast<OpNode *>(node);
+    bool l = treeContains(op->left, pnt), r = treeContains(op->right, pnt);
+    switch(op->op)
+    {
+        case SetOp::UNION:
+            return l || r;
+        case SetOp::INTERSECTION:
+            return l && r;
+        default:
+            return l && !r;
+    }
+}
+
+/**
+ * Compare a sample of voxels against direct evaluation of a CSG tree at their positions
+ * @param vox   voxelised tree
+ * @param root  tree as written
+ * @returns     number of sampled voxels that disagree, or -1 if none of the sampled voxels are inside the tree
+ */
+static int voxelMismatches(VoxelVolume * vox, SceneNode * root)
+{
+    int dx, dy, dz, mismatches = 0, inside = 0;
+
+    vox->getDim(dx, dy, dz);
+    for(int z = 0; z < dz; z += 3)
+        for(int y = 0; y < dy; y += 2)
+            for(int x = 0; x < dx; x++)
+            {
+                bool expected = treeContains(root, vox->getVoxelPos(x, y, z));
+                if(expected)
+                    inside++;
+                if(vox->get(x, y, z) != expected)
+                    mismatches++;
+            }
+    return (inside > 0) ? mismatches : -1;
+}
+
+void TestCSG::testCSGPlan()
+{
+    SceneParser parser;
+    SceneNode * root;
+    CSGPlan plan;
+    cgp::BoundBox region;
+
+    region.min = cgp::Point(-10.0f, -10.0f, -10.0f);
+    region.max = cgp::Point(10.0f, 10.0f, 10.0f);
+
+    // intersection of shapes whose bounds do not meet is empty
+    std::istringstream disjoint("sphere a 0 0 0 1\nsphere b 5 0 0 1\nintersection i a b\n");
+    CPPUNIT_ASSERT(parser.parse(disjoint, "", root));
+    plan.build(root, region);
+    CPPUNIT_ASSERT(plan.getRoot() == NULL);
+    CPPUNIT_ASSERT(plan.getStats().pruned > 0);
+    plan.clear();
+    deleteSceneGraph(root);
+
+    // subtracting a shape that cannot overlap leaves the minuend untouched
+    std::istringstream noop("sphere a 0 0 0 1\nsphere b 5 0 0 1\ndifference d a b\n");
+    CPPUNIT_ASSERT(parser.parse(noop, "", root));
+    plan.build(root, region);
+    CPPUNIT_ASSERT(plan.getRoot() == dynamic_cast<OpNode *>(root)->left);
+    plan.clear();
+    deleteSceneGraph(root);
+
+    // a right-deep chain of unions becomes one n-ary union that needs only two volumes
+    std::istringstream chain(
+        "sphere s1 -4 0 0 1\nsphere s2 -2 0 0 1\nsphere s3 0 0 0 1\nsphere s4 2 0 0 1\nsphere s5 4 0 0 1\n"
+        "union u4 s4 s5\nunion u3 s3 u4\nunion u2 s2 u3\nunion u1 s1 u2\n");
+    CPPUNIT_ASSERT(parser.parse(chain, "", root));
+    plan.build(root, region);
+    NaryOpNode * nary = dynamic_cast<NaryOpNode *>(plan.getRoot());
+    CPPUNIT_ASSERT(nary != NULL && nary->op == SetOp::UNION && nary->children.size() == 5);
+    CPPUNIT_ASSERT(plan.getStats().treevolumes == 5);
+    CPPUNIT_ASSERT(plan.getStats().planvolumes == 2);
+    plan.clear();
+    deleteSceneGraph(root);
+
+    // voxelising the optimised tree agrees with the tree as written
+    const string description =
+        "sphere a 0 0 0 3\n"
+        "sphere b 1 0 0 3\n"
+        "sphere far 9 9 9 0.5\n"
+        "cylinder c -5 0 0 5 0 0 1\n"
+        "sphere d 2 2 0 1.5\n"
+        "sphere e -2 -2 0 1.5\n"
+        "sphere f 0 0 2.5 1\n"
+        "sphere g 6 6 6 1\n"
+        "intersection lens a b\n"
+        "intersection empty lens far\n"
+        "union u1 lens empty\n"
+        "union u2 u1 d\n"
+        "union u3 u2 e\n"
+        "difference cut u3 c\n"
+        "difference cut2 cut g\n"
+        "difference part cut2 f\n";
+    {
+        TempDirectory tmp("csgplan_tmp");
+        std::ofstream out("csgplan_tmp/plan.scene");
+        out << description;
+        out.close();
+        CPPUNIT_ASSERT(csg->loadScene("csgplan_tmp/plan.scene"));
+    }
+    std::istringstream in(description);
+    CPPUNIT_ASSERT(parser.parse(in, "", root));
+    csg->voxelise(0.2f);
+
+    CPPUNIT_ASSERT(voxelMismatches(csg->getVox(), root) == 0);
+    deleteSceneGraph(root);
+
+    cerr << "CSG PLAN PASSED" << endl << endl;
+}
+
+void TestCSG::testSharedSubtrees()
+{
+    SceneParser parser;
+    SceneNode * root;
+    CSGPlan plan;
+    cgp::BoundBox region;
+
+    region.min = cgp::Point(-10.0f, -10.0f, -10.0f);
+    region.max = cgp::Point(10.0f, 10.0f, 10.0f);
+
+    // a shape and an operation each used by two parents stay shared in the plan
+    std::istringstream in(
+        "sphere a 0 0 0 3\n"
+        "cylinder c -5 0 0 5 0 0 1\n"
+        "sphere d 2 2 0 1.5\n"
+        "union body a d\n"
+        "difference cut body c\n"
+        "intersection core cut a\n"
+        "sphere e -2 -2 0 2\n"
+        "union ring core e\n"
+        "difference part ring d\n"
+        "intersection left cut e\n"
+        "union all part left\n");
+    CPPUNIT_ASSERT(parser.parse(in, "", root));
+    plan.build(root, region);
+    CPPUNIT_ASSERT(plan.getRoot() != NULL);
+    CPPUNIT_ASSERT(plan.getStats().shared >= 2);
+    plan.clear();
+
+    // voxelising the shared graph gives the same result as the tree as written
+    csg->clear();
+    csg->csgroot = root;
+    csg->voxelise(0.2f);
+    CPPUNIT_ASSERT(voxelMismatches(csg->getVox(), root) == 0);
+
+    // a shape used on both sides of a difference is voxelised once
+    CountingSphere * ball = new CountingSphere(cgp::Point(1.0f, 0.0f, 0.0f), 3.0f);
+    ShapeNode * shared = new ShapeNode();
+    shared->shape = ball;
+    ShapeNode * rod = new ShapeNode();
+    rod->shape = new Cylinder(cgp::Point(-7.0f, -7.0f, 0.0f), cgp::Point(7.0f, 7.0f, 0.0f), 2.0f);
+    OpNode * combine = new OpNode();
+    combine->op = SetOp::UNION;
+    combine->left = shared;
+    combine->right = rod;
+    OpNode * diff = new OpNode();
+    diff->op = SetOp::DIFFERENCE;
+    diff->left = combine;
+    diff->right = shared;
+
+    csg->clear();
+    csg->csgroot = diff;
+    csg->voxelise(0.2f);
+    long once = ball->tests;
+    csg->clear();
+
+    // control with the same bounds, so that the volume is the same
+    CountingSphere * single = new CountingSphere(cgp::Point(1.0f, 0.0f, 0.0f), 3.0f);
+    ShapeNode * alone = new ShapeNode();
+    alone->shape = single;
+    ShapeNode * rod2 = new ShapeNode();
+    rod2->shape = new Cylinder(cgp::Point(-7.0f, -7.0f, 0.0f), cgp::Point(7.0f, 7.0f, 0.0f), 2.0f);
+    OpNode * control = new OpNode();
+    control->op = SetOp::UNION;
+    control->left = alone;
+    control->right = rod2;
+    csg->csgroot = control;
+    csg->voxelise(0.2f);
+    CPPUNIT_ASSERT(once > 0);
+    CPPUNIT_ASSERT(once == (long) single->tests);
+    csg->clear();
+
+    cerr << "CSG SHARED SUBTREES PASSED" << endl << endl;
+}
+
+void TestCSG::testRevoxelise()
+{
+    SceneParser parser;
+    SceneNode * root;
+    int dx, dy, dz, ex, ey, ez, x, y, z;
+
+    // a scene with a shape far from the edits, which should not be revisited
+    std::istringstream in(
+        "sphere ball 1 -2 -2 3\n"
+        "cylinder rod -7 -7 0 7 7 0 2\n"
+        "sphere hole -1 1 0 1.5\n"
+        "union body ball rod\n"
+        "difference part body hole\n");
+    CPPUNIT_ASSERT(parser.parse(in, "", root));
+    CountingSphere * far = new CountingSphere(cgp::Point(6.0f, -6.0f, 6.0f), 1.5f);
+    ShapeNode * farnode = new ShapeNode();
+    farnode->shape = far;
+    OpNode * combine = new OpNode();
+    combine->op = SetOp::UNION;
+    combine->left = root;
+    combine->right = farnode;
+    csg->clear();
+    csg->csgroot = combine;
+    csg->voxelise(0.2f);
+    CPPUNIT_ASSERT(far->tests > 0);
+
+    // move and grow the ball within the extent of the scene, shrink the hole
+    OpNode * diff = dynamic_cast<OpNode *>(root);
+    ShapeNode * ballnode = dynamic_cast<ShapeNode *>(dynamic_cast<OpNode *>(diff->left)->left);
+    ShapeNode * holenode = dynamic_cast<ShapeNode *>(diff->right);
+    Sphere * ball = dynamic_cast<Sphere *>(ballnode->shape);
+    Sphere * hole = dynamic_cast<Sphere *>(holenode->shape);
+    ball->c = cgp::Point(-1.0f, -1.0f, -1.5f);
+    ball->r = 3.5f;
+    hole->r = 0.75f;
+    csg->markDirty(ballnode);
+    csg->markDirty(holenode);
+    long before = far->tests;
+    csg->getVox()->getDim(dx, dy, dz);
+    csg->revoxelise();
+    CPPUNIT_ASSERT(far->tests == before);
+
+    // the patched volume matches the edited tree
+    csg->getVox()->getDim(ex, ey, ez);
+    CPPUNIT_ASSERT(ex == dx && ey == dy && ez == dz);
+    CPPUNIT_ASSERT(voxelMismatches(csg->getVox(), combine) == 0);
+
+    // moving a shape beyond the volume refits it to the tree
+    far->c = cgp::Point(10.0f, -6.0f, 6.0f);
+    csg->markDirty(farnode);
+    csg->revoxelise();
+    csg->getVox()->getDim(ex, ey, ez);
+    CPPUNIT_ASSERT(ex >= dx && ey == dy && ez == dz);
+    CPPUNIT_ASSERT(csg->getVox()->getVoxelIndex(cgp::Point(11.4f, -6.0f, 6.0f), x, y, z) && csg->getVox()->get(x, y, z));
+    CPPUNIT_ASSERT(voxelMismatches(csg->getVox(), combine) == 0);
+    csg->clear();
+
+    cerr << "CSG REVOXELISE PASSED" << endl << endl;
+}
+
+void TestCSG::testIsoChunks()
+{
+    Mesh whole;
+    Scene fresh;
+    int redone;
+
+    // stitched chunks match marching cubes over the whole volume
+    csg->clear();
+    csg->sampleScene();
+    csg->voxelise(0.1f);
+    csg->isoextract();
+    whole.marchingCubes(* csg->getVox());
+    CPPUNIT_ASSERT(csg->isochunks.numChunks() > 8);
+    CPPUNIT_ASSERT(csg->getIsosurface()->getVerts().size() == whole.getVerts().size());
+    CPPUNIT_ASSERT(csg->getIsosurface()->getTris().size() == whole.getTris().size());
+    CPPUNIT_ASSERT(csg->isochunks.numTris() == (int) whole.getTris().size());
+
+    // the current chunks stay in place while new ones are extracted, after which they are reused, along with any
+    // buffers they hold, by the extraction after next
+    std::set<IsoChunk *> first(csg->isochunks.chunks.begin(), csg->isochunks.chunks.end());
+    csg->isochunks.extract(* csg->getVox());
+    csg->isochunks.extract(* csg->getVox());
+    for(IsoChunk * chunk: csg->isochunks.chunks)
+        CPPUNIT_ASSERT(first.count(chunk) == 1);
+    CPPUNIT_ASSERT(csg->isochunks.numTris() == (int) whole.getTris().size());
+
+    // nudge the central sphere within the extent of the scene, then patch voxels and surface
+    OpNode * diff = dynamic_cast<OpNode *>(csg->csgroot);
+    ShapeNode * ballnode = dynamic_cast<ShapeNode *>(dynamic_cast<OpNode *>(diff->left)->left);
+    Sphere * ball = dynamic_cast<Sphere *>(ballnode->shape);
+    CPPUNIT_ASSERT(ball != NULL);
+    ball->c.x += 0.3f;
+    csg->markDirty(ballnode);
+    csg->revoxelise();
+    redone = csg->isochunks.update(* csg->getVox(), csg->changed);
+    CPPUNIT_ASSERT(redone > 0 && redone < csg->isochunks.numChunks());
+    csg->isochunks.assemble(* csg->getIsosurface());
+
+    // the patched surface matches one extracted from scratch
+    fresh.sampleScene();
+    OpNode * fdiff = dynamic_cast<OpNode *>(fresh.csgroot);
+    dynamic_cast<Sphere *>(dynamic_cast<ShapeNode *>(dynamic_cast<OpNode *>(fdiff->left)->left)->shape)->c.x += 0.3f;
+    fresh.voxelise(0.1f);
+    fresh.isoextract();
+    CPPUNIT_ASSERT(csg->getIsosurface()->getVerts().size() == fresh.getIsosurface()->getVerts().size());
+    CPPUNIT_ASSERT(csg->getIsosurface()->getTris().size() == fresh.getIsosurface()->getTris().size());
+
+    // the scene level update does the same
+    csg->isoupdate();
+    CPPUNIT_ASSERT(csg->getIsosurface()->getTris().size() == fresh.getIsosurface()->getTris().size());
+    csg->clear();
+
+    cerr << "CSG ISOSURFACE CHUNKS PASSED" << endl << endl;
+}
+
+void TestCSG::testResultCache()
+{
+    TempDirectory tmp("resultcache_test");
+    ResultCache cache;
+    Scene first, second, edited;
+    int dx, dy, dz, mismatches = 0;
+
+    CPPUNIT_ASSERT(cache.open("resultcache_test", (std::uintmax_t) 1 << 30));
+
+    // the first run computes and stores both results
+    first.setCache(&cache);
+    first.sampleScene();
+    first.voxelise(0.2f);
+    first.isoextract();
+    CPPUNIT_ASSERT(cache.numHits() == 0 && cache.numMisses() == 2);
+
+    // an identical scene in another run reads them back
+    second.setCache(&cache);
+    second.sampleScene();
+    second.voxelise(0.2f);
+    CPPUNIT_ASSERT(cache.numHits() == 1);
+    first.getVox()->getDim(dx, dy, dz);
+    for(int z = 0; z < dz; z++)
+        for(int y = 0; y < dy; y++)
+            for(int x = 0; x < dx; x++)
+                if(first.getVox()->get(x, y, z) != second.getVox()->get(x, y, z))
+                    mismatches++;
+    CPPUNIT_ASSERT(mismatches == 0);
+    CPPUNIT_ASSERT(second.getVox()->getVoxelPos(dx-1, dy-1, dz-1) == first.getVox()->getVoxelPos(dx-1, dy-1, dz-1));
+    second.isoextract();
+    CPPUNIT_ASSERT(cache.numHits() == 2);
+    CPPUNIT_ASSERT(second.getIsosurface()->getVerts().size() == first.getIsosurface()->getVerts().size());
+    CPPUNIT_ASSERT(second.getIsosurface()->getTris().size() == first.getIsosurface()->getTris().size());
+
+    // a changed parameter or voxel size gives a new key
+    edited.sampleScene();
+    std::uint64_t key = cache.sceneKey(edited.csgroot, 0.2f);
+    CPPUNIT_ASSERT(key == cache.sceneKey(first.csgroot, 0.2f));
+    CPPUNIT_ASSERT(key != cache.sceneKey(edited.csgroot, 0.1f));
+    OpNode * diff = dynamic_cast<OpNode *>(edited.csgroot);
+    dynamic_cast<Sphere *>(dynamic_cast<ShapeNode *>(dynamic_cast<OpNode *>(diff->left)->left)->shape)->r += 0.01f;
+    CPPUNIT_ASSERT(key != cache.sceneKey(edited.csgroot, 0.2f));
+
+    // so does the same mesh placed differently
+    ShapeNode placed;
+    Mesh * ball = new Mesh();
+    ball->buildSphere(cgp::Point(0.0f, 0.0f, 0.0f), 1.0f, 16, 8);
+    placed.shape = ball;
+    std::uint64_t meshkey = cache.sceneKey(&placed, 0.2f);
+    ball->setTranslation(cgp::Vector(1.0f, 0.0f, 0.0f));
+    std::uint64_t movedkey = cache.sceneKey(&placed, 0.2f);
+    CPPUNIT_ASSERT(movedkey != meshkey);
+    ball->setRotations(0.0f, 90.0f, 0.0f);
+    CPPUNIT_ASSERT(cache.sceneKey(&placed, 0.2f) != movedkey);
+    ball->setRotations(0.0f, 0.0f, 0.0f);
+    ball->setScale(2.0f);
+    CPPUNIT_ASSERT(cache.sceneKey(&placed, 0.2f) != movedkey);
+
+    // patched voxels are not looked up
+    edited.setCache(&cache);
+    edited.voxelise(0.2f);
+    CPPUNIT_ASSERT(cache.numMisses() == 3);
+    edited.markDirty(dynamic_cast<OpNode *>(diff->left)->left);
+    edited.revoxelise();
+    edited.isoextract();
+    CPPUNIT_ASSERT(cache.numMisses() == 3 && cache.numHits() == 2);
+
+    // a cap too small for any entry empties the cache
+    ResultCache small;
+    CPPUNIT_ASSERT(small.open("resultcache_test", 1));
+    VoxelVolume unused;
+    CPPUNIT_ASSERT(!small.loadVoxels(key, unused));
+
+    cerr << "CSG RESULT CACHE PASSED" << endl << endl;
+}
+
+void TestCSG::testProgress()
+{
+    StageProgress progress;
+    ShapeGeometry packed;
+    int dx, dy, dz, cx, cy, cz, chunks, mismatches = 0;
+    size_t tris;
+
+    csg->clear();
+    csg->sampleScene();
+    csg->setProgress(&progress);
+
+    // a completed stage reports all of its work
+    CPPUNIT_ASSERT(csg->voxelise(0.2f));
+    CPPUNIT_ASSERT(progress.fraction() == 1.0f);
+    CPPUNIT_ASSERT(csg->isoextract());
+    CPPUNIT_ASSERT(progress.fraction() == 1.0f);
+    VoxelVolume before(* csg->getVox());
+    before.getDim(dx, dy, dz);
+    chunks = csg->isochunks.numChunks();
+    tris = csg->getIsosurface()->getTris().size();
+
+    // cancelled stages do no work and leave the voxels, chunks and surface as they were
+    progress.reset();
+    progress.cancel();
+    CPPUNIT_ASSERT(!csg->voxelise(0.1f));
+    CPPUNIT_ASSERT(progress.fraction() < 1.0f);
+    CPPUNIT_ASSERT(!csg->isoextract());
+    CPPUNIT_ASSERT(csg->rep == SceneRep::ISOSURFACE);
+    csg->getVox()->getDim(cx, cy, cz);
+    CPPUNIT_ASSERT(cx == dx && cy == dy && cz == dz);
+    for(int z = 0; z < dz; z++)
+        for(int y = 0; y < dy; y++)
+            for(int x = 0; x < dx; x++)
+                if(csg->getVox()->get(x, y, z) != before.get(x, y, z))
+                    mismatches++;
+    CPPUNIT_ASSERT(mismatches == 0);
+    CPPUNIT_ASSERT(csg->isochunks.numChunks() == chunks);
+    CPPUNIT_ASSERT(csg->getIsosurface()->getTris().size() == tris);
+    CPPUNIT_ASSERT(csg->voxsidelen == 0.2f);
+
+    // the scene runs as normal once the request is cleared
+    progress.reset();
+    CPPUNIT_ASSERT(csg->voxelise(0.2f));
+    CPPUNIT_ASSERT(csg->rep == SceneRep::VOXELS);
+    CPPUNIT_ASSERT(csg->isoextract());
+    CPPUNIT_ASSERT(csg->getIsosurface()->getTris().size() == tris);
+    csg->genGeometry(&packed);
+    CPPUNIT_ASSERT((int) packed.getDrawParameters().indexBufSize == 3 * (int) tris);
+
+    csg->setProgress(NULL);
+    csg->clear();
+
+    cerr << "CSG PROGRESS PASSED" << endl << endl;
+}
+
 //#if 0 /* Disabled since it crashes the whole test suite */
 CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(TestCSG, TestSet::perBuild());
 //#endif
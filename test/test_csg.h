@@ -4,13 +4,27 @@
 
 #include <string>
 #include <cppunit/extensions/HelperMacros.h>
+#define private public
 #include "tesselate/csg.h"
+#undef private
+#include "tesselate/meshcsg.h"
+#include "tesselate/sceneparser.h"
+#include "tesselate/csgplan.h"
+#include "tesselate/resultcache.h"
 
 /// Test code for @ref VoxelVolume
 class TestCSG : public CppUnit::TestFixture
 {
     CPPUNIT_TEST_SUITE(TestCSG);
     CPPUNIT_TEST(testSimpleCSG);
+    CPPUNIT_TEST(testMeshCSG);
+    CPPUNIT_TEST(testSceneFile);
+    CPPUNIT_TEST(testCSGPlan);
+    CPPUNIT_TEST(testSharedSubtrees);
+    CPPUNIT_TEST(testRevoxelise);
+    CPPUNIT_TEST(testIsoChunks);
+    CPPUNIT_TEST(testResultCache);
+    CPPUNIT_TEST(testProgress);
     CPPUNIT_TEST_SUITE_END();
 
 private:
@@ -28,6 +42,50 @@ public:
      * Run simple set and get validity tests on voxels
      */
     void testSimpleCSG();
+
+    /**
+     * Check mesh boolean operations on two overlapping spheres against volume identities and winding numbers
+     */
+    void testMeshCSG();
+
+    /**
+     * Parse scene descriptions, checking node sharing, the mesh cache and rejection of malformed input
+     */
+    void testSceneFile();
+
+    /**
+     * Check pruning, flattening and reordering by the tree optimiser, and that voxelising the optimised tree matches
+     * direct evaluation of the tree as written
+     */
+    void testCSGPlan();
+
+    /**
+     * Check that subtrees shared by several parents are evaluated once and give the same voxels as the tree as written
+     */
+    void testSharedSubtrees();
+
+    /**
+     * Edit shapes after voxelising and check that patching the affected region matches a full voxelisation
+     */
+    void testRevoxelise();
+
+    /**
+     * Check that the chunked isosurface stitches into the same surface as whole volume marching cubes, and that a local
+     * edit re-extracts only nearby chunks
+     */
+    void testIsoChunks();
+
+    /**
+     * Check that voxel volumes and isosurfaces are read back from the cache for an identical scene, but not for an
+     * edited one, and that entries are evicted beyond the size cap
+     */
+    void testResultCache();
+
+    /**
+     * Check that stages report their progress, that cancelled stages leave the scene as it was, and
+     * that the geometry packed for drawing follows the representation
+     */
+    void testProgress();
 };
 
 #endif /* !TILER_TEST_CSG_H */
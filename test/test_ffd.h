@@ -12,6 +12,9 @@ class TestFFD : public CppUnit::TestFixture
     CPPUNIT_TEST_SUITE(TestFFD);
     CPPUNIT_TEST(testApplyUndeformedLattice);
     CPPUNIT_TEST(testApplyDeformedLattice);
+    CPPUNIT_TEST(testBatchDeform);
+    CPPUNIT_TEST(testBSplineLattice);
+    CPPUNIT_TEST(testJacobianNormals);
     CPPUNIT_TEST_SUITE_END();
 
 private:
@@ -34,6 +37,21 @@ public:
      * Tests that applying a deformed lattice moves the point correctly
      */
     void testApplyDeformedLattice();
+
+    /**
+     * Tests that batched deformation matches single point deformation, and is the identity on an undeformed lattice
+     */
+    void testBatchDeform();
+
+    /**
+     * Tests that a large B-spline lattice is the identity when undeformed and has local support when deformed
+     */
+    void testBSplineLattice();
+
+    /**
+     * Test that normals carried through the deformation Jacobian match affine maps exactly and finite differences otherwise
+     */
+    void testJacobianNormals();
 };
 
 #endif /* !TILER_TEST_FFD_H */
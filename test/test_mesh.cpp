@@ -4,6 +4,7 @@
 
 #include <test/testutil.h>
 #include "test_mesh.h"
+#include "tesselate/vcache.h"
 #include <stdio.h>
 #include <cstdint>
 #include <sstream>
@@ -59,15 +60,94 @@ void TestMesh::testMeshing()
 
 }
 
+void TestMesh::testManifoldReport()
+{
+    ManifoldReport report;
+
+    mesh->validTetTest();
+    CPPUNIT_ASSERT(mesh->manifoldCheck(report));
+
+    // flipping one triangle misorients all three of its edges
+    std::swap(mesh->tris[0].v[1], mesh->tris[0].v[2]);
+    mesh->topologyChanged();
+    CPPUNIT_ASSERT(!mesh->manifoldCheck(report));
+    CPPUNIT_ASSERT(report.misorientededges.size() == 3);
+    CPPUNIT_ASSERT(report.nonmanifoldedges.empty());
+    CPPUNIT_ASSERT(report.boundaryloops.empty());
+
+    // a missing side leaves a single triangular hole
+    mesh->openTetTest();
+    CPPUNIT_ASSERT(!mesh->manifoldCheck(report));
+    CPPUNIT_ASSERT(report.boundaryloops.size() == 1);
+    CPPUNIT_ASSERT(report.boundaryloops[0].size() == 3);
+    CPPUNIT_ASSERT(report.misorientededges.empty());
+
+    // two tetrahedra that touch at a point are pinched at the shared vertex only
+    mesh->touchTetsTest();
+    CPPUNIT_ASSERT(!mesh->manifoldCheck(report));
+    CPPUNIT_ASSERT(report.nonmanifoldverts.size() == 1);
+    CPPUNIT_ASSERT(report.nonmanifoldverts[0] == 3);
+    CPPUNIT_ASSERT(report.nonmanifoldedges.empty());
+
+    // every triangle doubled, so every edge has four incident triangles
+    mesh->overlapTetTest();
+    CPPUNIT_ASSERT(!mesh->manifoldCheck(report));
+    CPPUNIT_ASSERT(report.duplicatetris.size() == 4);
+    CPPUNIT_ASSERT(report.duplicatetris[0] == std::make_pair(0, 1));
+    CPPUNIT_ASSERT(report.nonmanifoldedges.size() == 6);
+
+    cerr << "MANIFOLD REPORT PASSED" << endl << endl;
+}
+
+void TestMesh::testSelfIntersections()
+{
+    std::vector<std::pair<int, int>> pairs;
+    Triangle t;
+
+    // a closed tetrahedron does not intersect itself, since neighbouring faces are excluded
+    mesh->validTetTest();
+    mesh->selfIntersections(pairs);
+    CPPUNIT_ASSERT(pairs.empty());
+
+    // free-standing triangles: 0 in the z = 0 plane, 1 crossing it at x = 0.5, 2 far away and 3 coplanar with and overlapping 0
+    mesh->clear();
+    mesh->verts = {
+        cgp::Point(0.0f, 0.0f, 0.0f), cgp::Point(2.0f, 0.0f, 0.0f), cgp::Point(0.0f, 2.0f, 0.0f),
+        cgp::Point(0.5f, 0.5f, -1.0f), cgp::Point(0.5f, 0.5f, 1.0f), cgp::Point(0.5f, -1.0f, 0.0f),
+        cgp::Point(5.0f, 5.0f, 5.0f), cgp::Point(6.0f, 5.0f, 5.0f), cgp::Point(5.0f, 6.0f, 5.0f),
+        cgp::Point(0.2f, 0.2f, 0.0f), cgp::Point(3.0f, 0.2f, 0.0f), cgp::Point(0.2f, 3.0f, 0.0f)
+    };
+    for(int i = 0; i < 4; i++)
+    {
+        t.v[0] = 3*i; t.v[1] = 3*i+1; t.v[2] = 3*i+2;
+        mesh->tris.push_back(t);
+    }
+    mesh->selfIntersections(pairs);
+    CPPUNIT_ASSERT(pairs.size() == 3);
+    CPPUNIT_ASSERT(pairs[0] == std::make_pair(0, 1));
+    CPPUNIT_ASSERT(pairs[1] == std::make_pair(0, 3));
+    CPPUNIT_ASSERT(pairs[2] == std::make_pair(1, 3));
+
+    // lifting the crossing triangle clear of the plane removes its intersections
+    for(int i = 3; i < 6; i++)
+        mesh->verts[i].z += 2.0f;
+    mesh->selfIntersections(pairs);
+    CPPUNIT_ASSERT(pairs.size() == 1);
+    CPPUNIT_ASSERT(pairs[0] == std::make_pair(0, 3));
+
+    cerr << "MESH SELF INTERSECTION PASSED" << endl << endl;
+}
+
 void TestMesh::testSmoothing(){
     // set up a valid tetrahedron to test smoothing on
     mesh->validTetTest();
 
+    // every vertex neighbours all others, so Jacobi iterations collapse the tetrahedron onto its centroid
     std::vector<cgp::Point> expected_smoothed_verts = {
-        cgp::Point(0.5f, 0.5f, 0.33f),
-        cgp::Point(0.5f, 0.5f, 0.33f),
-        cgp::Point(0.5f, 0.5f, 0.33f),
-        cgp::Point(0.5f, 0.5f, 0.33f)
+        cgp::Point(0.5f, 0.25f, 0.25f),
+        cgp::Point(0.5f, 0.25f, 0.25f),
+        cgp::Point(0.5f, 0.25f, 0.25f),
+        cgp::Point(0.5f, 0.25f, 0.25f)
     };
 
     mesh->laplacianSmooth(6, 1); //apply the smoothing
@@ -82,6 +162,83 @@ void TestMesh::testSmoothing(){
     cerr << "MESH SMOOTHING PASSED" << endl << endl;
 }
 
+/**
+ * Extract the staircased isosurface of a voxelised sphere centred on the origin, with voxels of unit size
+ * @param mesh      mesh to replace with the isosurface
+ * @param radius    sphere radius in voxels
+ * @param dim       number of voxels along each side of the volume
+ */
+static void marchSphere(Mesh * mesh, float radius, int dim)
+{
+    VoxelVolume vox(dim, dim, dim, cgp::Point(-0.5f * dim, -0.5f * dim, -0.5f * dim), cgp::Vector(dim, dim, dim));
+
+    vox.fill(false);
+    for(int x = 0; x < dim; x++)
+        for(int y = 0; y < dim; y++)
+            for(int z = 0; z < dim; z++)
+            {
+                cgp::Point p = vox.getVoxelPos(x, y, z);
+                if(p.x*p.x + p.y*p.y + p.z*p.z < radius*radius)
+                    vox.set(x, y, z, true);
+            }
+    mesh->marchingCubes(vox);
+}
+
+void TestMesh::testTaubinSmoothing(){
+    // voxelise a sphere of radius 8 voxels and extract its staircased isosurface
+    float voxlen = 1.0f, radius = 8.0f;
+    int dim = 24;
+    marchSphere(mesh, radius, dim);
+    CPPUNIT_ASSERT(!mesh->verts.empty());
+    std::vector<cgp::Point> original = mesh->verts.toVector();
+
+    // mean distance of the vertices from the centroid of the extracted surface
+    cgp::Point c(0.0f, 0.0f, 0.0f);
+    for(const cgp::Point & p: original){
+        c.x += p.x; c.y += p.y; c.z += p.z;
+    }
+    c.x /= (float) original.size(); c.y /= (float) original.size(); c.z /= (float) original.size();
+    auto meanRadius = [&c](const std::vector<cgp::Point> & pnts){
+        double sum = 0.0;
+        for(const cgp::Point & p: pnts)
+            sum += sqrt((p.x-c.x)*(p.x-c.x) + (p.y-c.y)*(p.y-c.y) + (p.z-c.z)*(p.z-c.z));
+        return sum / (double) pnts.size();
+    };
+    double before = meanRadius(original);
+
+    mesh->laplacianSmooth(6, 1.0f);
+    double laplacian = meanRadius(mesh->verts.toVector());
+
+    mesh->verts = original;
+    mesh->taubinSmooth(3, 0.6307f, -0.6732f);
+    double taubin = meanRadius(mesh->verts.toVector());
+
+    // plain smoothing shrinks the sphere, whereas Taubin smoothing should largely preserve its size
+    CPPUNIT_ASSERT(laplacian < before);
+    CPPUNIT_ASSERT(fabs(taubin - before) < fabs(laplacian - before));
+    CPPUNIT_ASSERT(fabs(taubin - before) < 0.1 * voxlen);
+
+    cerr << "MESH TAUBIN SMOOTHING PASSED" << endl << endl;
+}
+
+void TestMesh::testImplicitSmoothing(){
+    // on a tetrahedron the umbrella operator scales offsets from the centroid by 4/3, so a backward Euler
+    // step with lambda = 3 shrinks every vertex towards the centroid by a factor of 1 + 4 = 5
+    mesh->validTetTest();
+    std::vector<cgp::Point> original = mesh->verts.toVector();
+    cgp::Point centroid(0.5f, 0.25f, 0.25f);
+
+    CPPUNIT_ASSERT(mesh->implicitSmooth(3.0f, 50, 1.0e-8f));
+
+    for(int i = 0; i < (int) mesh->verts.size(); i++){
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(centroid.x + (original[i].x - centroid.x) / 5.0f, mesh->verts[i].x, 0.0001f);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(centroid.y + (original[i].y - centroid.y) / 5.0f, mesh->verts[i].y, 0.0001f);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(centroid.z + (original[i].z - centroid.z) / 5.0f, mesh->verts[i].z, 0.0001f);
+    }
+
+    cerr << "MESH IMPLICIT SMOOTHING PASSED" << endl << endl;
+}
+
 void TestMesh::testMarchingCubes(){
     // set up a voxelVolume with only voxel at (0,0,0) set to true
     float voxlen = 5.0f;
@@ -106,6 +263,406 @@ void TestMesh::testMarchingCubes(){
     cerr << "MESH MARCHING CUBES PASSED" << endl << endl;
 }
 
+void TestMesh::testBoxFit(){
+    // the tetrahedron spans a unit cube, so fitting it to a cube of side 4 doubles it about the origin
+    mesh->validTetTest();
+    mesh->boxFit(4.0f);
+
+    cgp::BoundBox bbox = mesh->verts.bounds();
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-2.0f, bbox.min.x, 0.0001f);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-2.0f, bbox.min.y, 0.0001f);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-2.0f, bbox.min.z, 0.0001f);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(2.0f, bbox.max.x, 0.0001f);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(2.0f, bbox.max.y, 0.0001f);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(2.0f, bbox.max.z, 0.0001f);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(2.0f, mesh->verts[2].x, 0.0001f);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(2.0f, mesh->verts[2].z, 0.0001f);
+
+    // face normals of the base still point downwards after the scaled copy
+    mesh->deriveFaceNorms();
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(-1.0f, mesh->tris[0].n.j, 0.0001f);
+
+    cerr << "MESH BOX FIT PASSED" << endl << endl;
+}
+
+void TestMesh::testUpdateNormals(){
+    // two tetrahedra joined at a vertex, so moving a base corner of the second leaves the first untouched
+    mesh->touchTetsTest();
+    mesh->deriveFaceNorms();
+    mesh->deriveVertNorms();
+    CPPUNIT_ASSERT(mesh->norms.size() == mesh->verts.size());
+
+    // normals do not accumulate over repeated derivations
+    mesh->deriveVertNorms();
+    CPPUNIT_ASSERT(mesh->norms.size() == mesh->verts.size());
+
+    int corner = 6;
+    cgp::Vector before = mesh->norms[0];
+    mesh->verts[corner].y += 1.5f;
+    mesh->verts[corner].x += 0.5f;
+    mesh->updateNormals(std::vector<int>(1, corner));
+    VectorArray incremental = mesh->norms;
+    std::vector<Triangle> incrementaltris = mesh->tris;
+
+    // incremental results must match a full recomputation
+    mesh->deriveFaceNorms();
+    mesh->deriveVertNorms();
+    for(int t = 0; t < (int) mesh->tris.size(); t++){
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(mesh->tris[t].n.i, incrementaltris[t].n.i, 0.0001f);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(mesh->tris[t].n.j, incrementaltris[t].n.j, 0.0001f);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(mesh->tris[t].n.k, incrementaltris[t].n.k, 0.0001f);
+    }
+    for(int v = 0; v < (int) mesh->verts.size(); v++){
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(mesh->norms[v].i, incremental[v].i, 0.0001f);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(mesh->norms[v].j, incremental[v].j, 0.0001f);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(mesh->norms[v].k, incremental[v].k, 0.0001f);
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(before.i, incremental[0].i, 0.0001f);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(before.j, incremental[0].j, 0.0001f);
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(before.k, incremental[0].k, 0.0001f);
+
+    cerr << "MESH INCREMENTAL NORMALS PASSED" << endl << endl;
+}
+
+void TestMesh::testAdjacency(){
+    // every vertex of a tetrahedron neighbours the other three and lies on three faces
+    mesh->validTetTest();
+    const MeshAdjacency & adj = mesh->getAdjacency();
+    CPPUNIT_ASSERT(adj.numVerts() == 4);
+    for(int v = 0; v < 4; v++){
+        CPPUNIT_ASSERT(adj.numNeighbours(v) == 3);
+        CPPUNIT_ASSERT(adj.numIncident(v) == 3);
+        for(int n = 0; n < adj.numNeighbours(v); n++)
+            CPPUNIT_ASSERT(adj.neighbours(v)[n] != v);
+    }
+
+    // rebuilding for a new mesh picks up the pinch vertex shared by both tetrahedra
+    mesh->touchTetsTest();
+    const MeshAdjacency & touchadj = mesh->getAdjacency();
+    CPPUNIT_ASSERT(touchadj.numVerts() == 7);
+    CPPUNIT_ASSERT(touchadj.numNeighbours(3) == 6);
+    CPPUNIT_ASSERT(touchadj.numIncident(3) == 6);
+    CPPUNIT_ASSERT(touchadj.numNeighbours(0) == 3);
+
+    cerr << "MESH ADJACENCY PASSED" << endl << endl;
+}
+
+void TestMesh::testIncrementalFFD(){
+    // voxelised sphere filling most of a B-spline lattice, so that each control point only reaches part of it
+    float radius = 8.0f;
+    int dim = 24;
+    marchSphere(mesh, radius, dim);
+    CPPUNIT_ASSERT(!mesh->verts.empty());
+    std::vector<cgp::Point> rest = mesh->verts.toVector();
+
+    ffd bspline(7, 7, 7, cgp::Point(-10.0f, -10.0f, -10.0f), cgp::Vector(20.0f, 20.0f, 20.0f), FFDBasis::BSPLINE);
+    cgp::Point target = bspline.getCP(2, 3, 4);
+    target.x += 3.0f; target.y -= 2.0f; target.z += 1.0f;
+    CPPUNIT_ASSERT(mesh->moveFFDControlPoint(&bspline, 2, 3, 4, target));
+    CPPUNIT_ASSERT(mesh->boundToFFD(&bspline));
+
+    // vertices outside the support of the control point are left exactly where they were
+    int untouched = 0;
+    for(int v = 0; v < (int) rest.size(); v++)
+        if(mesh->verts.xs()[v] == rest[v].x && mesh->verts.ys()[v] == rest[v].y && mesh->verts.zs()[v] == rest[v].z)
+            untouched++;
+    CPPUNIT_ASSERT(untouched > (int) rest.size() / 2);
+
+    target = bspline.getCP(4, 4, 4);
+    target.z -= 4.0f;
+    CPPUNIT_ASSERT(mesh->moveFFDControlPoint(&bspline, 4, 4, 4, target));
+    CPPUNIT_ASSERT(!mesh->moveFFDControlPoint(&bspline, 7, 0, 0, target));
+
+    // the accumulated edits must match a full deformation of the original vertices
+    std::vector<cgp::Point> full = rest;
+    bspline.deform(full.data(), full.size());
+    for(int v = 0; v < (int) full.size(); v++){
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(full[v].x, mesh->verts[v].x, 0.0001f);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(full[v].y, mesh->verts[v].y, 0.0001f);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(full[v].z, mesh->verts[v].z, 0.0001f);
+    }
+
+    // any other vertex edit drops the binding, and changing the lattice layout invalidates it
+    mesh->laplacianSmooth(1, 0.5f);
+    CPPUNIT_ASSERT(!mesh->boundToFFD(&bspline));
+    CPPUNIT_ASSERT(mesh->moveFFDControlPoint(&bspline, 0, 0, 0, bspline.getCP(0, 0, 0)));
+    CPPUNIT_ASSERT(mesh->boundToFFD(&bspline));
+    bspline.setDim(5, 5, 5);
+    CPPUNIT_ASSERT(!mesh->boundToFFD(&bspline));
+
+    // the global Bezier basis moves every vertex but gives the same result as a full deformation
+    rest = mesh->verts.toVector();
+    ffd bezier(4, 4, 4, cgp::Point(-10.0f, -10.0f, -10.0f), cgp::Vector(20.0f, 20.0f, 20.0f));
+    target = bezier.getCP(1, 2, 3);
+    target.y += 5.0f;
+    CPPUNIT_ASSERT(mesh->moveFFDControlPoint(&bezier, 1, 2, 3, target));
+    full = rest;
+    bezier.deform(full.data(), full.size());
+    for(int v = 0; v < (int) full.size(); v++){
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(full[v].x, mesh->verts[v].x, 0.0001f);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(full[v].y, mesh->verts[v].y, 0.0001f);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(full[v].z, mesh->verts[v].z, 0.0001f);
+    }
+
+    cerr << "MESH INCREMENTAL FFD PASSED" << endl << endl;
+}
+
+void TestMesh::testFollowFFD(){
+    float radius = 8.0f;
+    int dim = 24;
+    marchSphere(mesh, radius, dim);
+    std::vector<cgp::Point> rest = mesh->verts.toVector();
+
+    // a control point moved while nothing was bound is applied in full when the mesh first follows the lattice
+    ffd bspline(7, 7, 7, cgp::Point(-10.0f, -10.0f, -10.0f), cgp::Vector(20.0f, 20.0f, 20.0f), FFDBasis::BSPLINE);
+    cgp::Point target = bspline.getCP(2, 3, 4);
+    target.x += 3.0f; target.y -= 2.0f;
+    bspline.setCP(2, 3, 4, target);
+    target = bspline.getCP(4, 4, 4);
+    target.z -= 4.0f;
+    CPPUNIT_ASSERT(mesh->moveFFDControlPoint(&bspline, 4, 4, 4, target));
+    std::vector<cgp::Point> full = rest;
+    bspline.deform(full.data(), full.size());
+    for(int v = 0; v < (int) full.size(); v++){
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(full[v].x, mesh->verts[v].x, 0.0001f);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(full[v].y, mesh->verts[v].y, 0.0001f);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(full[v].z, mesh->verts[v].z, 0.0001f);
+    }
+
+    // following the same lattice again after a smooth leaves the smoothed vertices as they are
+    mesh->laplacianSmooth(1, 0.5f);
+    CPPUNIT_ASSERT(!mesh->boundToFFD(&bspline));
+    std::vector<cgp::Point> smoothed = mesh->verts.toVector();
+    CPPUNIT_ASSERT(mesh->followFFD(&bspline));
+    CPPUNIT_ASSERT(mesh->boundToFFD(&bspline));
+    for(int v = 0; v < (int) smoothed.size(); v++){
+        CPPUNIT_ASSERT(mesh->verts[v].x == smoothed[v].x);
+        CPPUNIT_ASSERT(mesh->verts[v].y == smoothed[v].y);
+        CPPUNIT_ASSERT(mesh->verts[v].z == smoothed[v].z);
+    }
+
+    // moves made after a smooth are applied once, as if the smoothed vertices sat in an undeformed lattice
+    mesh->laplacianSmooth(1, 0.5f);
+    smoothed = mesh->verts.toVector();
+    ffd pending(7, 7, 7, cgp::Point(-10.0f, -10.0f, -10.0f), cgp::Vector(20.0f, 20.0f, 20.0f), FFDBasis::BSPLINE);
+    target = bspline.getCP(2, 3, 4);
+    target.z += 2.0f;
+    bspline.setCP(2, 3, 4, target);
+    target = pending.getCP(2, 3, 4);
+    target.z += 2.0f;
+    pending.setCP(2, 3, 4, target);
+    target = bspline.getCP(3, 3, 3);
+    target.x -= 1.5f;
+    CPPUNIT_ASSERT(mesh->moveFFDControlPoint(&bspline, 3, 3, 3, target));
+    target = pending.getCP(3, 3, 3);
+    target.x -= 1.5f;
+    pending.setCP(3, 3, 3, target);
+    pending.deform(smoothed.data(), smoothed.size());
+    for(int v = 0; v < (int) smoothed.size(); v++){
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(smoothed[v].x, mesh->verts[v].x, 0.0001f);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(smoothed[v].y, mesh->verts[v].y, 0.0001f);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(smoothed[v].z, mesh->verts[v].z, 0.0001f);
+    }
+
+    // a rebuilt mesh follows no lattice, so it receives the full deformation again
+    marchSphere(mesh, radius, dim);
+    CPPUNIT_ASSERT(mesh->followFFD(&bspline));
+    full = rest;
+    bspline.deform(full.data(), full.size());
+    for(int v = 0; v < (int) full.size(); v++){
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(full[v].x, mesh->verts[v].x, 0.0001f);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(full[v].y, mesh->verts[v].y, 0.0001f);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(full[v].z, mesh->verts[v].z, 0.0001f);
+    }
+
+    cerr << "MESH FOLLOW FFD PASSED" << endl << endl;
+}
+
+void TestMesh::testReorder(){
+    float radius = 8.0f;
+    int dim = 24;
+    marchSphere(mesh, radius, dim);
+    int numverts = (int) mesh->verts.size(), numtris = (int) mesh->tris.size();
+    double extracted = mesh->meanEdgeSpan();
+    ManifoldReport extractedreport;
+    mesh->manifoldCheck(extractedreport);
+
+    // scatter the vertices and triangles with a random permutation
+    std::vector<int> perm(numverts);
+    for(int v = 0; v < numverts; v++)
+        perm[v] = v;
+    srand(5);
+    for(int v = numverts - 1; v > 0; v--)
+        std::swap(perm[v], perm[rand() % (v + 1)]);
+    PointArray shuffled;
+    shuffled.resize(numverts);
+    for(int v = 0; v < numverts; v++)
+        shuffled[perm[v]] = mesh->verts[v];
+    mesh->verts.swap(shuffled);
+    for(Triangle & t: mesh->tris)
+        for(int p = 0; p < 3; p++)
+            t.v[p] = perm[t.v[p]];
+    for(int t = numtris - 1; t > 0; t--)
+        std::swap(mesh->tris[t], mesh->tris[rand() % (t + 1)]);
+    mesh->topologyChanged();
+
+    // triangle centroids identify the geometry independently of the ordering
+    auto centroids = [this](){
+        std::vector<std::tuple<float, float, float>> cs;
+        for(const Triangle & t: mesh->tris){
+            cgp::Point a = mesh->verts[t.v[0]], b = mesh->verts[t.v[1]], c = mesh->verts[t.v[2]];
+            cs.push_back(std::make_tuple(a.x + b.x + c.x, a.y + b.y + c.y, a.z + b.z + c.z));
+        }
+        std::sort(cs.begin(), cs.end());
+        return cs;
+    };
+    auto before = centroids();
+    double scattered = mesh->meanEdgeSpan();
+    CPPUNIT_ASSERT(scattered > 5.0 * extracted);
+
+    mesh->reorder();
+    CPPUNIT_ASSERT(mesh->meanEdgeSpan() < 0.2 * scattered);
+    std::vector<int> drawn;
+    for(const Triangle & t: mesh->tris)
+        for(int p = 0; p < 3; p++)
+            drawn.push_back(t.v[p]);
+    CPPUNIT_ASSERT(computeACMR(drawn, numverts) < 0.8f); // ready for the vertex cache as it stands
+    CPPUNIT_ASSERT((int) mesh->verts.size() == numverts);
+    CPPUNIT_ASSERT((int) mesh->tris.size() == numtris);
+    CPPUNIT_ASSERT(centroids() == before);
+
+    // winding and connectivity survive the remapping
+    ManifoldReport report;
+    mesh->manifoldCheck(report);
+    CPPUNIT_ASSERT(report.nonmanifoldedges.size() == extractedreport.nonmanifoldedges.size());
+    CPPUNIT_ASSERT(report.misorientededges.size() == extractedreport.misorientededges.size());
+    CPPUNIT_ASSERT(report.boundaryloops.size() == extractedreport.boundaryloops.size());
+    CPPUNIT_ASSERT(mesh->basicValidity());
+    CPPUNIT_ASSERT(mesh->pointContainment(cgp::Point(0.5f, 0.5f, 0.5f)));
+    CPPUNIT_ASSERT(!mesh->pointContainment(cgp::Point(11.0f, 0.0f, 0.0f)));
+
+    cerr << "MESH REORDER PASSED" << endl << endl;
+}
+
+void TestMesh::testVertexCache(){
+    float radius = 8.0f;
+    int dim = 24;
+    marchSphere(mesh, radius, dim);
+    int numverts = (int) mesh->verts.size();
+    std::vector<int> faces;
+    // extraction already orders the mesh for the cache, so start from a random triangle order
+    std::vector<Triangle> shuffled = mesh->tris;
+    srand(7);
+    for(int t = (int) shuffled.size() - 1; t > 0; t--)
+        std::swap(shuffled[t], shuffled[rand() % (t + 1)]);
+    for(const Triangle & t: shuffled)
+        for(int p = 0; p < 3; p++)
+            faces.push_back(t.v[p]);
+
+    // no reuse at all costs three vertices per triangle
+    std::vector<int> soup(faces.size());
+    for(int i = 0; i < (int) soup.size(); i++)
+        soup[i] = i;
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(3.0f, computeACMR(soup, (int) soup.size()), 0.0001f);
+
+    std::vector<int> optimised = faces;
+    float before = computeACMR(faces, numverts);
+    optimizeVertexCache(optimised, numverts);
+    float after = computeACMR(optimised, numverts);
+    CPPUNIT_ASSERT(after < before);
+    CPPUNIT_ASSERT(after < 0.8f);
+
+    // the same triangles with the same winding, compared after rotating each to start at its lowest index
+    auto canonical = [](const std::vector<int> & idx){
+        std::vector<std::tuple<int, int, int>> tris;
+        for(int t = 0; t < (int) idx.size() / 3; t++){
+            int a = idx[3*t], b = idx[3*t+1], c = idx[3*t+2];
+            while(a > b || a > c){
+                int tmp = a; a = b; b = c; c = tmp;
+            }
+            tris.push_back(std::make_tuple(a, b, c));
+        }
+        std::sort(tris.begin(), tris.end());
+        return tris;
+    };
+    CPPUNIT_ASSERT(canonical(optimised) == canonical(faces));
+
+    // fetch reordering numbers vertices by first use and leaves the cache behaviour unchanged
+    std::vector<int> remap, fetched = optimised;
+    optimizeVertexFetch(fetched, numverts, remap);
+    int seen = -1;
+    for(int i = 0; i < (int) fetched.size(); i++){
+        CPPUNIT_ASSERT(fetched[i] <= seen + 1);
+        seen = std::max(seen, fetched[i]);
+        CPPUNIT_ASSERT(fetched[i] == remap[optimised[i]]);
+    }
+    CPPUNIT_ASSERT_DOUBLES_EQUAL(after, computeACMR(fetched, numverts), 0.0001f);
+
+    cerr << "MESH VERTEX CACHE PASSED" << endl << endl;
+}
+
+void TestMesh::testCompactMesh(){
+    float radius = 8.0f;
+    int dim = 24;
+    marchSphere(mesh, radius, dim);
+    mesh->laplacianSmooth(2, 0.5f); // move vertices off the voxel lattice
+    PointArray full = mesh->verts;
+    std::vector<Triangle> fulltris = mesh->tris;
+
+    CompactMesh cmesh;
+    CPPUNIT_ASSERT(mesh->toCompact(cmesh));
+    CPPUNIT_ASSERT(!cmesh.wideIndices());
+    CPPUNIT_ASSERT(cmesh.numVerts() == full.size());
+    CPPUNIT_ASSERT(cmesh.numTris() == (int) fulltris.size());
+    CPPUNIT_ASSERT(mesh->memoryBytes() > 3 * cmesh.memoryBytes());
+
+    // topology is exact, positions within half a step and face normals derived from the quantised positions
+    cgp::Vector step = cmesh.quantisationStep();
+    mesh->fromCompact(cmesh);
+    CPPUNIT_ASSERT(mesh->norms.size() == mesh->verts.size());
+    for(int v = 0; v < full.size(); v++){
+        CPPUNIT_ASSERT(fabs(mesh->verts[v].x - full[v].x) <= 0.5f * step.i + 1.0e-5f);
+        CPPUNIT_ASSERT(fabs(mesh->verts[v].y - full[v].y) <= 0.5f * step.j + 1.0e-5f);
+        CPPUNIT_ASSERT(fabs(mesh->verts[v].z - full[v].z) <= 0.5f * step.k + 1.0e-5f);
+    }
+    for(int t = 0; t < (int) fulltris.size(); t++){
+        for(int p = 0; p < 3; p++)
+            CPPUNIT_ASSERT(mesh->tris[t].v[p] == fulltris[t].v[p]);
+        cgp::Vector n = cmesh.faceNormal(t);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(fulltris[t].n.i, n.i, 0.01f);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(fulltris[t].n.j, n.j, 0.01f);
+        CPPUNIT_ASSERT_DOUBLES_EQUAL(fulltris[t].n.k, n.k, 0.01f);
+    }
+
+    // a second round trip reproduces the compact form exactly
+    CompactMesh again;
+    CPPUNIT_ASSERT(mesh->toCompact(again));
+    for(int v = 0; v < cmesh.numVerts(); v++){
+        cgp::Point a = again.getVert(v), b = cmesh.getVert(v);
+        CPPUNIT_ASSERT(a.x == b.x && a.y == b.y && a.z == b.z);
+    }
+
+    // more than 65536 vertices needs 32 bit indices
+    PointArray many;
+    std::vector<Triangle> manytris(1);
+    for(int v = 0; v < 70000; v++)
+        many.push_back(cgp::Point((float) (v % 100), (float) (v / 100), 0.0f));
+    manytris[0].v[0] = 0; manytris[0].v[1] = 69999; manytris[0].v[2] = 65536;
+    CPPUNIT_ASSERT(cmesh.encode(many, manytris));
+    CPPUNIT_ASSERT(cmesh.wideIndices());
+    int v0, v1, v2;
+    cmesh.getTri(0, v0, v1, v2);
+    CPPUNIT_ASSERT(v0 == 0 && v1 == 69999 && v2 == 65536);
+    CPPUNIT_ASSERT(cgp::Point(cmesh.getVert(69999)) == cgp::Point(99.0f, 699.0f, 0.0f));
+
+    // invalid indices are refused
+    manytris[0].v[2] = 70000;
+    CPPUNIT_ASSERT(!cmesh.encode(many, manytris));
+    CPPUNIT_ASSERT(cmesh.numVerts() == 0);
+
+    cerr << "MESH COMPACT STORAGE PASSED" << endl << endl;
+}
+
 //#if 0 /* Disabled since it crashes the whole test suite */
 CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(TestMesh, TestSet::perBuild());
 //#endif
@@ -7,6 +7,7 @@
 
 #define private public
 #include "tesselate/mesh.h"
+#include "tesselate/compactmesh.h"
 #define private private
 
 /// Test code for @ref Mesh
@@ -14,8 +15,20 @@ class TestMesh : public CppUnit::TestFixture
 {
     CPPUNIT_TEST_SUITE(TestMesh);
     CPPUNIT_TEST(testMeshing);
+    CPPUNIT_TEST(testManifoldReport);
+    CPPUNIT_TEST(testSelfIntersections);
     CPPUNIT_TEST(testSmoothing);
+    CPPUNIT_TEST(testTaubinSmoothing);
+    CPPUNIT_TEST(testImplicitSmoothing);
     CPPUNIT_TEST(testMarchingCubes);
+    CPPUNIT_TEST(testBoxFit);
+    CPPUNIT_TEST(testUpdateNormals);
+    CPPUNIT_TEST(testAdjacency);
+    CPPUNIT_TEST(testIncrementalFFD);
+    CPPUNIT_TEST(testFollowFFD);
+    CPPUNIT_TEST(testReorder);
+    CPPUNIT_TEST(testVertexCache);
+    CPPUNIT_TEST(testCompactMesh);
     CPPUNIT_TEST_SUITE_END();
 
 private:
@@ -35,15 +48,75 @@ public:
      */
     void testMeshing();
 
+    /**
+     * Test that the manifold check reports each kind of violation on the small broken test meshes
+     */
+    void testManifoldReport();
+
+    /**
+     * Test that crossing and overlapping coplanar triangles are reported as self-intersections, and adjacent faces are not
+     */
+    void testSelfIntersections();
+
     /**
      * Test that the laplacian smoothing method correctly smooths a mesh
      */
     void testSmoothing();
 
+    /**
+     * Test that Taubin smoothing preserves the size of a voxelised sphere better than Laplacian smoothing
+     */
+    void testTaubinSmoothing();
+
+    /**
+     * Test that a single implicit smoothing step matches the analytic backward Euler solution on a tetrahedron
+     */
+    void testImplicitSmoothing();
+
     /**
      * Test that the marching cubes method correctly adds triangles to the mesh
      */
     void testMarchingCubes();
+
+    /**
+     * Test that box fitting centres and scales the vertices using the vectorised transform and bounds kernels
+     */
+    void testBoxFit();
+
+    /**
+     * Test that incremental normal updates after a local edit match a full recomputation
+     */
+    void testUpdateNormals();
+
+    /**
+     * Test that the shared adjacency structure reports correct one-rings and is rebuilt after topology changes
+     */
+    void testAdjacency();
+
+    /**
+     * Test that moving control points incrementally matches deforming the undeformed mesh with the final lattice
+     */
+    void testIncrementalFFD();
+
+    /**
+     * Test that binding to a lattice applies control point moves made beforehand, and that moves made before a smooth are not applied twice
+     */
+    void testFollowFFD();
+
+    /**
+     * Test that Morton reordering restores locality to a shuffled mesh without changing its geometry or topology
+     */
+    void testReorder();
+
+    /**
+     * Test that vertex cache optimisation lowers the miss ratio of an extracted isosurface while keeping every triangle and its winding
+     */
+    void testVertexCache();
+
+    /**
+     * Test that the compact mesh form is several times smaller, keeps topology exactly and positions within half a quantisation step
+     */
+    void testCompactMesh();
 };
 
 #endif /* !TILER_TEST_MESH_H */
@@ -12,6 +12,8 @@ class TestVoxels : public CppUnit::TestFixture
     CPPUNIT_TEST_SUITE(TestVoxels);
     CPPUNIT_TEST(testVoxelSet);
     CPPUNIT_TEST(testVoxelRegistration);
+    CPPUNIT_TEST(testVoxelCopy);
+    CPPUNIT_TEST(testSubVolume);
     CPPUNIT_TEST_SUITE_END();
 
 private:
@@ -34,6 +36,16 @@ public:
      * Check correspondence of voxel elements to 3D position
      */
     void testVoxelRegistration();
+
+    /**
+     * Check that copies of a voxel volume own independent grids
+     */
+    void testVoxelCopy();
+
+    /**
+     * Check that blocks of a grid are placed on word boundaries and combine with each other at their offsets
+     */
+    void testSubVolume();
 };
 
 #endif /* !TILER_TEST_VOXEL_H */